@@ -0,0 +1,533 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "aot.h"
+#include "embed.h"
+
+/* in the order of vm->flags, see FEQ through FCF in vm.h. */
+static const char* g_flag_names[FLAGS_MAX] = { "feq", "fneq", "fgt", "flt", "fgteq", "flteq", "fof", "fcf" };
+
+/* everything the generated code needs besides vm.h, the registers and flags live in
+ * locals and are only spilled to the vm around natives and when the function returns. */
+static const char* g_prelude =
+    "#include <stdint.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "#include \"vm.h\"\n"
+    "\n"
+    "#define THK_FAULT(ip, fault) do { vm->rip = (ip); THK_SPILL(); vm_fault(vm, (fault)); return; } while (0)\n"
+    "\n"
+    "#define THK_FLAGS(lhs, rhs) do { \\\n"
+    "    feq = (lhs) == (rhs); fneq = (lhs) != (rhs); \\\n"
+    "    fgt = (lhs) > (rhs); flt = (lhs) < (rhs); \\\n"
+    "    fgteq = (lhs) >= (rhs); flteq = (lhs) <= (rhs); \\\n"
+    "} while (0)\n"
+    "\n"
+    "#define THK_SIGNED_FLAGS(lhs, rhs) THK_FLAGS((int64_t)(lhs), (int64_t)(rhs))\n"
+    "\n"
+    "static inline uint8_t* thk_memory(VM* vm, uint64_t address, uint64_t len) {\n"
+    "    if (address > vm->memory_size || len > vm->memory_size - address)\n"
+    "        return NULL;\n"
+    "\n"
+    "    return &vm->memory[address];\n"
+    "}\n"
+    "\n"
+    "static inline int thk_push_qword(VM* vm, uint64_t value) {\n"
+    "    if (vm->rsp + sizeof(uint64_t) >= STACK_MAX)\n"
+    "        return 0;\n"
+    "\n"
+    "    memcpy(&vm->stack[vm->rsp], &value, sizeof(uint64_t));\n"
+    "    vm->rsp += sizeof(uint64_t);\n"
+    "    return 1;\n"
+    "}\n"
+    "\n"
+    "/* a byte at a time like the interpreter, a full stack keeps the bytes pushed so far. */\n"
+    "static inline int thk_push_bytes(VM* vm, uint64_t value) {\n"
+    "    const uint8_t* bytes = (const uint8_t*)&value;\n"
+    "\n"
+    "    for (uint8_t i = 0; i < sizeof(uint64_t); i++) {\n"
+    "        if (vm->rsp >= STACK_MAX)\n"
+    "            return 0;\n"
+    "\n"
+    "        vm->stack[vm->rsp] = bytes[i];\n"
+    "        vm->rsp += 1;\n"
+    "    }\n"
+    "\n"
+    "    return 1;\n"
+    "}\n"
+    "\n";
+
+static void emit_register(FILE* file, uint8_t reg) {
+    fprintf(file, "r%c", 'a' + reg);
+}
+
+static uint64_t immediate_at(const ParsedInstruction* parsed_instruction, uint8_t offset) {
+    uint64_t immediate = 0;
+    size_t len = parsed_instruction->operand_count;
+
+    if (len > offset)
+        memcpy(&immediate, &parsed_instruction->operands[offset], len - offset);
+
+    return immediate;
+}
+
+static void emit_spill(FILE* file, const char* name, int reload) {
+    fprintf(file, "#define %s() do { \\\n", name);
+
+    for (uint8_t i = 0; i < REGISTER_MAX; i++) {
+        if (reload)
+            fprintf(file, "    r%c = vm->registers[%u]; \\\n", 'a' + i, i);
+        else
+            fprintf(file, "    vm->registers[%u] = r%c; \\\n", i, 'a' + i);
+    }
+
+    for (uint8_t i = 0; i < FLAGS_MAX; i++) {
+        if (reload)
+            fprintf(file, "    %s = vm->flags[%u]; \\\n", g_flag_names[i], i);
+        else
+            fprintf(file, "    vm->flags[%u] = %s; \\\n", i, g_flag_names[i]);
+    }
+
+    fprintf(file, "} while (0)\n\n");
+}
+
+static void emit_init(FILE* file, const char* name, const uint8_t* code, uint64_t code_size, uint64_t start_rip) {
+    embed_emit_code(file, "g_code", code, code_size);
+
+    fprintf(file, "VM* %s_init(uint64_t memory_size) {\n", name);
+    fprintf(file, "    return vm_init(g_code, %lu, memory_size);\n", start_rip);
+    fprintf(file, "}\n\n");
+}
+
+static void emit_jump(FILE* file, const char* condition, uint64_t target) {
+    if (condition)
+        fprintf(file, "    if (%s)\n        goto block_%lu;\n", condition, target);
+    else
+        fprintf(file, "    goto block_%lu;\n", target);
+}
+
+static void emit_fault_if(FILE* file, const char* condition, uint64_t ip, const char* fault) {
+    fprintf(file, "    if (%s)\n        THK_FAULT(%lu, %s);\n", condition, ip, fault);
+}
+
+static void emit_arithmetic(FILE* file, const ParsedInstruction* parsed_instruction, const char* op) {
+    const uint8_t* operands = parsed_instruction->operands;
+
+    for (size_t i = 1; i < parsed_instruction->operand_count; i++) {
+        fprintf(file, "    ");
+        emit_register(file, operands[0]);
+        fprintf(file, " %s= ", op);
+        emit_register(file, operands[i]);
+        fprintf(file, ";\n");
+    }
+}
+
+/* division works on a copy so a faulting divisor leaves the destination untouched, and
+ * a divisor equal to the destination reads its value from before the instruction. */
+static void emit_divide(FILE* file, const ParsedInstruction* parsed_instruction, uint64_t ip, int is_signed) {
+    const uint8_t* operands = parsed_instruction->operands;
+    const char* type = is_signed ? "int64_t" : "uint64_t";
+    char dst = 'a' + operands[0];
+
+    fprintf(file, "    {\n        %s quotient = (%s)r%c;\n\n", type, type, dst);
+
+    for (size_t i = 1; i < parsed_instruction->operand_count; i++) {
+        char divisor = 'a' + operands[i];
+
+        fprintf(file, "        if (r%c == 0)\n            THK_FAULT(%lu, VM_FAULT_DIVIDE_BY_ZERO);\n", divisor, ip);
+
+        if (is_signed)
+            fprintf(file, "        if ((int64_t)r%c == -1 && quotient == INT64_MIN)\n            THK_FAULT(%lu, VM_FAULT_DIVIDE_OVERFLOW);\n", divisor, ip);
+
+        fprintf(file, "        quotient /= (%s)r%c;\n", type, divisor);
+    }
+
+    fprintf(file, "\n        r%c = (uint64_t)quotient;\n    }\n", dst);
+}
+
+static void emit_divide_immediate(FILE* file, const ParsedInstruction* parsed_instruction, uint64_t ip, int is_signed) {
+    uint8_t dst = parsed_instruction->operands[0];
+    uint64_t divisor = immediate_at(parsed_instruction, 1);
+
+    if (divisor == 0) {
+        fprintf(file, "    THK_FAULT(%lu, VM_FAULT_DIVIDE_BY_ZERO);\n", ip);
+        return;
+    }
+
+    if (!is_signed) {
+        fprintf(file, "    r%c /= %luULL;\n", 'a' + dst, divisor);
+        return;
+    }
+
+    if ((int64_t)divisor == -1)
+        fprintf(file, "    if (r%c == (uint64_t)INT64_MIN)\n        THK_FAULT(%lu, VM_FAULT_DIVIDE_OVERFLOW);\n", 'a' + dst, ip);
+
+    fprintf(file, "    r%c = (uint64_t)((int64_t)r%c / (int64_t)%luULL);\n", 'a' + dst, 'a' + dst, divisor);
+}
+
+static void emit_checked_arithmetic(FILE* file, const ParsedInstruction* parsed_instruction, const char* builtin) {
+    char dst = 'a' + parsed_instruction->operands[0];
+    char src = 'a' + parsed_instruction->operands[1];
+
+    fprintf(file, "    {\n        uint64_t result;\n        int64_t signed_result;\n");
+    fprintf(file, "        fcf = __builtin_%s_overflow(r%c, r%c, &result);\n", builtin, dst, src);
+    fprintf(file, "        fof = __builtin_%s_overflow((int64_t)r%c, (int64_t)r%c, &signed_result);\n", builtin, dst, src);
+    fprintf(file, "        r%c = result;\n    }\n", dst);
+}
+
+static void emit_memory(FILE* file, const ParsedInstruction* parsed_instruction, uint64_t ip, uint8_t width, int store) {
+    const uint8_t* operands = parsed_instruction->operands;
+    uint64_t offset = immediate_at(parsed_instruction, 2);
+
+    fprintf(file, "    {\n        uint8_t* at = thk_memory(vm, r%c + %luULL, %u);\n\n", 'a' + operands[1], offset, width);
+    fprintf(file, "        if (!at)\n            THK_FAULT(%lu, VM_FAULT_MEMORY_BOUNDS);\n\n", ip);
+
+    if (store) {
+        fprintf(file, "        memcpy(at, &r%c, %u);\n    }\n", 'a' + operands[0], width);
+    } else {
+        fprintf(file, "        uint64_t value = 0;\n        memcpy(&value, at, %u);\n", width);
+        fprintf(file, "        r%c = value;\n    }\n", 'a' + operands[0]);
+    }
+}
+
+static void emit_vector_memory(FILE* file, const ParsedInstruction* parsed_instruction, uint64_t ip, int store) {
+    const uint8_t* operands = parsed_instruction->operands;
+    uint64_t offset = immediate_at(parsed_instruction, 2);
+
+    fprintf(file, "    {\n        uint8_t* at = thk_memory(vm, r%c + %luULL, sizeof(vm->vregisters[%u]));\n\n", 'a' + operands[1], offset, operands[0]);
+    fprintf(file, "        if (!at)\n            THK_FAULT(%lu, VM_FAULT_MEMORY_BOUNDS);\n\n", ip);
+
+    if (store)
+        fprintf(file, "        memcpy(at, vm->vregisters[%u], sizeof(vm->vregisters[%u]));\n    }\n", operands[0], operands[0]);
+    else
+        fprintf(file, "        memcpy(vm->vregisters[%u], at, sizeof(vm->vregisters[%u]));\n    }\n", operands[0], operands[0]);
+}
+
+/* one instruction, every case mirrors the interpreter's evaluate including where it faults. */
+static void emit_instruction(FILE* file, const ParsedInstruction* parsed_instruction, uint64_t ip) {
+    const uint8_t* operands = parsed_instruction->operands;
+    size_t len = parsed_instruction->operand_count;
+    char dst = len > 0 ? 'a' + operands[0] : 0;
+    char src = len > 1 ? 'a' + operands[1] : 0;
+
+    fprintf(file, "    /* %lu: %s */\n", ip, vm_instruction_name(parsed_instruction->instruction));
+
+    switch (parsed_instruction->instruction) {
+    case INS_HALT:
+        fprintf(file, "    vm->rip = %lu;\n    THK_SPILL();\n    return;\n", ip + 1);
+        break;
+
+    case INS_IADD:
+        fprintf(file, "    r%c += %luULL;\n", dst, immediate_at(parsed_instruction, 1));
+        break;
+
+    case INS_ISUB:
+        fprintf(file, "    r%c -= %luULL;\n", dst, immediate_at(parsed_instruction, 1));
+        break;
+
+    case INS_IMUL:
+        fprintf(file, "    r%c *= %luULL;\n", dst, immediate_at(parsed_instruction, 1));
+        break;
+
+    case INS_IDIV:
+        emit_divide_immediate(file, parsed_instruction, ip, 0);
+        break;
+
+    case INS_ADD:
+        emit_arithmetic(file, parsed_instruction, "+");
+        break;
+
+    case INS_SUB:
+        emit_arithmetic(file, parsed_instruction, "-");
+        break;
+
+    case INS_MUL:
+        emit_arithmetic(file, parsed_instruction, "*");
+        break;
+
+    case INS_DIV:
+        emit_divide(file, parsed_instruction, ip, 0);
+        break;
+
+    case INS_IPUSH:
+        fprintf(file, "    if (!thk_push_qword(vm, %luULL))\n        THK_FAULT(%lu, VM_FAULT_STACK_OVERFLOW);\n", immediate_at(parsed_instruction, 0), ip);
+        break;
+
+    case INS_PUSH:
+        fprintf(file, "    if (vm->rsp + %zu >= STACK_MAX)\n        THK_FAULT(%lu, VM_FAULT_STACK_OVERFLOW);\n", len, ip);
+
+        for (size_t i = 0; i < len; i++)
+            fprintf(file, "    if (!thk_push_bytes(vm, r%c))\n        THK_FAULT(%lu, VM_FAULT_STACK_OVERFLOW);\n", 'a' + operands[i], ip);
+
+        break;
+
+    case INS_POP:
+        emit_fault_if(file, "vm->rsp < sizeof(uint64_t)", ip, "VM_FAULT_STACK_UNDERFLOW");
+        fprintf(file, "    memcpy(&r%c, &vm->stack[vm->rsp - sizeof(uint64_t)], sizeof(uint64_t));\n", dst);
+        fprintf(file, "    vm->rsp -= sizeof(uint64_t);\n");
+        break;
+
+    /* imove only overwrites as many low bytes as it carries. */
+    case INS_IMOVE:
+        if (len - 1 >= sizeof(uint64_t))
+            fprintf(file, "    r%c = %luULL;\n", dst, immediate_at(parsed_instruction, 1));
+        else
+            fprintf(file, "    r%c = (r%c & ~((1ULL << %zu) - 1)) | %luULL;\n", dst, dst, (len - 1) * 8, immediate_at(parsed_instruction, 1));
+
+        break;
+
+    case INS_MOVE:
+        fprintf(file, "    r%c = r%c;\n", dst, src);
+        break;
+
+    case INS_ICMP:
+        fprintf(file, "    THK_FLAGS(r%c, %luULL);\n", dst, immediate_at(parsed_instruction, 1));
+        break;
+
+    case INS_CMP:
+        fprintf(file, "    THK_FLAGS(r%c, r%c);\n", dst, src);
+        break;
+
+    case INS_JMP:
+        emit_jump(file, NULL, cfg_jump_target(parsed_instruction));
+        break;
+
+    case INS_JE:
+        emit_jump(file, "feq", cfg_jump_target(parsed_instruction));
+        break;
+
+    case INS_JNE:
+        emit_jump(file, "fneq", cfg_jump_target(parsed_instruction));
+        break;
+
+    case INS_JG:
+        emit_jump(file, "fgt", cfg_jump_target(parsed_instruction));
+        break;
+
+    case INS_JL:
+        emit_jump(file, "flt", cfg_jump_target(parsed_instruction));
+        break;
+
+    case INS_JGE:
+        emit_jump(file, "fgteq", cfg_jump_target(parsed_instruction));
+        break;
+
+    case INS_JLE:
+        emit_jump(file, "flteq", cfg_jump_target(parsed_instruction));
+        break;
+
+    case INS_LOOP:
+        fprintf(file, "    r%c -= 1;\n    THK_FLAGS(r%c, 0ULL);\n", dst, dst);
+        emit_jump(file, "fgt", cfg_jump_target(parsed_instruction));
+        break;
+
+    case INS_CALL:
+        emit_fault_if(file, "vm->rcsp >= CALL_STACK_MAX", ip, "VM_FAULT_CALL_STACK_OVERFLOW");
+        fprintf(file, "    vm->call_stack[vm->rcsp++] = %lu;\n", ip + parsed_instruction->size);
+        emit_jump(file, NULL, cfg_jump_target(parsed_instruction));
+        break;
+
+    case INS_RET:
+        emit_fault_if(file, "vm->rcsp == 0", ip, "VM_FAULT_CALL_STACK_UNDERFLOW");
+        fprintf(file, "    vm->rip = vm->call_stack[--vm->rcsp];\n    goto dispatch;\n");
+        break;
+
+    case INS_LOADB:
+        emit_memory(file, parsed_instruction, ip, 1, 0);
+        break;
+
+    case INS_LOADW:
+        emit_memory(file, parsed_instruction, ip, 2, 0);
+        break;
+
+    case INS_LOADD:
+        emit_memory(file, parsed_instruction, ip, 4, 0);
+        break;
+
+    case INS_LOADQ:
+        emit_memory(file, parsed_instruction, ip, 8, 0);
+        break;
+
+    case INS_STOREB:
+        emit_memory(file, parsed_instruction, ip, 1, 1);
+        break;
+
+    case INS_STOREW:
+        emit_memory(file, parsed_instruction, ip, 2, 1);
+        break;
+
+    case INS_STORED:
+        emit_memory(file, parsed_instruction, ip, 4, 1);
+        break;
+
+    case INS_STOREQ:
+        emit_memory(file, parsed_instruction, ip, 8, 1);
+        break;
+
+    case INS_MEMCPY:
+    case INS_MEMSET: {
+        char len_reg = 'a' + operands[2];
+
+        fprintf(file, "    {\n        uint8_t* to = thk_memory(vm, r%c, r%c);\n", dst, len_reg);
+
+        if (parsed_instruction->instruction == INS_MEMCPY)
+            fprintf(file, "        uint8_t* from = thk_memory(vm, r%c, r%c);\n\n        if (!to || !from)\n", src, len_reg);
+        else
+            fprintf(file, "\n        if (!to)\n");
+
+        fprintf(file, "            THK_FAULT(%lu, VM_FAULT_MEMORY_BOUNDS);\n\n", ip);
+
+        if (parsed_instruction->instruction == INS_MEMCPY)
+            fprintf(file, "        memmove(to, from, r%c);\n    }\n", len_reg);
+        else
+            fprintf(file, "        memset(to, (uint8_t)r%c, r%c);\n    }\n", src, len_reg);
+
+        break;
+    }
+
+    case INS_VADD:
+        fprintf(file, "    vm->simd->add(vm->vregisters[%u], vm->vregisters[%u]);\n", operands[0], operands[1]);
+        break;
+
+    case INS_VSUB:
+        fprintf(file, "    vm->simd->sub(vm->vregisters[%u], vm->vregisters[%u]);\n", operands[0], operands[1]);
+        break;
+
+    case INS_VMUL:
+        fprintf(file, "    vm->simd->mul(vm->vregisters[%u], vm->vregisters[%u]);\n", operands[0], operands[1]);
+        break;
+
+    case INS_VSUM:
+        fprintf(file, "    r%c = vm->simd->sum(vm->vregisters[%u]);\n", dst, operands[1]);
+        break;
+
+    case INS_VSPLAT:
+        fprintf(file, "    for (uint8_t lane = 0; lane < VECTOR_LANES; lane++)\n        vm->vregisters[%u][lane] = r%c;\n", operands[0], src);
+        break;
+
+    case INS_VLOAD:
+        emit_vector_memory(file, parsed_instruction, ip, 0);
+        break;
+
+    case INS_VSTORE:
+        emit_vector_memory(file, parsed_instruction, ip, 1);
+        break;
+
+    /* a native sees and may change the whole vm, so everything goes through memory around it. */
+    case INS_CALLNATIVE:
+        fprintf(file, "    vm->rip = %lu;\n    THK_SPILL();\n    vm_call_native(vm, %u);\n    THK_RELOAD();\n\n", ip, operands[0]);
+        fprintf(file, "    if (vm->fault != VM_FAULT_NONE)\n        return;\n");
+        break;
+
+    case INS_SDIV:
+        emit_divide(file, parsed_instruction, ip, 1);
+        break;
+
+    case INS_ISDIV:
+        emit_divide_immediate(file, parsed_instruction, ip, 1);
+        break;
+
+    case INS_ADDO:
+        emit_checked_arithmetic(file, parsed_instruction, "add");
+        break;
+
+    case INS_SUBO:
+        emit_checked_arithmetic(file, parsed_instruction, "sub");
+        break;
+
+    case INS_MULO:
+        emit_checked_arithmetic(file, parsed_instruction, "mul");
+        break;
+
+    case INS_SCMP:
+        fprintf(file, "    THK_SIGNED_FLAGS(r%c, r%c);\n", dst, src);
+        break;
+
+    case INS_ISCMP:
+        fprintf(file, "    THK_SIGNED_FLAGS(r%c, %luULL);\n", dst, immediate_at(parsed_instruction, 1));
+        break;
+
+    case INS_WMUL:
+        fprintf(file, "    {\n        unsigned __int128 product = (unsigned __int128)r%c * r%c;\n\n", src, 'a' + operands[2]);
+        fprintf(file, "        r%c = (uint64_t)product;\n        r%c = (uint64_t)(product >> 64);\n    }\n", src, dst);
+        break;
+
+    case INS_JO:
+        emit_jump(file, "fof", cfg_jump_target(parsed_instruction));
+        break;
+
+    case INS_JC:
+        emit_jump(file, "fcf", cfg_jump_target(parsed_instruction));
+        break;
+
+    default:
+        fprintf(file, "    THK_FAULT(%lu, VM_FAULT_UNKNOWN_OPCODE);\n", ip);
+        break;
+    }
+}
+
+/* the compiled function starts wherever vm->rip is, which has to be the start of a block
+ * or just past a halt. that covers a fresh vm, returns and a vm that already halted. */
+static void emit_dispatch(FILE* file, cvector_vector_type(ParsedInstruction) parsed_instructions, const CFG* cfg) {
+    int returns = 0;
+
+    for (size_t i = 0; i < cvector_size(parsed_instructions); i++)
+        returns |= parsed_instructions[i].instruction == INS_RET;
+
+    /* ret jumps back here, the label would be unused without one. */
+    if (returns)
+        fprintf(file, "dispatch:\n");
+
+    fprintf(file, "    switch (vm->rip) {\n");
+
+    for (size_t i = 0; i < cvector_size(cfg->blocks); i++)
+        fprintf(file, "    case %lu: goto block_%lu;\n", cfg->blocks[i].ip, cfg->blocks[i].ip);
+
+    for (size_t i = 0; i < cvector_size(parsed_instructions); i++) {
+        if (parsed_instructions[i].instruction == INS_HALT)
+            fprintf(file, "    case %lu: return;\n", cfg->ip_of[i] + 1);
+    }
+
+    fprintf(file, "    default:\n        vm_fault(vm, VM_FAULT_UNKNOWN_OPCODE);\n        return;\n    }\n\n");
+}
+
+void aot_emit_c(FILE* file, const char* name, cvector_vector_type(ParsedInstruction) parsed_instructions, const CFG* cfg, cvector_vector_type(Symbol) symbols, const uint8_t* code, uint64_t code_size, uint64_t start_rip) {
+    fprintf(file, "/* generated by thorkell --emit-c, do not edit. */\n\n");
+    fprintf(file, "%s", g_prelude);
+
+    emit_spill(file, "THK_SPILL", 0);
+    emit_spill(file, "THK_RELOAD", 1);
+    emit_init(file, name, code, code_size, start_rip);
+
+    fprintf(file, "void %s_execute(VM* vm) {\n", name);
+
+    for (uint8_t i = 0; i < REGISTER_MAX; i++)
+        fprintf(file, "    uint64_t r%c;\n", 'a' + i);
+
+    for (uint8_t i = 0; i < FLAGS_MAX; i++)
+        fprintf(file, "    uint8_t %s;\n", g_flag_names[i]);
+
+    fprintf(file, "\n    if (vm->fault != VM_FAULT_NONE)\n        return;\n\n    THK_RELOAD();\n\n");
+
+    emit_dispatch(file, parsed_instructions, cfg);
+
+    for (size_t i = 0; i < cvector_size(parsed_instructions); i++) {
+        size_t block = cfg->block_of[i];
+        uint64_t ip = cfg->ip_of[i];
+
+        if (cfg->blocks[block].first == i) {
+            fprintf(file, "block_%lu:", ip);
+
+            for (size_t j = 0; j < cvector_size(symbols); j++) {
+                if (symbols[j].ip == ip)
+                    fprintf(file, " /* %.*s */", (int)symbols[j].span.len, symbols[j].span.data);
+            }
+
+            fprintf(file, "\n");
+        }
+
+        emit_instruction(file, &parsed_instructions[i], ip);
+    }
+
+    fprintf(file, "}\n");
+}
@@ -0,0 +1,20 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cvector.h"
+#include "cfg.h"
+#include "parser.h"
+
+/* writes a c translation unit that runs the program without the interpreter. it defines
+ *
+ *     VM* <name>_init(uint64_t memory_size);
+ *     void <name>_execute(VM* vm);
+ *
+ * and links against vm.c. code is the bytecode of parsed_instructions, kept in the unit
+ * so a compiled vm can still be single stepped or snapshotted by the interpreter. */
+void aot_emit_c(FILE* file, const char* name, cvector_vector_type(ParsedInstruction) parsed_instructions, const CFG* cfg, cvector_vector_type(Symbol) symbols, const uint8_t* code, uint64_t code_size, uint64_t start_rip);
+
+#endif /* AOT_H */
@@ -0,0 +1,44 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "thorkell.h"
+
+/* shared by the benchmarks, each is a program of its own that prints what it measured. */
+
+static inline double bench_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/* a benchmark has nothing to fall back on, a source that does not assemble ends it. */
+static inline ThorkellProgram bench_assemble(const char* source, int flags) {
+    ThorkellProgram program;
+    ThorkellError error;
+
+    if (thorkell_assemble(source, flags, &program, &error) != THORKELL_OK) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+
+    return program;
+}
+
+static inline VM* bench_load(const ThorkellProgram* program, uint64_t memory_size) {
+    ThorkellError error;
+    VM* vm = thorkell_load(program, memory_size, &error);
+
+    if (!vm) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+
+    return vm;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,122 @@
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "chunked.h"
+
+#define BENCH_SOURCE_SIZE (8 << 20)
+#define BENCH_BLOCK_LINES 1024 /* lines between labels, the parser looks labels up one by one */
+#define BENCH_RUNS 3
+
+/* a label of letters only, q and i in base 26 after it. */
+static size_t label(char* to, size_t i) {
+    size_t len = 0;
+
+    to[len++] = 'q';
+
+    do {
+        to[len++] = 'a' + i % 26;
+        i /= 26;
+    } while (i > 0);
+
+    return len;
+}
+
+/* up to size bytes of generated source: blocks of arithmetic, each under a label and
+ * ending in a jump back to the label of the block before it. */
+static char* generate(size_t size) {
+    char* source = malloc(size + 64);
+    size_t at = 0;
+
+    if (!source) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+
+    for (size_t block = 0; at + BENCH_BLOCK_LINES * 16 < size; block++) {
+        at += label(&source[at], block);
+        at += sprintf(&source[at], ": move RA, %zu\n", block);
+
+        for (int line = 0; line < BENCH_BLOCK_LINES - 3; line++)
+            at += sprintf(&source[at], "%s RB, %d\n", line % 2 ? "add" : "mul", line + 1);
+
+        at += sprintf(&source[at], "cmp RA, RB\njl ");
+        at += label(&source[at], block > 0 ? block - 1 : 0);
+        source[at++] = '\n';
+    }
+
+    strcpy(&source[at], "start: halt\n");
+
+    return source;
+}
+
+/* the seconds of the fastest run and the cpu seconds all its threads took. */
+static double best_of(const char* source, size_t threads, ThorkellProgram* program, double* cpu_seconds) {
+    double best = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        ThorkellError error;
+        struct timespec cpu_started;
+        struct timespec cpu_stopped;
+
+        thorkell_program_free(program);
+
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_started);
+        double started = bench_seconds();
+        ThorkellStatus status = threads ? chunked_assemble(source, 0, threads, program, &error) : thorkell_assemble(source, 0, program, &error);
+        double seconds = bench_seconds() - started;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_stopped);
+
+        if (status != THORKELL_OK) {
+            fprintf(stderr, "ERROR: %s\n", error.message);
+            exit(1);
+        }
+
+        if (run == 0 || seconds < best) {
+            best = seconds;
+            *cpu_seconds = (cpu_stopped.tv_sec - cpu_started.tv_sec) + (cpu_stopped.tv_nsec - cpu_started.tv_nsec) / 1e9;
+        }
+    }
+
+    return best;
+}
+
+/* chunked_assemble on 1 to twice the cpus threads, at least 4, against thorkell_assemble.
+ * the speedup is over chunked_assemble on one thread so the parallelism shows on its
+ * own, and the cpu time tells it apart from the work the split saves or adds. */
+int main() {
+    char* source = generate(BENCH_SOURCE_SIZE);
+    size_t len = strlen(source);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = cpus > 2 ? 2 * (size_t)cpus : 4;
+    ThorkellProgram expected = { 0 };
+    ThorkellProgram program = { 0 };
+    double cpu_seconds;
+
+    printf("chunked: %zu bytes of generated source, %ld cpus\n", len, cpus);
+
+    double seconds = best_of(source, 0, &expected, &cpu_seconds);
+    printf("  %-19s: %.3f s, %.3f cpu s, %6.1f MB/s\n", "thorkell_assemble", seconds, cpu_seconds, len / seconds / 1e6);
+
+    double one = 0;
+
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        seconds = best_of(source, threads, &program, &cpu_seconds);
+        one = threads == 1 ? seconds : one;
+
+        if (cvector_size(program.code) != cvector_size(expected.code) || memcmp(program.code, expected.code, cvector_size(expected.code))
+                || program.start_rip != expected.start_rip) {
+            fprintf(stderr, "ERROR: %zu threads assembled other code\n", threads);
+            return 1;
+        }
+
+        printf("  chunked, %2zu threads: %.3f s, %.3f cpu s, %6.1f MB/s, %.2fx over one thread\n", threads, seconds, cpu_seconds, len / seconds / 1e6,
+               one / seconds);
+    }
+
+    thorkell_program_free(&program);
+    thorkell_program_free(&expected);
+    free(source);
+
+    return 0;
+}
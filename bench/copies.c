@@ -0,0 +1,69 @@
+#include "bench.h"
+
+#define BENCH_ITERATIONS 1000000
+#define STRING(x) #x
+#define EXPAND(x) STRING(x)
+
+/* the way scripts tend to be written: every value goes through a chain of moves and the
+ * loop compares the counter again for each branch. the registers are cleared at the end,
+ * so -O can drop the copies no one reads, and the flags of the first compare still hold
+ * for the others. */
+static const char* g_source =
+    "done: move RA, 0\n"
+    "move RB, 0\n"
+    "move RE, 0\n"
+    "move RG, 0\n"
+    "halt\n"
+    "high: add RH, 1\n"
+    "loop: move RA, RD\n"
+    "move RB, RA\n"
+    "move RC, RB\n"
+    "mul RC, 3\n"
+    "move RE, RC\n"
+    "move RG, RE\n"
+    "add RF, RG\n"
+    "add RD, 1\n"
+    "cmp RD, " EXPAND(BENCH_ITERATIONS) "\n"
+    "je done\n"
+    "cmp RD, " EXPAND(BENCH_ITERATIONS) "\n"
+    "jl loop\n"
+    "cmp RD, " EXPAND(BENCH_ITERATIONS) "\n"
+    "jg high\n"
+    "start: move RD, 0\n"
+    "jmp loop\n";
+
+static uint64_t run(const char* name, int flags, uint64_t expected) {
+    ThorkellProgram program = bench_assemble(g_source, flags);
+    VM* vm = bench_load(&program, 0);
+
+    double started = bench_seconds();
+    vm_execute(vm);
+    double seconds = bench_seconds() - started;
+    uint64_t instructions = vm->stats.instructions;
+
+    if (vm->fault != VM_FAULT_NONE || vm->registers[5] != expected) {
+        fprintf(stderr, "ERROR: %s came out as %lu, not %lu\n", name, vm->registers[5], expected);
+        exit(1);
+    }
+
+    printf("  %-9s: %9lu instructions, %5.2f per iteration, %.3f s\n", name, instructions, (double)instructions / BENCH_ITERATIONS, seconds);
+
+    vm_deinit(vm);
+    thorkell_program_free(&program);
+
+    return instructions;
+}
+
+int main() {
+    uint64_t expected = 0;
+
+    for (uint64_t i = 0; i < BENCH_ITERATIONS; i++)
+        expected += i * 3;
+
+    printf("copies: %d iterations of a move chain and three compares\n", BENCH_ITERATIONS);
+    uint64_t plain = run("plain", 0, expected);
+    uint64_t optimized = run("optimized", THORKELL_OPTIMIZE, expected);
+    printf("  -O executes %.1f%% fewer instructions\n", 100.0 * (plain - optimized) / plain);
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "bench.h"
+
+#define BENCH_N 27
+#define STRING(x) #x
+#define EXPAND(x) STRING(x)
+
+/* fib(n) with both recursive calls made, the return address of each on the call stack. */
+static const char* g_source =
+    "base: ret\n"
+    "fib: cmp RA, 2\n"
+    "jl base\n"
+    "push RA\n"
+    "sub RA, 1\n"
+    "call fib\n"
+    "pop RB\n"
+    "push RA\n"
+    "move RA, RB\n"
+    "sub RA, 2\n"
+    "call fib\n"
+    "pop RB\n"
+    "add RA, RB\n"
+    "ret\n"
+    "start: move RA, " EXPAND(BENCH_N) "\n"
+    "call fib\n"
+    "halt\n";
+
+static uint64_t calls(uint64_t n) {
+    return n < 2 ? 1 : 1 + calls(n - 1) + calls(n - 2);
+}
+
+static uint64_t fib(uint64_t n) {
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+int main() {
+    const char* names[] = { "plain", "optimized" };
+    uint64_t call_count = calls(BENCH_N);
+
+    for (int flags = 0; flags <= THORKELL_OPTIMIZE; flags++) {
+        ThorkellProgram program = bench_assemble(g_source, flags);
+        VM* vm = bench_load(&program, 0);
+
+        double started = bench_seconds();
+        vm_execute(vm);
+        double seconds = bench_seconds() - started;
+
+        if (vm->fault != VM_FAULT_NONE || vm->registers[0] != fib(BENCH_N)) {
+            fprintf(stderr, "ERROR: fib(%d) came out as %lu\n", BENCH_N, vm->registers[0]);
+            return 1;
+        }
+
+        printf("fib(%d) %-9s: %lu calls in %.3f s, %5.1f ns per call and return, %6.1f M instructions/s%s\n", BENCH_N, names[flags], call_count,
+               seconds, seconds * 1e9 / call_count, vm->stats.instructions / seconds / 1e6, vm->verified ? "" : ", unverified");
+
+        vm_deinit(vm);
+        thorkell_program_free(&program);
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <string.h>
+
+#include "bench.h"
+#include "incremental.h"
+
+#define BENCH_EDITS 200 /* of each kind, every other one undoes the one before */
+
+/* a label of letters only, q and i in base 26 after it. */
+static size_t label(char* to, size_t i) {
+    size_t len = 0;
+
+    to[len++] = 'q';
+
+    do {
+        to[len++] = 'a' + i % 26;
+        i /= 26;
+    } while (i > 0);
+
+    return len;
+}
+
+/* labels sections of a small loop each jumping back to the one before, and where the
+ * middle one starts. */
+static char* generate(size_t labels, size_t* middle) {
+    char* source = malloc(labels * 64 + 64);
+    size_t at = 0;
+
+    if (!source) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < labels; i++) {
+        if (i == labels / 2)
+            *middle = at;
+
+        at += label(&source[at], i);
+        at += sprintf(&source[at], ": add RA, 1\nadd RB, RA\ncmp RB, 100\njl ");
+        at += label(&source[at], i > 0 ? i - 1 : 0);
+        source[at++] = '\n';
+    }
+
+    strcpy(&source[at], "start: halt\n");
+
+    return source;
+}
+
+static void edit(IncrementalAssembler* assembler, size_t offset, size_t removed, const char* text) {
+    ThorkellError error;
+
+    if (incremental_edit(assembler, offset, removed, text, &error) != THORKELL_OK) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+}
+
+/* the microseconds an edit takes, made at offset and undone in turn. */
+static double time_edits(IncrementalAssembler* assembler, size_t offset, size_t removed, const char* text, const char* undo, size_t* relinked) {
+    double started = bench_seconds();
+
+    for (int i = 0; i < BENCH_EDITS; i += 2) {
+        edit(assembler, offset, removed, text);
+        *relinked = incremental_stats(assembler).relinked_sections;
+        edit(assembler, offset, strlen(text), undo);
+    }
+
+    return (bench_seconds() - started) * 1e6 / BENCH_EDITS;
+}
+
+/* one line edits in the middle of programs of growing size: a digit, which keeps the
+ * labels and sizes, an added line, which moves the code after it, and an added label.
+ * the first should take the same time at any size. whole is the source typed into a
+ * new assembler in one edit, which the edited program has to match. thorkell_assemble
+ * looks labels up one by one and would take minutes on the largest. */
+int main() {
+    size_t sizes[] = { 1000, 10000, 100000 };
+
+    printf("incremental: one line edits in the middle, us per edit and sections relinked\n");
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t middle = 0;
+        char* source = generate(sizes[i], &middle);
+        size_t digit = middle + label((char[32]) { 0 }, sizes[i] / 2) + strlen(": add RA, ");
+        size_t line = middle + strcspn(&source[middle], "\n") + 1;
+        IncrementalAssembler* assembler = incremental_init();
+        IncrementalAssembler* whole_assembler = incremental_init();
+        size_t relinked_digit;
+        size_t relinked_line;
+        size_t relinked_label;
+
+        if (!assembler || !whole_assembler) {
+            fprintf(stderr, "ERROR: out of memory\n");
+            return 1;
+        }
+
+        double started = bench_seconds();
+        edit(whole_assembler, 0, 0, source);
+        double whole = bench_seconds() - started;
+        const ThorkellProgram* expected = incremental_program(whole_assembler);
+
+        edit(assembler, 0, 0, source);
+
+        double digit_us = time_edits(assembler, digit, 1, "7", "1", &relinked_digit);
+        double line_us = time_edits(assembler, line, 0, "add RC, 1\n", "", &relinked_line);
+        double label_us = time_edits(assembler, line, 0, "extra: add RC, 1\n", "", &relinked_label);
+        const ThorkellProgram* program = incremental_program(assembler);
+
+        if (cvector_size(program->code) != cvector_size(expected->code) || memcmp(program->code, expected->code, cvector_size(expected->code))
+                || program->start_rip != expected->start_rip) {
+            fprintf(stderr, "ERROR: %zu labels edited back are other code\n", sizes[i]);
+            return 1;
+        }
+
+        printf("  %6zu labels: digit %7.2f us, %zu relinked, line %8.2f us, %6zu relinked, label %8.2f us, %6zu relinked, whole %7.2f ms\n", sizes[i],
+               digit_us, relinked_digit, line_us, relinked_line, label_us, relinked_label, whole * 1e3);
+
+        incremental_deinit(assembler);
+        incremental_deinit(whole_assembler);
+        free(source);
+    }
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include <string.h>
+
+#include "bench.h"
+#include "profile.h"
+
+#define BENCH_RUNS 3
+
+/* the corpus the layout is measured on. labels only resolve backwards, so handlers and
+ * helpers sit above the code that jumps to them and the entry comes last. */
+typedef struct Corpus_t {
+    const char* name;
+    const char* source;
+} Corpus;
+
+static const Corpus g_corpus[] = {
+    { "fib", "base: ret\n"
+             "fib: cmp RA, 2\n"
+             "jl base\n"
+             "push RA\n"
+             "sub RA, 1\n"
+             "call fib\n"
+             "pop RB\n"
+             "push RA\n"
+             "move RA, RB\n"
+             "sub RA, 2\n"
+             "call fib\n"
+             "pop RB\n"
+             "add RA, RB\n"
+             "ret\n"
+             "start: move RA, 24\n"
+             "call fib\n"
+             "halt\n" },
+    { "checked", "overflow: move RE, 1\n"
+                 "move RF, RA\n"
+                 "move RG, RB\n"
+                 "halt\n"
+                 "negative: move RE, 2\n"
+                 "move RF, RA\n"
+                 "move RG, RB\n"
+                 "halt\n"
+                 "toolarge: move RE, 3\n"
+                 "move RF, RA\n"
+                 "move RG, RB\n"
+                 "halt\n"
+                 "start: move RD, 0\n"
+                 "outer: move RB, 0\n"
+                 "move RC, 3\n"
+                 "loop: loadq RA, RB\n"
+                 "cmp RA, 1000000\n"
+                 "jg toolarge\n"
+                 "mul RA, RC\n"
+                 "addo RF, RA\n"
+                 "jo overflow\n"
+                 "add RB, 8\n"
+                 "cmp RB, 70000\n"
+                 "jg negative\n"
+                 "cmp RB, 65536\n" /* MEMORY_DEFAULT */
+                 "jl loop\n"
+                 "add RD, 1\n"
+                 "cmp RD, 40\n"
+                 "jl outer\n"
+                 "halt\n" },
+    { "reduce", "start: move RD, 0\n"
+                "outer: move RB, 0\n"
+                "inner: loadq RC, RB\n"
+                "add RA, RC\n"
+                "add RB, 8\n"
+                "cmp RB, 65536\n" /* MEMORY_DEFAULT */
+                "jl inner\n"
+                "add RD, 1\n"
+                "cmp RD, 40\n"
+                "jl outer\n"
+                "halt\n" },
+};
+
+static double best_of(const ThorkellProgram* program, VM** last) {
+    double best = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        VM* vm = bench_load(program, MEMORY_DEFAULT);
+
+        double started = bench_seconds();
+        vm_execute(vm);
+        double seconds = bench_seconds() - started;
+
+        best = run == 0 || seconds < best ? seconds : best;
+
+        if (*last)
+            vm_deinit(*last);
+
+        *last = vm;
+    }
+
+    return best;
+}
+
+/* every program of the corpus is profiled, laid out for its profile and run both ways.
+ * what the layout changed is counted from the profile: taken jumps, dispatches and the
+ * cache lines of code the run executed. */
+int main() {
+    printf("layout: taken jumps, dispatches and hot %d byte cache lines, source order -> profiled layout\n", LAYOUT_CACHE_LINE);
+
+    for (size_t i = 0; i < sizeof(g_corpus) / sizeof(g_corpus[0]); i++) {
+        const Corpus* corpus = &g_corpus[i];
+        ThorkellProgram program = bench_assemble(corpus->source, 0);
+        ThorkellProgram laid_out;
+        ThorkellError error;
+        LayoutStats stats;
+        Profile* profile = profile_init(program.code, cvector_size(program.code));
+        VM* vm = bench_load(&program, MEMORY_DEFAULT);
+
+        profile_run(vm, profile);
+        vm_deinit(vm);
+
+        if (thorkell_assemble_profiled(corpus->source, 0, profile, &laid_out, &stats, &error) != THORKELL_OK) {
+            fprintf(stderr, "ERROR: %s: %s\n", corpus->name, error.message);
+            return 1;
+        }
+
+        VM* before = NULL;
+        VM* after = NULL;
+        double seconds_before = best_of(&program, &before);
+        double seconds_after = best_of(&laid_out, &after);
+
+        if (before->fault != after->fault || memcmp(before->registers, after->registers, sizeof(before->registers))) {
+            fprintf(stderr, "ERROR: %s ends differently once laid out\n", corpus->name);
+            return 1;
+        }
+
+        printf("  %-8s: %8lu -> %8lu taken, %9lu -> %9lu dispatches, %2lu -> %2lu lines, %lu hot bytes, %lu cold, %.2f -> %.2f ms\n", corpus->name,
+               stats.taken_before, stats.taken_after, stats.dispatches_before, stats.dispatches_after, stats.lines_before, stats.lines_after,
+               stats.hot_size, stats.cold_size, seconds_before * 1e3, seconds_after * 1e3);
+
+        vm_deinit(before);
+        vm_deinit(after);
+        profile_deinit(profile);
+        thorkell_program_free(&laid_out);
+        thorkell_program_free(&program);
+    }
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "bench.h"
+
+#define BENCH_ITERATIONS 500000
+#define BENCH_CALLS (BENCH_ITERATIONS * 8) /* eight to an iteration */
+#define BENCH_RUNS 5 /* the fastest of these counts, alternating between the two */
+#define STRING(x) #x
+#define EXPAND(x) STRING(x)
+
+/* the same loop with and without RA counted up by a native, the difference is what a
+ * call costs. */
+static const char* g_native_source =
+    "start: move RB, 0\n"
+    "l: callnative 1\ncallnative 1\ncallnative 1\ncallnative 1\n"
+    "callnative 1\ncallnative 1\ncallnative 1\ncallnative 1\n"
+    "add RB, 1\n"
+    "cmp RB, " EXPAND(BENCH_ITERATIONS) "\n"
+    "jl l\n"
+    "halt\n";
+
+static const char* g_empty_source =
+    "start: move RB, 0\n"
+    "l: add RB, 1\n"
+    "cmp RB, " EXPAND(BENCH_ITERATIONS) "\n"
+    "jl l\n"
+    "halt\n";
+
+static void native_increment(VM* vm) {
+    REG(0) += 1;
+}
+
+static double run(const char* source, uint64_t calls) {
+    ThorkellProgram program = bench_assemble(source, 0);
+    VM* vm = bench_load(&program, 0);
+
+    double started = bench_seconds();
+    vm_execute(vm);
+    double seconds = bench_seconds() - started;
+
+    if (vm->fault != VM_FAULT_NONE || vm->registers[0] != calls) {
+        fprintf(stderr, "ERROR: RA came out as %lu\n", vm->registers[0]);
+        exit(1);
+    }
+
+    vm_deinit(vm);
+    thorkell_program_free(&program);
+
+    return seconds;
+}
+
+int main() {
+    vm_register_native(1, "increment", native_increment);
+
+    double native = run(g_native_source, BENCH_CALLS);
+    double empty = run(g_empty_source, 0);
+
+    for (int i = 1; i < BENCH_RUNS; i++) {
+        double seconds = run(g_native_source, BENCH_CALLS);
+
+        if (seconds < native)
+            native = seconds;
+
+        seconds = run(g_empty_source, 0);
+
+        if (seconds < empty)
+            empty = seconds;
+    }
+
+    printf("native: %d calls in %.3f s, %.1f ns per call over the empty loop\n", BENCH_CALLS, native, (native - empty) * 1e9 / BENCH_CALLS);
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <string.h>
+
+#include "bench.h"
+#include "simd.h"
+
+#define BENCH_WORDS (MEMORY_DEFAULT / sizeof(uint64_t))
+#define BENCH_PASSES 200
+#define STRING(x) #x
+#define EXPAND(x) STRING(x)
+
+/* both add up every word of memory BENCH_PASSES times, one word or one vector of them at a time. */
+static const char* g_scalar_source =
+    "start: move RD, 0\n"
+    "outer: move RB, 0\n"
+    "inner: loadq RC, RB\n"
+    "add RA, RC\n"
+    "add RB, 8\n"
+    "cmp RB, 65536\n" /* MEMORY_DEFAULT */
+    "jl inner\n"
+    "add RD, 1\n"
+    "cmp RD, " EXPAND(BENCH_PASSES) "\n"
+    "jl outer\n"
+    "halt\n";
+
+static const char* g_vector_source =
+    "start: move RD, 0\n"
+    "outer: move RB, 0\n"
+    "inner: vload VA, RB\n"
+    "vadd VB, VA\n"
+    "add RB, 32\n"
+    "cmp RB, 65536\n" /* MEMORY_DEFAULT */
+    "jl inner\n"
+    "add RD, 1\n"
+    "cmp RD, " EXPAND(BENCH_PASSES) "\n"
+    "jl outer\n"
+    "vsum RA, VB\n"
+    "halt\n";
+
+/* runs source over the words with ops for the vector instructions, returns the seconds. */
+static double run(const char* name, const char* source, const SimdOps* ops, uint64_t expected, double baseline) {
+    ThorkellProgram program = bench_assemble(source, 0);
+    VM* vm = bench_load(&program, MEMORY_DEFAULT);
+
+    for (uint64_t i = 0; i < BENCH_WORDS; i++) {
+        uint64_t word = i * 3 + 1;
+        memcpy(&vm->memory[i * sizeof(uint64_t)], &word, sizeof(word));
+    }
+
+    vm->simd = ops;
+
+    double started = bench_seconds();
+    vm_execute(vm);
+    double seconds = bench_seconds() - started;
+
+    if (vm->fault != VM_FAULT_NONE || vm->registers[0] != expected) {
+        fprintf(stderr, "ERROR: %s added up to %lu, not %lu\n", name, vm->registers[0], expected);
+        exit(1);
+    }
+
+    printf("  %-13s: %7.1f M words/s, %6.1f M instructions/s", name, (double)BENCH_PASSES * BENCH_WORDS / seconds / 1e6, vm->stats.instructions / seconds / 1e6);
+
+    if (baseline > 0)
+        printf(", %4.1fx the scalar loop", baseline / seconds);
+
+    printf("\n");
+
+    vm_deinit(vm);
+    thorkell_program_free(&program);
+
+    return seconds;
+}
+
+int main() {
+    const char* names[] = { "scalar", "sse2", "avx2" };
+    uint64_t expected = 0;
+
+    for (uint64_t i = 0; i < BENCH_WORDS; i++)
+        expected += i * 3 + 1;
+
+    expected *= BENCH_PASSES;
+
+    printf("reduce: %lu words %d times\n", (uint64_t)BENCH_WORDS, BENCH_PASSES);
+
+    double baseline = run("scalar loop", g_scalar_source, simd_ops(), expected, 0);
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        const SimdOps* ops = simd_ops_named(names[i]);
+        char name[32];
+
+        if (!ops)
+            continue;
+
+        snprintf(name, sizeof(name), "vector %s", names[i]);
+        run(name, g_vector_source, ops, expected, baseline);
+    }
+
+    return 0;
+}
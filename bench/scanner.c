@@ -0,0 +1,99 @@
+#include <string.h>
+
+#include "bench.h"
+#include "scan.h"
+
+#define BENCH_SOURCE_SIZE (32 << 20)
+#define BENCH_ASSEMBLE_SIZE (4 << 20)
+
+static const char* g_line = "    ; a comment that goes on for a while, as generated code has\n\n  move RA,    123456\n";
+
+/* size bytes of whole lines like a generated source has, ending in a start label. */
+static char* generate(size_t size) {
+    char* source = malloc(size + 1);
+    size_t len = strlen(g_line);
+    size_t at = 0;
+
+    if (!source) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+
+    for (; at + len + 16 < size; at += len)
+        memcpy(&source[at], g_line, len);
+
+    strcpy(&source[at], "start: halt\n");
+
+    return source;
+}
+
+/* walks the source the way the lexer does, with a run per class and a token boundary
+ * everywhere else. returns the tokens seen so the work cannot be left out. */
+static size_t walk(const ScanOps* ops, const char* source, size_t len) {
+    size_t tokens = 0;
+    size_t last;
+
+    for (const char* at = source; *at; tokens++) {
+        at += ops->whitespace(at);
+
+        if (*at == ';') {
+            at += ops->comment(at);
+            continue;
+        }
+
+        size_t run = ops->alphas(at);
+        run += ops->digits(at + run);
+        at += run > 0 || *at == 0 ? run : 1;
+    }
+
+    return tokens + ops->newlines(source, len, &last);
+}
+
+int main() {
+    const char* names[] = { "scalar", "sse2", "avx2" };
+    char* source = generate(BENCH_SOURCE_SIZE);
+    size_t len = strlen(source);
+    size_t expected = 0;
+
+    printf("scanner: %zu bytes of generated source\n", len);
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        const ScanOps* ops = scan_ops_named(names[i]);
+
+        if (!ops)
+            continue;
+
+        double started = bench_seconds();
+        size_t tokens = walk(ops, source, len);
+        double seconds = bench_seconds() - started;
+
+        if (expected == 0)
+            expected = tokens;
+
+        if (tokens != expected) {
+            fprintf(stderr, "ERROR: %s saw %zu tokens, scalar %zu\n", names[i], tokens, expected);
+            return 1;
+        }
+
+        printf("  %-6s  : %7.1f MB/s%s\n", names[i], len / seconds / 1e6, ops == scan_ops() ? ", picked by the lexer" : "");
+    }
+
+    /* cut at a line boundary, the start label goes after it */
+    size_t cut = BENCH_ASSEMBLE_SIZE - 16;
+
+    while (source[cut - 1] != '\n')
+        cut -= 1;
+
+    strcpy(&source[cut], "start: halt\n");
+
+    double started = bench_seconds();
+    ThorkellProgram program = bench_assemble(source, 0);
+    double seconds = bench_seconds() - started;
+
+    printf("  assemble: %7.1f MB/s of the first %zu bytes\n", cut / seconds / 1e6, cut);
+
+    thorkell_program_free(&program);
+    free(source);
+
+    return 0;
+}
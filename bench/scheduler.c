@@ -0,0 +1,127 @@
+#include <unistd.h>
+
+#include "bench.h"
+#include "scheduler.h"
+
+#define BENCH_VMS 10000
+
+#define BENCH_RUNS 3 /* the fastest of these counts */
+
+/* each vm adds up 0 to 499, about 2000 instructions. */
+static const char* g_source =
+    "start: move RB, 0\n"
+    "l: add RA, RB\n"
+    "add RB, 1\n"
+    "cmp RB, 500\n"
+    "jl l\n"
+    "halt\n";
+
+static double cpu_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/* runs BENCH_VMS resident vms to the end, returns the seconds it took and the cpu
+ * seconds all the workers spent. */
+static double run_once(const ThorkellProgram* program, size_t workers, uint64_t quantum, uint64_t time_quantum, uint64_t* instructions, double* cpu) {
+    Scheduler* scheduler = scheduler_init(workers, quantum);
+    VM** vms = malloc(BENCH_VMS * sizeof(VM*));
+
+    if (!scheduler || !vms) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+
+    scheduler_set_time_quantum(scheduler, time_quantum);
+
+    for (size_t i = 0; i < BENCH_VMS; i++) {
+        vms[i] = bench_load(program, 0);
+
+        if (!scheduler_spawn(scheduler, vms[i])) {
+            fprintf(stderr, "ERROR: out of memory\n");
+            exit(1);
+        }
+    }
+
+    double cpu_started = cpu_seconds();
+    double started = bench_seconds();
+    scheduler_run(scheduler);
+    double seconds = bench_seconds() - started;
+    *cpu = cpu_seconds() - cpu_started;
+
+    *instructions = 0;
+
+    for (size_t i = 0; i < BENCH_VMS; i++) {
+        *instructions += vms[i]->stats.instructions;
+        vm_deinit(vms[i]);
+    }
+
+    free(vms);
+    scheduler_deinit(scheduler);
+
+    return seconds;
+}
+
+/* the fastest of BENCH_RUNS, with the cpu seconds of that run. */
+static double run(const ThorkellProgram* program, size_t workers, uint64_t quantum, uint64_t time_quantum, uint64_t* instructions, double* cpu) {
+    double fastest = 0;
+
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        double run_cpu;
+        double seconds = run_once(program, workers, quantum, time_quantum, instructions, &run_cpu);
+
+        if (i == 0 || seconds < fastest) {
+            fastest = seconds;
+            *cpu = run_cpu;
+        }
+    }
+
+    return fastest;
+}
+
+/* the same work at a quantum long enough for every vm to finish in one slice and at
+ * shorter ones, what the shorter ones cost on top is spent switching between vms. the
+ * workers run side by side, so that cost is taken from the cpu time they spent. then
+ * the same with time quanta, a slice going on 8 instructions at a time until its time
+ * is used up. */
+int main(int argc, char** argv) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t workers = argc > 1 ? strtoul(argv[1], NULL, 10) : (cpus > 0 ? (size_t)cpus : 1);
+    ThorkellProgram program = bench_assemble(g_source, 0);
+    uint64_t quanta[] = { 1 << 20, 1024, 64, 8 };
+    uint64_t time_quanta[] = { 100000, 10000, 1000 };
+    uint64_t instructions;
+    double baseline_cpu;
+    double baseline = run(&program, workers, quanta[0], 0, &instructions, &baseline_cpu);
+    uint64_t per_vm = instructions / BENCH_VMS;
+
+    printf("scheduler: %d vms of %lu instructions on %zu workers\n", BENCH_VMS, per_vm, workers);
+
+    size_t count = sizeof(quanta) / sizeof(quanta[0]);
+    double seconds = baseline;
+    double cpu = baseline_cpu;
+    uint64_t slices = BENCH_VMS;
+
+    for (size_t i = 0; i < count; i++) {
+        seconds = i == 0 ? baseline : run(&program, workers, quanta[i], 0, &instructions, &cpu);
+        slices = (uint64_t)BENCH_VMS * ((per_vm + quanta[i] - 1) / quanta[i]);
+
+        printf("  quantum %8lu: %8.1f M instructions/s, %9lu slices, %.3f cpu s\n", quanta[i], instructions / seconds / 1e6, slices, cpu);
+    }
+
+    /* only the shortest quantum switches often enough to stand out from the noise */
+    double per_switch = (cpu - baseline_cpu) * 1e9 / (slices - BENCH_VMS);
+    printf("  %.1f ns per switch\n", per_switch > 0 ? per_switch : 0);
+
+    for (size_t i = 0; i < sizeof(time_quanta) / sizeof(time_quanta[0]); i++) {
+        seconds = run(&program, workers, 8, time_quanta[i], &instructions, &cpu);
+
+        printf("  time quantum %6lu ns: %8.1f M instructions/s, %.3f cpu s\n", time_quanta[i], instructions / seconds / 1e6, cpu);
+    }
+
+    thorkell_program_free(&program);
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "bench.h"
+
+#define BENCH_ITERATIONS 100000
+#define STRING(x) #x
+#define EXPAND(x) STRING(x)
+
+/* both work out (x1 + x2) * (x3 + x4) + (x5 + x6) * (x7 + x8) with xk = i + k for every i
+ * and add it up in RC. with only RA to RD the terms go through the stack in postfix order
+ * the way code written for four registers has to, with sixteen they stay in registers. */
+static const char* g_spilled_source =
+    "start: move RD, 0\n"
+    "loop: move RA, RD\nadd RA, 1\npush RA\n"
+    "move RA, RD\nadd RA, 2\npush RA\n"
+    "pop RB\npop RA\nadd RA, RB\npush RA\n"
+    "move RA, RD\nadd RA, 3\npush RA\n"
+    "move RA, RD\nadd RA, 4\npush RA\n"
+    "pop RB\npop RA\nadd RA, RB\npush RA\n"
+    "pop RB\npop RA\nmul RA, RB\npush RA\n"
+    "move RA, RD\nadd RA, 5\npush RA\n"
+    "move RA, RD\nadd RA, 6\npush RA\n"
+    "pop RB\npop RA\nadd RA, RB\npush RA\n"
+    "move RA, RD\nadd RA, 7\npush RA\n"
+    "move RA, RD\nadd RA, 8\npush RA\n"
+    "pop RB\npop RA\nadd RA, RB\npush RA\n"
+    "pop RB\npop RA\nmul RA, RB\npush RA\n"
+    "pop RB\npop RA\nadd RA, RB\nadd RC, RA\n"
+    "add RD, 1\n"
+    "cmp RD, " EXPAND(BENCH_ITERATIONS) "\n"
+    "jl loop\n"
+    "halt\n";
+
+static const char* g_register_source =
+    "start: move RD, 0\n"
+    "loop: move RE, RD\nadd RE, 1\n"
+    "move RF, RD\nadd RF, 2\n"
+    "move RG, RD\nadd RG, 3\n"
+    "move RH, RD\nadd RH, 4\n"
+    "move RI, RD\nadd RI, 5\n"
+    "move RJ, RD\nadd RJ, 6\n"
+    "move RK, RD\nadd RK, 7\n"
+    "move RL, RD\nadd RL, 8\n"
+    "add RE, RF\nadd RG, RH\nadd RI, RJ\nadd RK, RL\n"
+    "mul RE, RG\nmul RI, RK\n"
+    "add RE, RI\nadd RC, RE\n"
+    "add RD, 1\n"
+    "cmp RD, " EXPAND(BENCH_ITERATIONS) "\n"
+    "jl loop\n"
+    "halt\n";
+
+static void run(const char* name, const char* source, int flags, uint64_t expected) {
+    ThorkellProgram program = bench_assemble(source, flags);
+    VM* vm = bench_load(&program, 0);
+
+    double started = bench_seconds();
+    vm_execute(vm);
+    double seconds = bench_seconds() - started;
+
+    if (vm->fault != VM_FAULT_NONE || vm->registers[2] != expected) {
+        fprintf(stderr, "ERROR: %s came out as %lu, not %lu\n", name, vm->registers[2], expected);
+        exit(1);
+    }
+
+    printf("  %-19s: %8lu pushes %8lu pops %9lu instructions, %.3f s\n", name, vm->stats.pushes, vm->stats.pops, vm->stats.instructions, seconds);
+
+    vm_deinit(vm);
+    thorkell_program_free(&program);
+}
+
+int main() {
+    uint64_t expected = 0;
+
+    for (uint64_t i = 0; i < BENCH_ITERATIONS; i++)
+        expected += (2 * i + 3) * (2 * i + 7) + (2 * i + 11) * (2 * i + 15);
+
+    printf("spill: %d iterations of eight terms\n", BENCH_ITERATIONS);
+    run("RA to RD", g_spilled_source, 0, expected);
+    run("RA to RD, optimized", g_spilled_source, THORKELL_OPTIMIZE, expected);
+    run("RA to RL", g_register_source, 0, expected);
+    run("RA to RL, optimized", g_register_source, THORKELL_OPTIMIZE, expected);
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <string.h>
+
+#include "bench.h"
+#include "embed.h"
+
+#define BENCH_STARTS 20000
+
+/* bench/startup.tk as thorkell --embed wrote it at build time. */
+extern const EmbeddedProgram startup_program;
+
+static char* read_source(const char* path) {
+    FILE* file = fopen(path, "rb");
+
+    if (!file) {
+        fprintf(stderr, "ERROR: cannot read %s\n", path);
+        exit(1);
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* source = calloc(size + 1, 1);
+
+    if (!source || fread(source, 1, size, file) != (size_t)size) {
+        fprintf(stderr, "ERROR: cannot read %s\n", path);
+        exit(1);
+    }
+
+    fclose(file);
+
+    return source;
+}
+
+static void check(VM* vm, uint64_t expected, const char* name) {
+    if (vm->fault != VM_FAULT_NONE || vm->registers[0] != expected) {
+        fprintf(stderr, "ERROR: the %s program came out as %lu, not %lu\n", name, vm->registers[0], expected);
+        exit(1);
+    }
+}
+
+/* a start is everything from the source or the embedded bytes to a vm ready to run, the
+ * first vm of each is run to check that both are the same program. */
+int main(int argc, char** argv) {
+    char* source = read_source(argc > 1 ? argv[1] : "bench/startup.tk");
+    uint64_t expected = 0;
+    VM* vm;
+
+    double started = bench_seconds();
+
+    for (int i = 0; i < BENCH_STARTS; i++) {
+        ThorkellProgram program = bench_assemble(source, THORKELL_OPTIMIZE);
+        vm = bench_load(&program, MEMORY_DEFAULT);
+
+        if (i == 0) {
+            vm_execute(vm);
+            expected = vm->registers[0];
+            check(vm, expected, "parsed");
+        }
+
+        vm_deinit(vm);
+        thorkell_program_free(&program);
+    }
+
+    double parsed = bench_seconds() - started;
+
+    started = bench_seconds();
+
+    for (int i = 0; i < BENCH_STARTS; i++) {
+        vm = embedded_load(&startup_program, MEMORY_DEFAULT);
+
+        if (!vm) {
+            fprintf(stderr, "ERROR: out of memory\n");
+            return 1;
+        }
+
+        if (i == 0) {
+            vm_execute(vm);
+            check(vm, expected, "embedded");
+        }
+
+        vm_deinit(vm);
+    }
+
+    double embedded = bench_seconds() - started;
+
+    printf("startup: %d starts of a %lu byte program\n", BENCH_STARTS, startup_program.size);
+    printf("  parsed  : %7.2f us per start\n", parsed * 1e6 / BENCH_STARTS);
+    printf("  embedded: %7.2f us per start, %.1fx faster\n", embedded * 1e6 / BENCH_STARTS, parsed / embedded);
+
+    free(source);
+
+    return 0;
+}
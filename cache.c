@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+#define CACHE_PATH_MAX 4096
+
+/* one file per program in the disk tier, the source follows the header and the code follows the source. */
+typedef struct CacheFileHeader_t {
+    char magic[8];
+    uint32_t version;
+    int32_t flags;
+    uint64_t hash;
+    uint64_t start_rip;
+    uint64_t source_len;
+    uint64_t code_size;
+} CacheFileHeader;
+
+/* a hash table of the entries for lookups, threaded on a list from least to most
+ * recently used for eviction. one lock covers both and the stats, it is never held
+ * across assembling or the disk. */
+struct AssemblyCache_t {
+    pthread_mutex_t lock;
+    CachedProgram** buckets;
+    size_t bucket_count; /* a power of two */
+    size_t count;
+    size_t capacity;
+    CachedProgram* oldest;
+    CachedProgram* newest;
+    char* directory;
+    CacheStats stats;
+};
+
+static uint64_t rotate_left(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t hash_mix(uint64_t hash, uint64_t word) {
+    hash ^= word * 0x9e3779b97f4a7c15;
+    return rotate_left(hash, 31) * 0xc2b2ae3d27d4eb4f;
+}
+
+/* eight bytes per step, the assembler version and flags are part of the key since they
+ * change the bytes that come out. */
+uint64_t cache_hash(const char* source, size_t len, int flags) {
+    uint64_t hash = hash_mix(len, ((uint64_t)THORKELL_ASSEMBLER_VERSION << 32) | (uint32_t)flags);
+    size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, &source[i], sizeof(uint64_t));
+        hash = hash_mix(hash, word);
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, &source[i], len - i);
+    hash = hash_mix(hash, tail);
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+AssemblyCache* cache_init(size_t capacity, const char* directory) {
+    AssemblyCache* cache = calloc(1, sizeof(AssemblyCache));
+
+    if (!cache)
+        return NULL;
+
+    cache->capacity = capacity == 0 ? 1 : capacity;
+    cache->bucket_count = 16;
+
+    while (cache->bucket_count < cache->capacity * 2)
+        cache->bucket_count *= 2;
+
+    cache->buckets = calloc(cache->bucket_count, sizeof(CachedProgram*));
+    cache->directory = directory ? strdup(directory) : NULL;
+
+    if (!cache->buckets || (directory && !cache->directory)) {
+        free(cache->buckets);
+        free(cache->directory);
+        free(cache);
+        return NULL;
+    }
+
+    pthread_mutex_init(&cache->lock, NULL);
+
+    return cache;
+}
+
+static void entry_free(CachedProgram* entry) {
+    thorkell_program_free(&entry->program);
+    free(entry->source);
+    free(entry);
+}
+
+/* every program handed out has to be released before the cache goes. */
+void cache_deinit(AssemblyCache* cache) {
+    if (!cache)
+        return;
+
+    for (CachedProgram* entry = cache->oldest; entry;) {
+        CachedProgram* newer = entry->newer;
+        entry_free(entry);
+        entry = newer;
+    }
+
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->buckets);
+    free(cache->directory);
+    free(cache);
+}
+
+static CachedProgram** bucket_of(AssemblyCache* cache, uint64_t hash) {
+    return &cache->buckets[hash & (cache->bucket_count - 1)];
+}
+
+static void lru_unlink(AssemblyCache* cache, CachedProgram* entry) {
+    if (entry->older)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+
+    if (entry->newer)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+
+    entry->older = NULL;
+    entry->newer = NULL;
+}
+
+static void lru_push(AssemblyCache* cache, CachedProgram* entry) {
+    entry->older = cache->newest;
+    entry->newer = NULL;
+
+    if (cache->newest)
+        cache->newest->newer = entry;
+    else
+        cache->oldest = entry;
+
+    cache->newest = entry;
+}
+
+static CachedProgram* lookup(AssemblyCache* cache, uint64_t hash, int flags, const char* source, size_t len) {
+    for (CachedProgram* entry = *bucket_of(cache, hash); entry; entry = entry->chain) {
+        if (entry->hash == hash && entry->flags == flags && entry->source_len == len && memcmp(entry->source, source, len) == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+/* drops the least recently used entry, one still in use lives on until it is released. */
+static void evict_oldest(AssemblyCache* cache) {
+    CachedProgram* entry = cache->oldest;
+    CachedProgram** link = bucket_of(cache, entry->hash);
+
+    while (*link != entry)
+        link = &(*link)->chain;
+
+    *link = entry->chain;
+    lru_unlink(cache, entry);
+
+    cache->count -= 1;
+    cache->stats.evictions += 1;
+
+    if (entry->refs == 0)
+        entry_free(entry);
+    else
+        entry->evicted = 1;
+}
+
+/* takes ownership of program, the new entry starts with one reference for the caller. */
+static CachedProgram* insert(AssemblyCache* cache, uint64_t hash, int flags, const char* source, size_t len, ThorkellProgram program) {
+    CachedProgram* entry = calloc(1, sizeof(CachedProgram));
+    char* copy = malloc(len + 1);
+
+    if (!entry || !copy) {
+        free(entry);
+        free(copy);
+        thorkell_program_free(&program);
+        return NULL;
+    }
+
+    memcpy(copy, source, len + 1);
+
+    entry->program = program;
+    entry->hash = hash;
+    entry->flags = flags;
+    entry->source = copy;
+    entry->source_len = len;
+    entry->refs = 1;
+
+    if (cache->count == cache->capacity)
+        evict_oldest(cache);
+
+    CachedProgram** bucket = bucket_of(cache, hash);
+    entry->chain = *bucket;
+    *bucket = entry;
+
+    lru_push(cache, entry);
+    cache->count += 1;
+
+    return entry;
+}
+
+static void disk_path(const AssemblyCache* cache, char* path, uint64_t hash, int flags) {
+    snprintf(path, CACHE_PATH_MAX, "%s/%016lx-%d.thkc", cache->directory, hash, flags);
+}
+
+static int disk_load(AssemblyCache* cache, uint64_t hash, int flags, const char* source, size_t len, ThorkellProgram* program) {
+    char path[CACHE_PATH_MAX];
+    disk_path(cache, path, hash, flags);
+
+    FILE* file = fopen(path, "rb");
+
+    if (!file)
+        return 0;
+
+    CacheFileHeader header;
+    char* stored = NULL;
+    int ok = fread(&header, sizeof(header), 1, file) == 1
+            && memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0
+            && header.version == THORKELL_ASSEMBLER_VERSION
+            && header.flags == flags
+            && header.hash == hash
+            && header.source_len == len
+            && header.code_size != 0
+            && (stored = malloc(len + 1)) != NULL
+            && fread(stored, 1, len, file) == len
+            && memcmp(stored, source, len) == 0;
+
+    program->code = NULL;
+    program->start_rip = ok ? header.start_rip : 0;
+
+    for (uint64_t i = 0; ok && i < header.code_size; i++) {
+        int byte = fgetc(file);
+
+        ok = byte != EOF;
+        cvector_push_back(program->code, (uint8_t)byte);
+    }
+
+    if (!ok)
+        thorkell_program_free(program);
+
+    free(stored);
+    fclose(file);
+
+    return ok;
+}
+
+/* written under a temporary name of its own and renamed, so readers never see half a
+ * file and threads storing the same program at once do not write into each other. */
+static int disk_store(AssemblyCache* cache, uint64_t hash, int flags, const char* source, size_t len, const ThorkellProgram* program) {
+    char path[CACHE_PATH_MAX];
+    char temporary[CACHE_PATH_MAX + 32];
+
+    disk_path(cache, path, hash, flags);
+    snprintf(temporary, sizeof(temporary), "%s.XXXXXX", path);
+
+    int fd = mkstemp(temporary);
+    FILE* file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+
+    if (!file) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(temporary);
+        }
+
+        return 0;
+    }
+
+    CacheFileHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = THORKELL_ASSEMBLER_VERSION;
+    header.flags = flags;
+    header.hash = hash;
+    header.start_rip = program->start_rip;
+    header.source_len = len;
+    header.code_size = cvector_size(program->code);
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(source, 1, len, file) == len
+            && fwrite(program->code, 1, header.code_size, file) == header.code_size;
+
+    ok = fclose(file) == 0 && ok && rename(temporary, path) == 0;
+
+    if (!ok)
+        unlink(temporary);
+
+    return ok;
+}
+
+/* one more reference to entry, which is now the most recently used. */
+static void hit(AssemblyCache* cache, CachedProgram* entry) {
+    entry->refs += 1;
+
+    lru_unlink(cache, entry);
+    lru_push(cache, entry);
+}
+
+/* the assembled source, from memory, then disk, then the assembler. returns NULL with
+ * error filled in when the source does not assemble. release the program when done.
+ * the disk and the assembler are gone to without the lock, so threads asking for the
+ * same new source may both assemble it, the first one in is kept. */
+const CachedProgram* cache_assemble(AssemblyCache* cache, const char* source, int flags, ThorkellError* error) {
+    size_t len = strlen(source);
+    uint64_t hash = cache_hash(source, len, flags);
+    ThorkellProgram program;
+
+    pthread_mutex_lock(&cache->lock);
+
+    CachedProgram* entry = lookup(cache, hash, flags, source, len);
+
+    if (entry) {
+        cache->stats.hits += 1;
+        hit(cache, entry);
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    if (entry)
+        return entry;
+
+    int from_disk = cache->directory && disk_load(cache, hash, flags, source, len, &program);
+    int assembled = !from_disk && thorkell_assemble(source, flags, &program, error) == THORKELL_OK;
+    int stored = assembled && cache->directory && disk_store(cache, hash, flags, source, len, &program);
+
+    pthread_mutex_lock(&cache->lock);
+
+    if (from_disk)
+        cache->stats.disk_hits += 1;
+    else
+        cache->stats.misses += 1;
+
+    if (stored)
+        cache->stats.disk_writes += 1;
+
+    if (from_disk || assembled) {
+        entry = lookup(cache, hash, flags, source, len);
+
+        if (entry) {
+            hit(cache, entry);
+            thorkell_program_free(&program);
+        } else {
+            entry = insert(cache, hash, flags, source, len, program);
+        }
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    if (!entry && error && error->status == THORKELL_OK) {
+        error->status = THORKELL_ERROR_MEMORY;
+        snprintf(error->message, sizeof(error->message), "%s", thorkell_status_name(THORKELL_ERROR_MEMORY));
+    }
+
+    return entry;
+}
+
+void cache_release(AssemblyCache* cache, const CachedProgram* program) {
+    CachedProgram* entry = (CachedProgram*)program;
+
+    if (!entry)
+        return;
+
+    pthread_mutex_lock(&cache->lock);
+
+    entry->refs -= 1;
+
+    if (entry->evicted && entry->refs == 0)
+        entry_free(entry);
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+CacheStats cache_stats(AssemblyCache* cache) {
+    pthread_mutex_lock(&cache->lock);
+    CacheStats stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+
+    return stats;
+}
@@ -0,0 +1,42 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "thorkell.h"
+
+#define CACHE_MAGIC "THKCACHE"
+
+/* an assembled program shared by everyone who asked for the same source, never write to it. */
+typedef struct CachedProgram_t {
+    ThorkellProgram program;
+    uint64_t hash;
+    int flags;
+    char* source; /* kept to tell hash collisions apart */
+    size_t source_len;
+    size_t refs;
+    int evicted; /* dropped from the cache, freed with the last reference */
+    struct CachedProgram_t* older;
+    struct CachedProgram_t* newer;
+    struct CachedProgram_t* chain;
+} CachedProgram;
+
+typedef struct CacheStats_t {
+    uint64_t hits;
+    uint64_t disk_hits;
+    uint64_t misses; /* had to assemble */
+    uint64_t evictions;
+    uint64_t disk_writes;
+} CacheStats;
+
+typedef struct AssemblyCache_t AssemblyCache;
+
+AssemblyCache* cache_init(size_t capacity, const char* directory);
+void cache_deinit(AssemblyCache* cache);
+const CachedProgram* cache_assemble(AssemblyCache* cache, const char* source, int flags, ThorkellError* error);
+void cache_release(AssemblyCache* cache, const CachedProgram* program);
+CacheStats cache_stats(AssemblyCache* cache);
+uint64_t cache_hash(const char* source, size_t len, int flags);
+
+#endif /* CACHE_H */
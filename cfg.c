@@ -0,0 +1,609 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+
+int cfg_is_jump(Instruction instruction) {
+    switch (instruction) {
+    case INS_JMP:
+    case INS_JE:
+    case INS_JNE:
+    case INS_JG:
+    case INS_JL:
+    case INS_JGE:
+    case INS_JLE:
+    case INS_JO:
+    case INS_JC:
+    case INS_LOOP:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+int cfg_is_conditional_jump(Instruction instruction) {
+    return cfg_is_jump(instruction) && instruction != INS_JMP;
+}
+
+/* calls end a block too, control comes back to the next instruction once the callee returns. */
+int cfg_has_target(Instruction instruction) {
+    return cfg_is_jump(instruction) || instruction == INS_CALL;
+}
+
+/* loop carries its counter register in front of the target. */
+static uint8_t jump_target_offset(Instruction instruction) {
+    return instruction == INS_LOOP ? 1 : 0;
+}
+
+uint64_t cfg_jump_target(const ParsedInstruction* parsed_instruction) {
+    uint64_t target = 0;
+    uint8_t* bytes = (uint8_t*)&target;
+    uint8_t offset = jump_target_offset(parsed_instruction->instruction);
+
+    for (uint8_t i = 0; i < sizeof(uint64_t) && offset + i < parsed_instruction->operand_count; i++)
+        bytes[i] = parsed_instruction->operands[offset + i];
+
+    return target;
+}
+
+void cfg_set_jump_target(ParsedInstruction* parsed_instruction, uint64_t target) {
+    uint8_t* bytes = (uint8_t*)&target;
+    uint8_t offset = jump_target_offset(parsed_instruction->instruction);
+
+    for (uint8_t i = 0; i < sizeof(uint64_t) && offset + i < parsed_instruction->operand_count; i++)
+        parsed_instruction->operands[offset + i] = bytes[i];
+}
+
+static void add_edge(CFG* cfg, size_t from, size_t to) {
+    BasicBlock* block = &cfg->blocks[from];
+
+    for (size_t i = 0; i < cvector_size(block->succs); i++) {
+        if (block->succs[i] == to)
+            return;
+    }
+
+    cvector_push_back(block->succs, to);
+    cvector_push_back(cfg->blocks[to].preds, from);
+}
+
+/* iterative dfs from the entry, fills the postorder of every reachable block. the other
+ * roots count as successors of the entry, as if the host jumped there from start. */
+static cvector_vector_type(size_t) postorder(CFG* cfg) {
+    cvector_vector_type(size_t) order = NULL;
+    cvector_vector_type(size_t) stack = NULL;
+    cvector_vector_type(size_t) next = NULL;
+    cvector_vector_type(size_t) roots = NULL;
+
+    for (size_t i = 0; i < cvector_size(cfg->blocks); i++) {
+        cvector_push_back(next, 0);
+
+        if (cfg->blocks[i].root && i != cfg->entry)
+            cvector_push_back(roots, i);
+    }
+
+    cfg->blocks[cfg->entry].reachable = 1;
+    cvector_push_back(stack, cfg->entry);
+
+    while (cvector_size(stack) != 0) {
+        size_t block = stack[cvector_size(stack) - 1];
+        BasicBlock* bb = &cfg->blocks[block];
+
+        size_t succ_count = cvector_size(bb->succs) + (block == cfg->entry ? cvector_size(roots) : 0);
+
+        if (next[block] < succ_count) {
+            size_t succ = next[block] < cvector_size(bb->succs) ? bb->succs[next[block]] : roots[next[block] - cvector_size(bb->succs)];
+            next[block] += 1;
+
+            if (!cfg->blocks[succ].reachable) {
+                cfg->blocks[succ].reachable = 1;
+                cvector_push_back(stack, succ);
+            }
+
+            continue;
+        }
+
+        cvector_push_back(order, block);
+        cvector_pop_back(stack);
+    }
+
+    cvector_free(roots);
+    cvector_free(next);
+    cvector_free(stack);
+
+    return order;
+}
+
+static size_t intersect(const CFG* cfg, const size_t* number, size_t lhs, size_t rhs) {
+    while (lhs != rhs) {
+        while (number[lhs] < number[rhs])
+            lhs = cfg->blocks[lhs].idom;
+
+        while (number[rhs] < number[lhs])
+            rhs = cfg->blocks[rhs].idom;
+    }
+
+    return lhs;
+}
+
+/* cooper, harvey and kennedy's iterative dominator algorithm. */
+static void compute_dominators(CFG* cfg, cvector_vector_type(size_t) order) {
+    size_t* number = malloc(cvector_size(cfg->blocks) * sizeof(size_t));
+
+    for (size_t i = 0; i < cvector_size(order); i++)
+        number[order[i]] = i;
+
+    cfg->blocks[cfg->entry].idom = cfg->entry;
+
+    int changed = 1;
+
+    while (changed) {
+        changed = 0;
+
+        for (size_t i = cvector_size(order); i-- > 0;) {
+            size_t block = order[i];
+
+            if (block == cfg->entry)
+                continue;
+
+            BasicBlock* bb = &cfg->blocks[block];
+            size_t idom = bb->root ? cfg->entry : CFG_NONE;
+
+            for (size_t j = 0; j < cvector_size(bb->preds); j++) {
+                size_t pred = bb->preds[j];
+
+                if (cfg->blocks[pred].idom == CFG_NONE)
+                    continue;
+
+                idom = idom == CFG_NONE ? pred : intersect(cfg, number, pred, idom);
+            }
+
+            if (bb->idom != idom) {
+                bb->idom = idom;
+                changed = 1;
+            }
+        }
+    }
+
+    free(number);
+}
+
+/* numbers the dominator tree so that dominance checks are constant time. */
+static void number_dominator_tree(CFG* cfg) {
+    size_t* pre = cfg->dom_pre;
+    size_t* post = cfg->dom_post;
+    size_t count = cvector_size(cfg->blocks);
+    size_t* first_child = malloc(count * sizeof(size_t));
+    size_t* next_sibling = malloc(count * sizeof(size_t));
+
+    for (size_t i = 0; i < count; i++) {
+        first_child[i] = CFG_NONE;
+        next_sibling[i] = CFG_NONE;
+        pre[i] = CFG_NONE;
+        post[i] = CFG_NONE;
+    }
+
+    for (size_t i = count; i-- > 0;) {
+        size_t idom = cfg->blocks[i].idom;
+
+        if (idom == CFG_NONE || i == cfg->entry)
+            continue;
+
+        next_sibling[i] = first_child[idom];
+        first_child[idom] = i;
+    }
+
+    cvector_vector_type(size_t) stack = NULL;
+    size_t clock = 0;
+
+    cvector_push_back(stack, cfg->entry);
+    pre[cfg->entry] = clock++;
+
+    while (cvector_size(stack) != 0) {
+        size_t block = stack[cvector_size(stack) - 1];
+        size_t child = first_child[block];
+
+        if (child != CFG_NONE) {
+            first_child[block] = next_sibling[child];
+            pre[child] = clock++;
+            cvector_push_back(stack, child);
+            continue;
+        }
+
+        post[block] = clock++;
+        cvector_pop_back(stack);
+    }
+
+    cvector_free(stack);
+    free(next_sibling);
+    free(first_child);
+}
+
+static void find_loops(CFG* cfg) {
+    size_t count = cvector_size(cfg->blocks);
+    size_t* loop_of = malloc(count * sizeof(size_t));
+    size_t* stamp = malloc(count * sizeof(size_t));
+
+    for (size_t i = 0; i < count; i++) {
+        loop_of[i] = CFG_NONE;
+        stamp[i] = CFG_NONE;
+    }
+
+    cvector_vector_type(size_t) worklist = NULL;
+
+    for (size_t tail = 0; tail < count; tail++) {
+        BasicBlock* bb = &cfg->blocks[tail];
+
+        if (!bb->reachable)
+            continue;
+
+        for (size_t i = 0; i < cvector_size(bb->succs); i++) {
+            size_t header = bb->succs[i];
+
+            if (!cfg_dominates(cfg, header, tail))
+                continue;
+
+            if (loop_of[header] == CFG_NONE) {
+                Loop loop = { .header = header, .blocks = NULL };
+                cvector_push_back(loop.blocks, header);
+
+                loop_of[header] = cvector_size(cfg->loops);
+                cvector_push_back(cfg->loops, loop);
+
+                stamp[header] = loop_of[header];
+            }
+
+            size_t id = loop_of[header];
+
+            if (stamp[tail] == id)
+                continue;
+
+            stamp[tail] = id;
+            cvector_push_back(cfg->loops[id].blocks, tail);
+            cvector_push_back(worklist, tail);
+
+            while (cvector_size(worklist) != 0) {
+                size_t block = worklist[cvector_size(worklist) - 1];
+                cvector_pop_back(worklist);
+
+                BasicBlock* member = &cfg->blocks[block];
+
+                for (size_t j = 0; j < cvector_size(member->preds); j++) {
+                    size_t pred = member->preds[j];
+
+                    if (!cfg->blocks[pred].reachable || stamp[pred] == id)
+                        continue;
+
+                    stamp[pred] = id;
+                    cvector_push_back(cfg->loops[id].blocks, pred);
+                    cvector_push_back(worklist, pred);
+                }
+            }
+        }
+    }
+
+    cvector_free(worklist);
+    free(stamp);
+    free(loop_of);
+}
+
+/* NULL when the start label or a jump points between or past the instructions, the
+ * caller reports that. entries are labels the host may start at besides start, NULL
+ * when there are none. their blocks are roots like the entry, entered with nothing
+ * known, and dominated by the entry only in name. */
+CFG* cfg_init(cvector_vector_type(ParsedInstruction) parsed_instructions, uint64_t start_rip, cvector_vector_type(Symbol) entries) {
+    size_t count = cvector_size(parsed_instructions);
+
+    if (count == 0)
+        return NULL;
+
+    CFG* cfg = malloc(sizeof(CFG));
+    cfg->blocks = NULL;
+    cfg->loops = NULL;
+    cfg->block_of = malloc(count * sizeof(size_t));
+    cfg->ip_of = malloc((count + 1) * sizeof(uint64_t));
+    cfg->dom_pre = NULL;
+    cfg->dom_post = NULL;
+    cfg->entry = CFG_NONE;
+
+    cfg->ip_of[0] = 0;
+
+    for (size_t i = 0; i < count; i++)
+        cfg->ip_of[i + 1] = cfg->ip_of[i] + parsed_instructions[i].size;
+
+    uint64_t total = cfg->ip_of[count];
+    size_t* index_at = malloc((total + 1) * sizeof(size_t));
+    uint8_t* leader = calloc(count, 1);
+
+    for (uint64_t ip = 0; ip <= total; ip++)
+        index_at[ip] = CFG_NONE;
+
+    for (size_t i = 0; i < count; i++)
+        index_at[cfg->ip_of[i]] = i;
+
+    if (start_rip >= total || index_at[start_rip] == CFG_NONE)
+        goto fail;
+
+    leader[0] = 1;
+    leader[index_at[start_rip]] = 1;
+
+    /* a label past the last instruction is no place to start at */
+    for (size_t i = 0; i < cvector_size(entries); i++) {
+        if (entries[i].ip < total && index_at[entries[i].ip] != CFG_NONE)
+            leader[index_at[entries[i].ip]] = 1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        Instruction instruction = parsed_instructions[i].instruction;
+
+        if (cfg_has_target(instruction)) {
+            uint64_t target = cfg_jump_target(&parsed_instructions[i]);
+
+            if (target >= total || index_at[target] == CFG_NONE)
+                goto fail;
+
+            leader[index_at[target]] = 1;
+        }
+
+        if ((cfg_has_target(instruction) || instruction == INS_HALT || instruction == INS_RET) && i + 1 < count)
+            leader[i + 1] = 1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (leader[i]) {
+            BasicBlock block = {
+                .first = i,
+                .end = i,
+                .ip = cfg->ip_of[i],
+                .succs = NULL,
+                .preds = NULL,
+                .idom = CFG_NONE,
+                .reachable = 0,
+                .root = 0,
+            };
+
+            cvector_push_back(cfg->blocks, block);
+        }
+
+        cfg->block_of[i] = cvector_size(cfg->blocks) - 1;
+        cfg->blocks[cvector_size(cfg->blocks) - 1].end = i + 1;
+    }
+
+    for (size_t i = 0; i < cvector_size(cfg->blocks); i++) {
+        size_t last = cfg->blocks[i].end - 1;
+        Instruction instruction = parsed_instructions[last].instruction;
+
+        if (cfg_has_target(instruction))
+            add_edge(cfg, i, cfg->block_of[index_at[cfg_jump_target(&parsed_instructions[last])]]);
+
+        if (instruction != INS_HALT && instruction != INS_JMP && instruction != INS_RET && last + 1 < count)
+            add_edge(cfg, i, cfg->block_of[last + 1]);
+    }
+
+    cfg->entry = cfg->block_of[index_at[start_rip]];
+    cfg->blocks[cfg->entry].root = 1;
+
+    for (size_t i = 0; i < cvector_size(entries); i++) {
+        if (entries[i].ip < total && index_at[entries[i].ip] != CFG_NONE)
+            cfg->blocks[cfg->block_of[index_at[entries[i].ip]]].root = 1;
+    }
+
+    cvector_vector_type(size_t) order = postorder(cfg);
+    compute_dominators(cfg, order);
+    cvector_free(order);
+
+    cfg->dom_pre = malloc(cvector_size(cfg->blocks) * sizeof(size_t));
+    cfg->dom_post = malloc(cvector_size(cfg->blocks) * sizeof(size_t));
+    number_dominator_tree(cfg);
+
+    find_loops(cfg);
+
+    free(leader);
+    free(index_at);
+
+    return cfg;
+
+fail:
+    free(leader);
+    free(index_at);
+    cfg_deinit(cfg);
+
+    return NULL;
+}
+
+void cfg_deinit(CFG* cfg) {
+    if (!cfg)
+        return;
+
+    for (size_t i = 0; i < cvector_size(cfg->blocks); i++) {
+        cvector_free(cfg->blocks[i].succs);
+        cvector_free(cfg->blocks[i].preds);
+    }
+
+    for (size_t i = 0; i < cvector_size(cfg->loops); i++)
+        cvector_free(cfg->loops[i].blocks);
+
+    free(cfg->dom_pre);
+    free(cfg->dom_post);
+    cvector_free(cfg->blocks);
+    cvector_free(cfg->loops);
+    free(cfg->block_of);
+    free(cfg->ip_of);
+    free(cfg);
+}
+
+int cfg_dominates(const CFG* cfg, size_t dominator, size_t block) {
+    if (cfg->dom_pre[dominator] == CFG_NONE || cfg->dom_pre[block] == CFG_NONE)
+        return 0;
+
+    return cfg->dom_pre[dominator] <= cfg->dom_pre[block] && cfg->dom_post[block] <= cfg->dom_post[dominator];
+}
+
+static void print_register(FILE* file, uint8_t reg) {
+    fprintf(file, "R%c", 'A' + reg);
+}
+
+static void print_instruction(FILE* file, const ParsedInstruction* parsed_instruction) {
+    const uint8_t* operands = parsed_instruction->operands;
+    size_t len = parsed_instruction->operand_count;
+
+    fprintf(file, "%s", vm_instruction_name(parsed_instruction->instruction));
+
+    switch (parsed_instruction->instruction) {
+    case INS_IADD:
+    case INS_ISUB:
+    case INS_IMUL:
+    case INS_IDIV:
+    case INS_ISDIV:
+    case INS_IMOVE:
+    case INS_ICMP:
+    case INS_ISCMP: {
+        uint64_t immediate = 0;
+        memcpy(&immediate, &operands[1], len - 1);
+
+        fprintf(file, " ");
+        print_register(file, operands[0]);
+        fprintf(file, ", %lu", immediate);
+        break;
+    }
+
+    case INS_IPUSH:
+    case INS_JMP:
+    case INS_JE:
+    case INS_JNE:
+    case INS_JG:
+    case INS_JL:
+    case INS_JGE:
+    case INS_JLE:
+    case INS_JO:
+    case INS_JC:
+    case INS_CALL:
+        fprintf(file, " %lu", cfg_jump_target(parsed_instruction));
+        break;
+
+    case INS_LOADB:
+    case INS_LOADW:
+    case INS_LOADD:
+    case INS_LOADQ:
+    case INS_STOREB:
+    case INS_STOREW:
+    case INS_STORED:
+    case INS_STOREQ: {
+        uint64_t offset = 0;
+        memcpy(&offset, &operands[2], len - 2);
+
+        fprintf(file, " ");
+        print_register(file, operands[0]);
+        fprintf(file, ", ");
+        print_register(file, operands[1]);
+        fprintf(file, ", %lu", offset);
+        break;
+    }
+
+    case INS_VLOAD:
+    case INS_VSTORE: {
+        uint64_t offset = 0;
+        memcpy(&offset, &operands[2], len - 2);
+
+        fprintf(file, " V%c, ", 'A' + operands[0]);
+        print_register(file, operands[1]);
+        fprintf(file, ", %lu", offset);
+        break;
+    }
+
+    case INS_VADD:
+    case INS_VSUB:
+    case INS_VMUL:
+        fprintf(file, " V%c, V%c", 'A' + operands[0], 'A' + operands[1]);
+        break;
+
+    case INS_VSUM:
+        fprintf(file, " ");
+        print_register(file, operands[0]);
+        fprintf(file, ", V%c", 'A' + operands[1]);
+        break;
+
+    case INS_VSPLAT:
+        fprintf(file, " V%c, ", 'A' + operands[0]);
+        print_register(file, operands[1]);
+        break;
+
+    case INS_CALLNATIVE: {
+        const char* name = vm_native_name(operands[0]);
+
+        fprintf(file, " %u", operands[0]);
+
+        if (name)
+            fprintf(file, " (%s)", name);
+
+        break;
+    }
+
+    case INS_LOOP:
+        fprintf(file, " ");
+        print_register(file, operands[0]);
+        fprintf(file, ", %lu", cfg_jump_target(parsed_instruction));
+        break;
+
+    default:
+        for (size_t i = 0; i < len; i++) {
+            fprintf(file, i == 0 ? " " : ", ");
+            print_register(file, operands[i]);
+        }
+
+        break;
+    }
+}
+
+static void print_blocks(FILE* file, cvector_vector_type(size_t) blocks) {
+    if (cvector_size(blocks) == 0)
+        fprintf(file, " -");
+
+    for (size_t i = 0; i < cvector_size(blocks); i++)
+        fprintf(file, " %zu", blocks[i]);
+
+    fprintf(file, "\n");
+}
+
+void cfg_dump(FILE* file, const CFG* cfg, cvector_vector_type(ParsedInstruction) parsed_instructions, cvector_vector_type(Symbol) symbols) {
+    for (size_t i = 0; i < cvector_size(cfg->blocks); i++) {
+        const BasicBlock* block = &cfg->blocks[i];
+
+        fprintf(file, "block %zu (ip %lu)", i, block->ip);
+
+        for (size_t j = 0; j < cvector_size(symbols); j++) {
+            if (symbols[j].ip == block->ip) {
+                fprintf(file, " ");
+                span_print(file, symbols[j].span);
+                fprintf(file, ":");
+            }
+        }
+
+        if (i == cfg->entry)
+            fprintf(file, " entry");
+
+        if (!block->reachable)
+            fprintf(file, " unreachable");
+
+        fprintf(file, "\n");
+
+        for (size_t j = block->first; j < block->end; j++) {
+            fprintf(file, "    %6lu  ", cfg->ip_of[j]);
+            print_instruction(file, &parsed_instructions[j]);
+            fprintf(file, "\n");
+        }
+
+        fprintf(file, "  preds:");
+        print_blocks(file, block->preds);
+        fprintf(file, "  succs:");
+        print_blocks(file, block->succs);
+
+        if (block->idom != CFG_NONE && i != cfg->entry)
+            fprintf(file, "  idom: %zu\n", block->idom);
+    }
+
+    for (size_t i = 0; i < cvector_size(cfg->loops); i++) {
+        fprintf(file, "loop %zu header %zu:", i, cfg->loops[i].header);
+        print_blocks(file, cfg->loops[i].blocks);
+    }
+}
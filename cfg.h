@@ -0,0 +1,50 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cvector.h"
+#include "parser.h"
+
+#define CFG_NONE ((size_t)-1)
+
+typedef struct BasicBlock_t {
+    size_t first; /* index of the first instruction */
+    size_t end;   /* index one past the last instruction */
+    uint64_t ip;
+    cvector_vector_type(size_t) succs;
+    cvector_vector_type(size_t) preds;
+    size_t idom;
+    int reachable;
+    int root; /* execution may start here, the entry or an exported label */
+} BasicBlock;
+
+typedef struct Loop_t {
+    size_t header;
+    cvector_vector_type(size_t) blocks; /* includes the header */
+} Loop;
+
+typedef struct CFG_t {
+    cvector_vector_type(BasicBlock) blocks;
+    cvector_vector_type(Loop) loops;
+    size_t* block_of; /* instruction index -> block index */
+    uint64_t* ip_of;  /* instruction index -> ip, one extra entry for the end */
+    size_t* dom_pre;  /* dominator tree numbering */
+    size_t* dom_post;
+    size_t entry;
+} CFG;
+
+int cfg_is_jump(Instruction instruction);
+int cfg_is_conditional_jump(Instruction instruction);
+int cfg_has_target(Instruction instruction);
+uint64_t cfg_jump_target(const ParsedInstruction* parsed_instruction);
+void cfg_set_jump_target(ParsedInstruction* parsed_instruction, uint64_t target);
+
+CFG* cfg_init(cvector_vector_type(ParsedInstruction) parsed_instructions, uint64_t start_rip, cvector_vector_type(Symbol) entries);
+void cfg_deinit(CFG* cfg);
+int cfg_dominates(const CFG* cfg, size_t dominator, size_t block);
+void cfg_dump(FILE* file, const CFG* cfg, cvector_vector_type(ParsedInstruction) parsed_instructions, cvector_vector_type(Symbol) symbols);
+
+#endif /* CFG_H */
@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "chunked.h"
+#include "parser.h"
+#include "scan.h"
+#include "opt.h"
+#include "labels.h"
+
+/* a piece of the source assembled as if it were a program on its own. */
+typedef struct Chunk_t {
+    char* text;
+    int flags;
+    int ok;
+    cvector_vector_type(ParsedInstruction) parsed_instructions; /* kept for the optimizer */
+    cvector_vector_type(uint8_t) code;
+    cvector_vector_type(Relocation) relocations;
+    cvector_vector_type(Symbol) symbols; /* the spans point into text */
+    uint64_t start_rip;
+    int has_start;
+    uint64_t size;
+    uint64_t base; /* where it goes in the program */
+} Chunk;
+
+/* where to end the chunk starting at from, near to. a line starting with whitespace or a
+ * comment may lex differently once split off, so only a line starting with a token will do. */
+static const char* chunk_end(const char* from, const char* to, const char* end) {
+    for (const char* at = to > from ? to : from; at < end; at++) {
+        char next = at[1];
+
+        if (*at == '\n' && next != 0 && next != ' ' && next != '\t' && next != '\r' && next != '\n' && next != ';')
+            return at + 1;
+    }
+
+    return end;
+}
+
+static void* chunk_main(void* arg) {
+    Chunk* chunk = arg;
+
+    /* the split can leave the last chunks with nothing. */
+    chunk->ok = chunk->text[0] == 0;
+
+    if (chunk->ok || !parser_init(chunk->text))
+        return NULL;
+
+    chunk->parsed_instructions = parser_start_chunk(&chunk->start_rip, &chunk->relocations);
+    chunk->ok = parser_error() == NULL;
+
+    cvector_vector_type(Symbol) symbols = parser_symbols();
+
+    for (size_t i = 0; i < cvector_size(symbols); i++) {
+        cvector_push_back(chunk->symbols, symbols[i]);
+
+        if (span_equals(span_from("start"), symbols[i].span))
+            chunk->has_start = 1;
+    }
+
+    for (size_t i = 0; i < cvector_size(chunk->parsed_instructions); i++)
+        chunk->size += chunk->parsed_instructions[i].size;
+
+    if (chunk->ok && !(chunk->flags & THORKELL_OPTIMIZE)) {
+        chunk->code = parsed_instructions_codegen(chunk->parsed_instructions);
+        cvector_free(chunk->parsed_instructions);
+        chunk->parsed_instructions = NULL;
+    }
+
+    parser_deinit();
+
+    return NULL;
+}
+
+static void chunk_free(Chunk* chunk) {
+    cvector_free(chunk->parsed_instructions);
+    cvector_free(chunk->code);
+    cvector_free(chunk->relocations);
+    cvector_free(chunk->symbols);
+    free(chunk->text);
+}
+
+/* resolves the targets of every chunk against the labels of all of them, labels only
+ * ever refer back, so a target has to be defined at or before its jump. */
+static int link_chunks(Chunk* chunks, size_t count, cvector_vector_type(Symbol)* symbols, uint64_t* start_rip) {
+    size_t symbol_count = 0;
+    uint64_t base = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        chunks[i].base = base;
+        base += chunks[i].size;
+        symbol_count += cvector_size(chunks[i].symbols);
+
+        if (chunks[i].has_start)
+            *start_rip = chunks[i].base + chunks[i].start_rip;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < cvector_size(chunks[i].symbols); j++) {
+            Symbol symbol = chunks[i].symbols[j];
+            symbol.ip += chunks[i].base;
+            cvector_push_back(*symbols, symbol);
+        }
+    }
+
+    LabelTable table;
+
+    if (!label_table_init(&table, symbol_count))
+        return 0;
+
+    /* labels to their first definition in the merged symbols, plus one */
+    for (size_t i = 0; i < symbol_count; i++)
+        label_table_add(&table, (*symbols)[i].span, i + 1);
+
+    int ok = 1;
+
+    for (size_t i = 0; i < count && ok; i++) {
+        Chunk* chunk = &chunks[i];
+        size_t instruction = 0;
+        uint64_t ip = 0;
+
+        for (size_t j = 0; j < cvector_size(chunk->relocations) && ok; j++) {
+            Relocation relocation = chunk->relocations[j];
+            size_t defined = label_table_find(&table, relocation.label);
+            uint64_t target = defined > 0 ? (*symbols)[defined - 1].ip : 0;
+
+            ok = defined > 0 && target <= chunk->base + relocation.offset - 2;
+
+            if (!ok)
+                break;
+
+            if (chunk->code) {
+                memcpy(&chunk->code[relocation.offset], &target, sizeof(uint64_t));
+                continue;
+            }
+
+            /* the relocations come in the order of their jumps. */
+            while (ip + chunk->parsed_instructions[instruction].size <= relocation.offset) {
+                ip += chunk->parsed_instructions[instruction].size;
+                instruction += 1;
+            }
+
+            memcpy(&chunk->parsed_instructions[instruction].operands[relocation.offset - ip - 2], &target, sizeof(uint64_t));
+        }
+    }
+
+    label_table_deinit(&table);
+
+    return ok;
+}
+
+ThorkellStatus chunked_assemble(const char* source, int flags, size_t threads, ThorkellProgram* program, ThorkellError* error) {
+    size_t len = strlen(source);
+
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (size_t)cpus : 1;
+    }
+
+    size_t count = len / CHUNKED_MIN_CHUNK < threads ? len / CHUNKED_MIN_CHUNK : threads;
+
+    if (count <= 1)
+        return thorkell_assemble(source, flags, program, error);
+
+    Chunk* chunks = calloc(count, sizeof(Chunk));
+    pthread_t* workers = malloc(count * sizeof(pthread_t));
+    int* started = calloc(count, sizeof(int));
+    int ok = chunks && workers && started;
+    const char* from = source;
+
+    for (size_t i = 0; i < count && ok; i++) {
+        const char* to = i + 1 < count ? chunk_end(from, source + (i + 1) * len / count, source + len) : source + len;
+
+        chunks[i].flags = flags;
+        chunks[i].text = malloc(to - from + 1);
+        ok = chunks[i].text != NULL;
+
+        if (ok) {
+            memcpy(chunks[i].text, from, to - from);
+            chunks[i].text[to - from] = 0;
+        }
+
+        from = to;
+    }
+
+    /* picked once up front, the lexer of every thread asks for it. */
+    scan_ops();
+
+    for (size_t i = 1; i < count && ok; i++)
+        started[i] = pthread_create(&workers[i], NULL, chunk_main, &chunks[i]) == 0;
+
+    if (ok)
+        chunk_main(&chunks[0]);
+
+    for (size_t i = 1; i < count && ok; i++) {
+        if (started[i])
+            pthread_join(workers[i], NULL);
+        else
+            chunk_main(&chunks[i]);
+    }
+
+    cvector_vector_type(Symbol) symbols = NULL;
+
+    program->code = NULL;
+    program->start_rip = 0;
+
+    for (size_t i = 0; i < count && ok; i++)
+        ok = chunks[i].ok;
+
+    ok = ok && link_chunks(chunks, count, &symbols, &program->start_rip);
+
+    if (ok && !(flags & THORKELL_OPTIMIZE)) {
+        for (size_t i = 0; i < count; i++) {
+            for (size_t j = 0; j < cvector_size(chunks[i].code); j++)
+                cvector_push_back(program->code, chunks[i].code[j]);
+        }
+    } else if (ok) {
+        cvector_vector_type(ParsedInstruction) parsed_instructions = NULL;
+
+        for (size_t i = 0; i < count; i++) {
+            for (size_t j = 0; j < cvector_size(chunks[i].parsed_instructions); j++)
+                cvector_push_back(parsed_instructions, chunks[i].parsed_instructions[j]);
+
+            cvector_free(chunks[i].parsed_instructions);
+            chunks[i].parsed_instructions = NULL;
+        }
+
+        optimize(&parsed_instructions, &program->start_rip, symbols, 0);
+        program->code = parsed_instructions_codegen(parsed_instructions);
+        cvector_free(parsed_instructions);
+    }
+
+    for (size_t i = 0; chunks && i < count; i++)
+        chunk_free(&chunks[i]);
+
+    cvector_free(symbols);
+    free(chunks);
+    free(workers);
+    free(started);
+
+    /* the error is the one of the first problem in source order, with its position in the
+     * whole source, which is simplest to get from the assembler itself. */
+    if (!ok)
+        return thorkell_assemble(source, flags, program, error);
+
+    if (error)
+        memset(error, 0, sizeof(ThorkellError));
+
+    return THORKELL_OK;
+}
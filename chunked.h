@@ -0,0 +1,17 @@
+#ifndef CHUNKED_H
+#define CHUNKED_H
+
+#include <stddef.h>
+
+#include "thorkell.h"
+
+#define CHUNKED_MIN_CHUNK (64 * 1024) /* smaller sources are not worth a thread */
+
+/* assembles source like thorkell_assemble, with the source split at line boundaries and
+ * the chunks lexed and parsed on up to threads threads, 0 for one per cpu. the chunks are
+ * linked afterwards, with every jump target patched to where its label ended up. a
+ * source that does not assemble is assembled again on its own to report the error the
+ * way thorkell_assemble does. like it, it may be called from several threads at once. */
+ThorkellStatus chunked_assemble(const char* source, int flags, size_t threads, ThorkellProgram* program, ThorkellError* error);
+
+#endif /* CHUNKED_H */
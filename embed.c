@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "embed.h"
+
+/* a vm at the start of program, trusting the verification done when it was embedded. */
+VM* embedded_load(const EmbeddedProgram* program, uint64_t memory_size) {
+    VM* vm = vm_init(program->code, program->start_rip, memory_size);
+
+    if (vm)
+        vm->verified = program->stack_safe;
+
+    return vm;
+}
+
+/* looks a label up by name, returns 0 when the program has no such label. setting the
+ * rip of a fresh vm from embedded_load to ip runs the program from there. */
+int embedded_symbol(const EmbeddedProgram* program, const char* name, uint64_t* ip) {
+    for (size_t i = 0; i < program->symbol_count; i++) {
+        if (strcmp(program->symbols[i].name, name) == 0) {
+            *ip = program->symbols[i].ip;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* the bytecode as a static array called name. */
+void embed_emit_code(FILE* file, const char* name, const uint8_t* code, uint64_t size) {
+    fprintf(file, "static const uint8_t %s[%lu] = {", name, size);
+
+    for (uint64_t i = 0; i < size; i++)
+        fprintf(file, "%s0x%02x,", i % 12 == 0 ? "\n    " : " ", code[i]);
+
+    fprintf(file, "\n};\n\n");
+}
+
+/* writes a translation unit defining const EmbeddedProgram <name>, labels are alphabetic
+ * so they need no escaping. */
+void embed_emit_c(FILE* file, const char* name, const uint8_t* code, uint64_t size, uint64_t start_rip, cvector_vector_type(Symbol) symbols, int stack_safe) {
+    size_t symbol_count = cvector_size(symbols);
+
+    fprintf(file, "/* generated by thorkell --embed, do not edit. */\n\n");
+    fprintf(file, "#include \"embed.h\"\n\n");
+
+    embed_emit_code(file, "g_code", code, size);
+
+    if (symbol_count != 0) {
+        fprintf(file, "static const EmbeddedSymbol g_symbols[%zu] = {\n", symbol_count);
+
+        for (size_t i = 0; i < symbol_count; i++)
+            fprintf(file, "    { \"%.*s\", %lu },\n", (int)symbols[i].span.len, symbols[i].span.data, symbols[i].ip);
+
+        fprintf(file, "};\n\n");
+    }
+
+    fprintf(file, "const EmbeddedProgram %s = {\n", name);
+    fprintf(file, "    .code = g_code,\n");
+    fprintf(file, "    .size = %lu,\n", size);
+    fprintf(file, "    .start_rip = %lu,\n", start_rip);
+    fprintf(file, "    .symbols = %s,\n", symbol_count != 0 ? "g_symbols" : "NULL");
+    fprintf(file, "    .symbol_count = %zu,\n", symbol_count);
+    fprintf(file, "    .stack_safe = %d,\n", stack_safe);
+    fprintf(file, "};\n");
+}
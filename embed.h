@@ -0,0 +1,35 @@
+#ifndef EMBED_H
+#define EMBED_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cvector.h"
+#include "parser.h"
+#include "vm.h"
+
+typedef struct EmbeddedSymbol_t {
+    const char* name;
+    uint64_t ip;
+} EmbeddedSymbol;
+
+/* a program assembled and verified at build time by thorkell --embed, loading it does
+ * no parsing and no verification. a fresh vm may be started at start_rip or at any of
+ * the symbols, the optimizer and the verifier treated each of them as an entry. */
+typedef struct EmbeddedProgram_t {
+    const uint8_t* code;
+    uint64_t size;
+    uint64_t start_rip;
+    const EmbeddedSymbol* symbols;
+    size_t symbol_count;
+    int stack_safe; /* what the verifier said, from the start and from every symbol */
+} EmbeddedProgram;
+
+VM* embedded_load(const EmbeddedProgram* program, uint64_t memory_size);
+int embedded_symbol(const EmbeddedProgram* program, const char* name, uint64_t* ip);
+
+void embed_emit_code(FILE* file, const char* name, const uint8_t* code, uint64_t size);
+void embed_emit_c(FILE* file, const char* name, const uint8_t* code, uint64_t size, uint64_t start_rip, cvector_vector_type(Symbol) symbols, int stack_safe);
+
+#endif /* EMBED_H */
@@ -0,0 +1,162 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "fork.h"
+#include "scheduler.h"
+
+/* copies the registers and the used part of both stacks, the rest of the vm is
+ * either shared (instructions) or set up by the caller (memory). */
+static VM* fork_state(const VM* parent) {
+    VM* child = malloc(sizeof(VM));
+
+    if (!child)
+        return NULL;
+
+    memcpy(child->registers, parent->registers, sizeof(parent->registers));
+    memcpy(child->vregisters, parent->vregisters, sizeof(parent->vregisters));
+    memcpy(child->flags, parent->flags, sizeof(parent->flags));
+    memcpy(child->stack, parent->stack, parent->rsp);
+    memcpy(child->call_stack, parent->call_stack, parent->rcsp * sizeof(uint64_t));
+
+    child->instructions = parent->instructions;
+    child->memory = NULL;
+    child->memory_size = 0;
+    child->memory_owner = VM_MEMORY_HEAP;
+    child->simd = parent->simd;
+    child->rsp = parent->rsp;
+    child->rip = parent->rip;
+    child->rcsp = parent->rcsp;
+    child->fault = parent->fault;
+    child->fault_rip = parent->fault_rip;
+    child->verified = parent->verified;
+    memset(&child->stats, 0, sizeof(VMStats)); /* counts from the fork on */
+    child->native_hook = NULL;
+    child->native_write_hook = NULL;
+    child->native_hook_data = NULL;
+
+    return child;
+}
+
+static uint8_t* map_private(int fd, uint64_t size) {
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+    return memory == MAP_FAILED ? NULL : memory;
+}
+
+/* freezes the parent's memory into an anonymous file with a single copy. */
+static int freeze_memory(const VM* parent) {
+    int fd = memfd_create("thorkell-fork", MFD_CLOEXEC);
+
+    if (fd < 0)
+        return -1;
+
+    if (ftruncate(fd, parent->memory_size) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    void* shared = mmap(NULL, parent->memory_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (shared == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    memcpy(shared, parent->memory, parent->memory_size);
+    munmap(shared, parent->memory_size);
+
+    return fd;
+}
+
+/* branches parent into count children that continue from the same state, returns 0 on
+ * failure. the instructions are shared read only and the linear memory is frozen into
+ * a memfd that every child maps privately, so a child only ever copies the pages it
+ * writes. the memfd holds a copy, so nothing the parent writes afterwards reaches the
+ * children either way. the parent is moved onto such a mapping too (unless the host
+ * owns its memory) so it shares the frozen pages instead of keeping its own full copy
+ * beside them. the stacks live inside the vm and are smaller than a page, so those are
+ * copied, only the used part. */
+int vm_fork(VM* parent, VM** children, size_t count) {
+    int fd = -1;
+
+    if (parent->memory_size > 0 && (fd = freeze_memory(parent)) < 0)
+        return 0;
+
+    for (size_t i = 0; i < count; i++) {
+        VM* child = fork_state(parent);
+
+        if (child && fd >= 0) {
+            child->memory = map_private(fd, parent->memory_size);
+            child->memory_size = child->memory ? parent->memory_size : 0;
+            child->memory_owner = VM_MEMORY_MAPPED;
+        }
+
+        if (!child || (fd >= 0 && !child->memory)) {
+            vm_deinit(child);
+
+            for (size_t j = 0; j < i; j++) {
+                vm_deinit(children[j]);
+                children[j] = NULL;
+            }
+
+            if (fd >= 0)
+                close(fd);
+
+            return 0;
+        }
+
+        children[i] = child;
+    }
+
+    if (fd >= 0 && parent->memory_owner != VM_MEMORY_HOST) {
+        uint8_t* memory = map_private(fd, parent->memory_size);
+
+        if (memory) {
+            uint64_t size = parent->memory_size;
+
+            vm_map_memory(parent, memory, size);
+            parent->memory_owner = VM_MEMORY_MAPPED;
+        }
+    }
+
+    if (fd >= 0)
+        close(fd);
+
+    return 1;
+}
+
+/* runs the children to completion on workers threads and records how each ended,
+ * the children stay alive so the caller can inspect memory too. returns 0 when out
+ * of memory, before any child ran. */
+int vm_fork_run(VM** children, size_t count, size_t workers, ForkResult* results) {
+    Scheduler* scheduler = scheduler_init(workers, SCHED_DEFAULT_QUANTUM);
+
+    if (!scheduler)
+        return 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!scheduler_spawn(scheduler, children[i])) {
+            scheduler_deinit(scheduler);
+            return 0;
+        }
+    }
+
+    scheduler_run(scheduler);
+    scheduler_deinit(scheduler);
+
+    for (size_t i = 0; i < count; i++) {
+        const VM* child = children[i];
+
+        memcpy(results[i].registers, child->registers, sizeof(child->registers));
+        memcpy(results[i].flags, child->flags, sizeof(child->flags));
+        results[i].status = child->fault != VM_FAULT_NONE ? VM_FAULTED : VM_HALTED;
+        results[i].fault = child->fault;
+        results[i].fault_rip = child->fault_rip;
+    }
+
+    return 1;
+}
@@ -0,0 +1,20 @@
+#ifndef FORK_H
+#define FORK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+typedef struct ForkResult_t {
+    uint64_t registers[REGISTER_MAX];
+    uint8_t flags[FLAGS_MAX];
+    VMStatus status;
+    VMFault fault;
+    uint64_t fault_rip;
+} ForkResult;
+
+int vm_fork(VM* parent, VM** children, size_t count);
+int vm_fork_run(VM** children, size_t count, size_t workers, ForkResult* results);
+
+#endif /* FORK_H */
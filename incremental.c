@@ -0,0 +1,553 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "incremental.h"
+#include "parser.h"
+#include "lexer.h"
+#include "labels.h"
+
+/* the source from one label up to the next, the part before the first label has none. */
+typedef struct Section_t {
+    char* text; /* runs on to the end of the next label, so errors name the same token */
+    size_t len; /* of the section's own part of text */
+    size_t lines; /* newlines in text */
+    size_t tail; /* characters after the last newline */
+    Span label;
+    cvector_vector_type(uint8_t) code; /* relocations are patched in for the current layout */
+    cvector_vector_type(Relocation) relocations;
+    cvector_vector_type(size_t) targets; /* the section index of each relocation's label */
+    size_t start; /* where text starts in the source */
+    uint64_t base; /* and code in the program */
+} Section;
+
+struct IncrementalAssembler_t {
+    Section* sections;
+    size_t count;
+    size_t capacity;
+    LabelTable labels; /* each label to the first section it names, its index plus one */
+    size_t start_section; /* the last section labelled start plus one, 0 for none */
+    size_t shift_from; /* the sections from here on start shift bytes after their start */
+    size_t shift;
+    size_t source_len;
+    ThorkellProgram program;
+    IncrementalStats stats;
+};
+
+/* an edit being made: count pieces take the place of the sections from first to last. */
+typedef struct Edit_t {
+    Section* pieces;
+    size_t count;
+    size_t first;
+    size_t last;
+} Edit;
+
+static ThorkellStatus set_error(ThorkellError* error, ThorkellStatus status, size_t line, size_t col, const char* message) {
+    if (!error)
+        return status;
+
+    memset(error, 0, sizeof(ThorkellError));
+    error->status = status;
+    error->line = line;
+    error->col = col;
+    snprintf(error->message, sizeof(error->message), "%s", message);
+
+    return status;
+}
+
+IncrementalAssembler* incremental_init() {
+    IncrementalAssembler* assembler = calloc(1, sizeof(IncrementalAssembler));
+
+    if (assembler && !label_table_init(&assembler->labels, 0)) {
+        free(assembler);
+        return NULL;
+    }
+
+    return assembler;
+}
+
+static void section_free(Section* section) {
+    free(section->text);
+    cvector_free(section->code);
+    cvector_free(section->relocations);
+    cvector_free(section->targets);
+}
+
+void incremental_deinit(IncrementalAssembler* assembler) {
+    if (!assembler)
+        return;
+
+    for (size_t i = 0; i < assembler->count; i++)
+        section_free(&assembler->sections[i]);
+
+    free(assembler->sections);
+    label_table_deinit(&assembler->labels);
+    thorkell_program_free(&assembler->program);
+    free(assembler);
+}
+
+const ThorkellProgram* incremental_program(const IncrementalAssembler* assembler) {
+    return &assembler->program;
+}
+
+IncrementalStats incremental_stats(const IncrementalAssembler* assembler) {
+    return assembler->stats;
+}
+
+/* where section i starts in the source. */
+static size_t section_start(const IncrementalAssembler* assembler, size_t i) {
+    return assembler->sections[i].start + (i >= assembler->shift_from ? assembler->shift : 0);
+}
+
+/* moves the sections from `from` on by delta bytes of source, wrapping for a negative
+ * one. the move is left pending in shift, only the sections between it and the last
+ * one are touched, so nearby edits do not walk the rest of the program. */
+static void shift_starts(IncrementalAssembler* assembler, size_t from, size_t delta) {
+    for (size_t i = assembler->shift_from; i < from; i++)
+        assembler->sections[i].start += assembler->shift;
+
+    for (size_t i = from; i < assembler->shift_from; i++)
+        assembler->sections[i].start -= assembler->shift;
+
+    assembler->shift_from = from;
+    assembler->shift += delta;
+}
+
+/* the section holding offset of the source, the last one for the end of it. */
+static size_t section_at(const IncrementalAssembler* assembler, size_t offset) {
+    size_t low = 0;
+    size_t high = assembler->count;
+
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+
+        if (section_start(assembler, middle) <= offset)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/* the section holding the end of the line offset is on. no token or comment crosses a
+ * line, so that is as far as an edit can change how the source lexes. */
+static size_t line_end_section(const IncrementalAssembler* assembler, size_t offset) {
+    for (size_t i = section_at(assembler, offset); i < assembler->count; i++) {
+        const Section* section = &assembler->sections[i];
+        size_t start = section_start(assembler, i);
+        size_t from = offset > start ? offset - start : 0;
+
+        if (from < section->len && memchr(&section->text[from], '\n', section->len - from))
+            return i;
+    }
+
+    return assembler->count - 1;
+}
+
+/* moves line and col, as the lexer counts them, past the text of section. */
+static void advance_position(size_t* line, size_t* col, const Section* section) {
+    if (section->lines > 0) {
+        *line += section->lines;
+        *col = 1 + section->tail;
+    } else {
+        *col += section->tail;
+    }
+}
+
+/* a position in a section's own text as a position in the source, given where it starts. */
+static void source_position(size_t line, size_t col, size_t* error_line, size_t* error_col) {
+    if (*error_line == 1)
+        *error_col = col + *error_col - 1;
+
+    *error_line = line + *error_line - 1;
+}
+
+/* section i of the program as the edit leaves it. */
+static Section* edited_section(IncrementalAssembler* assembler, const Edit* edit, size_t i) {
+    if (i < edit->first)
+        return &assembler->sections[i];
+
+    if (i < edit->first + edit->count)
+        return &edit->pieces[i - edit->first];
+
+    return &assembler->sections[i - edit->first - edit->count + edit->last];
+}
+
+/* line and col, as the lexer counts them, where section i of the edited program starts.
+ * only errors need it, so it may walk every section before. */
+static void edited_position(IncrementalAssembler* assembler, const Edit* edit, size_t i, size_t* line, size_t* col) {
+    *line = 1;
+    *col = 1;
+
+    for (size_t j = 0; j < i; j++)
+        advance_position(line, col, edited_section(assembler, edit, j));
+}
+
+/* checks that every target of section i of the edited program is a label at or before it. */
+static ThorkellStatus section_check(IncrementalAssembler* assembler, const Edit* edit, const LabelTable* table, size_t i, ThorkellError* error) {
+    const Section* section = edited_section(assembler, edit, i);
+
+    for (size_t j = 0; j < cvector_size(section->relocations); j++) {
+        Relocation relocation = section->relocations[j];
+        size_t defined = label_table_find(table, relocation.label);
+
+        if (defined == 0 || defined > i + 1) {
+            char message[THORKELL_ERROR_MAX];
+            size_t line;
+            size_t col;
+            size_t label_line;
+            size_t label_col;
+
+            snprintf(message, sizeof(message), "the lable: %.*s does not exist", (int)relocation.label.len, relocation.label.data);
+            lexer_position(section->text, relocation.label.data - section->text, &label_line, &label_col);
+            edited_position(assembler, edit, i, &line, &col);
+            source_position(line, col, &label_line, &label_col);
+
+            return set_error(error, THORKELL_ERROR_SYNTAX, label_line, label_col, message);
+        }
+    }
+
+    return THORKELL_OK;
+}
+
+/* patches the targets of section i into its code and the program's, the ones before
+ * from kept their place. resolve looks them up again, the labels or the section's
+ * relocations changed. */
+static void section_link(IncrementalAssembler* assembler, size_t i, size_t from, int resolve) {
+    Section* section = &assembler->sections[i];
+
+    for (size_t j = 0; j < cvector_size(section->relocations); j++) {
+        if (resolve)
+            section->targets[j] = label_table_find(&assembler->labels, section->relocations[j].label) - 1;
+
+        size_t target = section->targets[j];
+        uint64_t offset = section->relocations[j].offset;
+
+        if (target < from)
+            continue;
+
+        memcpy(&section->code[offset], &assembler->sections[target].base, sizeof(uint64_t));
+        memcpy(&assembler->program.code[section->base + offset], &section->code[offset], sizeof(uint64_t));
+    }
+}
+
+/* assembles a section of len bytes from text on its own, text_len takes in the label of
+ * the next section. a failure leaves the parse error in error with the position relative
+ * to the text, the relocations before it are kept to be checked first. */
+static int section_parse(Section* section, const char* text, size_t len, size_t text_len, size_t label_len, ParseError* error) {
+    memset(section, 0, sizeof(Section));
+
+    section->text = malloc(text_len + 1);
+
+    if (!section->text) {
+        snprintf(error->message, sizeof(error->message), "%s", thorkell_status_name(THORKELL_ERROR_MEMORY));
+        error->line = 1;
+        error->col = 1;
+        return 0;
+    }
+
+    memcpy(section->text, text, text_len);
+    section->text[text_len] = 0;
+    section->len = len;
+    section->label = label_len > 0 ? span_init(section->text, label_len) : span_init_null();
+
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\n') {
+            section->lines += 1;
+            section->tail = 0;
+        } else {
+            section->tail += 1;
+        }
+    }
+
+    uint64_t start_rip = 0;
+
+    parser_init(section->text);
+
+    cvector_vector_type(ParsedInstruction) parsed_instructions = parser_start_section(&start_rip, &section->relocations);
+    const ParseError* parse_error = parser_error();
+
+    if (parse_error) {
+        *error = *parse_error;
+        parser_deinit();
+        return 0;
+    }
+
+    section->code = parsed_instructions_codegen(parsed_instructions);
+    cvector_free(parsed_instructions);
+    parser_deinit();
+
+    for (size_t i = 0; i < cvector_size(section->relocations); i++)
+        cvector_push_back(section->targets, 0);
+
+    return 1;
+}
+
+/* the labels of region as the lexer sees them, the region starts at a token. */
+static cvector_vector_type(Span) region_labels(const char* region) {
+    cvector_vector_type(Span) labels = NULL;
+
+    lexer_init(region);
+
+    for (Token token = lexer_get_token(); token.kind != TOK_EOF && token.kind != TOK_ERROR; token = lexer_get_token()) {
+        if (token.kind == TOK_LABLE)
+            cvector_push_back(labels, token_span(token));
+    }
+
+    return labels;
+}
+
+/* resizes the part of the program's code from at, old_size bytes long, to new_size,
+ * moving whatever follows it. */
+static void resize_code(ThorkellProgram* program, uint64_t at, uint64_t old_size, uint64_t new_size) {
+    uint64_t size = cvector_size(program->code);
+    uint64_t tail = size - at - old_size;
+
+    if (new_size > old_size) {
+        for (uint64_t i = old_size; i < new_size; i++)
+            cvector_push_back(program->code, 0);
+
+        if (tail > 0)
+            memmove(&program->code[at + new_size], &program->code[at + old_size], tail);
+    } else if (new_size < old_size) {
+        if (tail > 0)
+            memmove(&program->code[at + new_size], &program->code[at + old_size], tail);
+
+        for (uint64_t i = new_size; i < old_size; i++)
+            cvector_pop_back(program->code);
+    }
+}
+
+/* replaces removed bytes of the source at offset with text. the sections from the one
+ * before the edit to the end of its line are split again at their labels and parsed, the
+ * edit can turn the label of the first into part of the one before. labels only ever
+ * refer back, so the sections before the edit keep their targets. when the edit keeps
+ * the labels and the size of every section, nothing after it changes and the cost is
+ * that of the edit and of the distance to the last one. otherwise the sections after it
+ * are moved and relinked, and the label table is built again if the labels changed.
+ * on failure error has the first problem in source order and nothing changes. */
+ThorkellStatus incremental_edit(IncrementalAssembler* assembler, size_t offset, size_t removed, const char* text, ThorkellError* error) {
+    if (offset > assembler->source_len || removed > assembler->source_len - offset)
+        return set_error(error, THORKELL_ERROR_PROGRAM, 0, 0, "the edit is outside of the source");
+
+    size_t first = 0;
+    size_t last = 0;
+
+    if (assembler->count > 0) {
+        first = section_at(assembler, offset == 0 ? 0 : offset - 1);
+        first = first > 0 ? first - 1 : 0;
+        last = line_end_section(assembler, offset + removed) + 1;
+    }
+
+    size_t region_start = assembler->count > 0 ? section_start(assembler, first) : 0;
+    size_t old_len = 0;
+    uint64_t old_size = 0;
+
+    for (size_t i = first; i < last; i++) {
+        old_len += assembler->sections[i].len;
+        old_size += cvector_size(assembler->sections[i].code);
+    }
+
+    size_t inserted = strlen(text);
+    size_t local = offset - region_start;
+    size_t region_len = old_len - removed + inserted;
+    Span next_label = last < assembler->count ? assembler->sections[last].label : span_init_null();
+    char* region = malloc(old_len + inserted + next_label.len + 2);
+
+    if (!region)
+        return set_error(error, THORKELL_ERROR_MEMORY, 0, 0, thorkell_status_name(THORKELL_ERROR_MEMORY));
+
+    for (size_t i = first, at = 0; i < last; at += assembler->sections[i].len, i++)
+        memcpy(&region[at], assembler->sections[i].text, assembler->sections[i].len);
+
+    memmove(&region[local + inserted], &region[local + removed], old_len - local - removed);
+    memcpy(&region[local], text, inserted);
+    if (next_label.len > 0)
+        memcpy(&region[region_len], next_label.data, next_label.len);
+
+    region[region_len + next_label.len] = ':';
+    region[region_len + next_label.len + (next_label.len > 0 ? 1 : 0)] = 0;
+
+    /* the label after the region is only there to end the last section's text. */
+    cvector_vector_type(Span) labels = region_labels(region);
+    size_t label_count = cvector_size(labels);
+
+    if (label_count > 0 && labels[label_count - 1].data >= region + region_len)
+        label_count -= 1;
+    size_t prefix = label_count > 0 ? (size_t)(labels[0].data - region) : region_len;
+    size_t pieces = label_count + (prefix > 0 ? 1 : 0);
+    size_t count = first + pieces + (assembler->count - last);
+    int same_labels = pieces == last - first;
+
+    for (size_t i = 0; i < pieces && same_labels; i++) {
+        Span label = prefix > 0 && i == 0 ? span_init_null() : labels[i - (prefix > 0 ? 1 : 0)];
+
+        same_labels = span_equals(label, assembler->sections[first + i].label);
+    }
+
+    Edit edit = {
+        .pieces = calloc(pieces > 0 ? pieces : 1, sizeof(Section)),
+        .count = pieces,
+        .first = first,
+        .last = last,
+    };
+    LabelTable table = assembler->labels;
+    size_t start_section = assembler->start_section;
+
+    /* the array only grows here, so nothing can fail once it is being changed */
+    if (edit.pieces && count > assembler->capacity) {
+        size_t capacity = count > 2 * assembler->capacity ? count : 2 * assembler->capacity;
+        Section* sections = realloc(assembler->sections, capacity * sizeof(Section));
+
+        if (sections) {
+            assembler->sections = sections;
+            assembler->capacity = capacity;
+        }
+    }
+
+    if (!edit.pieces || count > assembler->capacity || (!same_labels && !label_table_init(&table, count))) {
+        free(edit.pieces);
+        free(region);
+        cvector_free(labels);
+        return set_error(error, THORKELL_ERROR_MEMORY, 0, 0, thorkell_status_name(THORKELL_ERROR_MEMORY));
+    }
+
+    ParseError parse_error;
+    int failed = 0;
+    size_t parsed = 0;
+
+    for (; parsed < pieces && !failed; parsed++) {
+        size_t piece = parsed - (prefix > 0 ? 1 : 0);
+        const char* from = prefix > 0 && parsed == 0 ? region : labels[piece].data;
+        const char* to = piece + 1 < label_count ? labels[piece + 1].data : region + region_len;
+        const char* end = piece + 1 < cvector_size(labels) ? labels[piece + 1].data + labels[piece + 1].len + 1 : region + region_len;
+        size_t label_len = prefix > 0 && parsed == 0 ? 0 : labels[piece].len;
+
+        failed = !section_parse(&edit.pieces[parsed], from, to - from, end - from, label_len, &parse_error);
+    }
+
+    if (!same_labels) {
+        start_section = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            Span label = edited_section(assembler, &edit, i)->label;
+
+            if (label.len > 0) {
+                label_table_add(&table, label, i + 1);
+
+                if (span_equals(span_from("start"), label))
+                    start_section = i + 1;
+            }
+        }
+    }
+
+    ThorkellStatus status = THORKELL_OK;
+
+    for (size_t i = first; i < first + parsed && status == THORKELL_OK; i++)
+        status = section_check(assembler, &edit, &table, i, error);
+
+    if (failed && status == THORKELL_OK) {
+        size_t line;
+        size_t col;
+
+        edited_position(assembler, &edit, first + parsed - 1, &line, &col);
+        source_position(line, col, &parse_error.line, &parse_error.col);
+        status = set_error(error, THORKELL_ERROR_SYNTAX, parse_error.line, parse_error.col, parse_error.message);
+    }
+
+    /* with the same labels every target after the edit still resolves */
+    for (size_t i = first + pieces; i < count && !same_labels && status == THORKELL_OK; i++)
+        status = section_check(assembler, &edit, &table, i, error);
+
+    free(region);
+    cvector_free(labels);
+
+    if (status != THORKELL_OK) {
+        for (size_t i = 0; i < parsed; i++)
+            section_free(&edit.pieces[i]);
+
+        if (!same_labels)
+            label_table_deinit(&table);
+
+        free(edit.pieces);
+        return status;
+    }
+
+    uint64_t region_base = first < assembler->count ? assembler->sections[first].base : 0;
+    uint64_t new_size = 0;
+    int same_sizes = same_labels;
+
+    for (size_t i = 0; i < pieces; i++) {
+        new_size += cvector_size(edit.pieces[i].code);
+        same_sizes = same_sizes && cvector_size(edit.pieces[i].code) == cvector_size(assembler->sections[first + i].code);
+    }
+
+    if (same_labels) {
+        /* the table points into the text of the edited sections, which is about to go */
+        for (size_t i = 0; i < pieces; i++) {
+            if (edit.pieces[i].label.len > 0)
+                label_table_rebind(&assembler->labels, edit.pieces[i].label, first + i + 1);
+        }
+    } else {
+        label_table_deinit(&assembler->labels);
+        assembler->labels = table;
+        assembler->start_section = start_section;
+    }
+
+    resize_code(&assembler->program, region_base, old_size, new_size);
+
+    for (size_t i = first; i < last; i++)
+        section_free(&assembler->sections[i]);
+
+    /* the starts after the edit are settled before the sections move under them */
+    if (pieces != last - first) {
+        shift_starts(assembler, assembler->count, 0);
+        memmove(&assembler->sections[first + pieces], &assembler->sections[last], (assembler->count - last) * sizeof(Section));
+        assembler->count = count;
+        assembler->shift_from = count;
+        assembler->shift = 0;
+    }
+
+    shift_starts(assembler, first + pieces, inserted - removed);
+
+    for (size_t i = 0, start = region_start, base = region_base; i < pieces; i++) {
+        assembler->sections[first + i] = edit.pieces[i];
+        assembler->sections[first + i].start = start;
+        assembler->sections[first + i].base = base;
+        start += edit.pieces[i].len;
+        base += cvector_size(edit.pieces[i].code);
+    }
+
+    if (!same_sizes) {
+        for (size_t i = first + pieces; i < count; i++)
+            assembler->sections[i].base += new_size - old_size;
+    }
+
+    /* the new sections are copied in whole, those after them only have their targets
+     * patched, and only when something they could point at moved. */
+    for (size_t i = first; i < first + pieces; i++) {
+        Section* section = &assembler->sections[i];
+
+        section_link(assembler, i, 0, 1);
+
+        if (cvector_size(section->code) > 0)
+            memcpy(&assembler->program.code[section->base], section->code, cvector_size(section->code));
+    }
+
+    size_t relinked = same_sizes ? 0 : count - first - pieces;
+
+    for (size_t i = first + pieces; i < first + pieces + relinked; i++)
+        section_link(assembler, i, first, !same_labels);
+
+    free(edit.pieces);
+
+    assembler->source_len = assembler->source_len - removed + inserted;
+    assembler->program.start_rip = assembler->start_section > 0 ? assembler->sections[assembler->start_section - 1].base : 0;
+    assembler->stats.sections = count;
+    assembler->stats.reparsed_sections = pieces;
+    assembler->stats.reparsed_bytes = region_len;
+    assembler->stats.relinked_sections = relinked;
+
+    return set_error(error, THORKELL_OK, 0, 0, "");
+}
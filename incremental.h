@@ -0,0 +1,32 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "thorkell.h"
+
+typedef struct IncrementalStats_t {
+    size_t sections;
+    size_t reparsed_sections; /* by the last edit */
+    size_t reparsed_bytes;
+    size_t relinked_sections; /* after the edited ones, 0 when it kept the labels and sizes */
+} IncrementalStats;
+
+/* a program kept as one section per label, each with its encoded bytes and the jump
+ * targets it leaves open. an edit re-lexes and re-parses only the sections it touches
+ * and patches the program's bytes in place. an edit that keeps the labels and the size
+ * of every section costs the same at any program size, one that moves code relinks the
+ * sections after it and one that changes labels looks theirs up again. the program is
+ * the one thorkell_assemble gives for the edited source without flags, the optimizer
+ * needs the whole program and is not run. different assemblers may be edited on
+ * different threads, one may not. */
+typedef struct IncrementalAssembler_t IncrementalAssembler;
+
+IncrementalAssembler* incremental_init();
+void incremental_deinit(IncrementalAssembler* assembler);
+ThorkellStatus incremental_edit(IncrementalAssembler* assembler, size_t offset, size_t removed, const char* text, ThorkellError* error);
+const ThorkellProgram* incremental_program(const IncrementalAssembler* assembler);
+IncrementalStats incremental_stats(const IncrementalAssembler* assembler);
+
+#endif /* INCREMENTAL_H */
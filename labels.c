@@ -0,0 +1,63 @@
+#include <stdlib.h>
+
+#include "labels.h"
+
+static uint64_t span_hash(Span span) {
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (size_t i = 0; i < span.len; i++)
+        hash = (hash ^ (uint8_t)span.data[i]) * 0x100000001b3;
+
+    return hash;
+}
+
+/* sized for count labels at most half full, so an add never has to grow it. */
+int label_table_init(LabelTable* table, size_t count) {
+    table->size = 16;
+
+    while (table->size < count * 2)
+        table->size *= 2;
+
+    table->slots = calloc(table->size, sizeof(LabelSlot));
+
+    return table->slots != NULL;
+}
+
+void label_table_deinit(LabelTable* table) {
+    free(table->slots);
+    table->slots = NULL;
+}
+
+/* the slot of label, or the empty one it would go in. */
+static LabelSlot* label_table_slot(const LabelTable* table, Span label) {
+    size_t i = span_hash(label) & (table->size - 1);
+
+    while (table->slots[i].value != 0 && !span_equals(table->slots[i].label, label))
+        i = (i + 1) & (table->size - 1);
+
+    return &table->slots[i];
+}
+
+/* value must not be 0, a label added twice keeps its first value. */
+void label_table_add(LabelTable* table, Span label, size_t value) {
+    LabelSlot* slot = label_table_slot(table, label);
+
+    if (slot->value == 0) {
+        slot->label = label;
+        slot->value = value;
+    }
+}
+
+/* 0 for a label never added. */
+size_t label_table_find(const LabelTable* table, Span label) {
+    return label_table_slot(table, label)->value;
+}
+
+/* points label, if it was added with value, at another copy of its text, for when the
+ * text it was added with goes away. */
+void label_table_rebind(LabelTable* table, Span label, size_t value) {
+    LabelSlot* slot = label_table_slot(table, label);
+
+    if (slot->value == value)
+        slot->label = label;
+}
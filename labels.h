@@ -0,0 +1,27 @@
+#ifndef LABELS_H
+#define LABELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lexer.h"
+
+/* labels to a value of the caller's, open addressing, 0 is empty. the spans are not
+ * copied, the text they point into has to outlive the table. */
+typedef struct LabelSlot_t {
+    Span label;
+    size_t value;
+} LabelSlot;
+
+typedef struct LabelTable_t {
+    LabelSlot* slots;
+    size_t size; /* a power of two */
+} LabelTable;
+
+int label_table_init(LabelTable* table, size_t count);
+void label_table_deinit(LabelTable* table);
+void label_table_add(LabelTable* table, Span label, size_t value);
+size_t label_table_find(const LabelTable* table, Span label);
+void label_table_rebind(LabelTable* table, Span label, size_t value);
+
+#endif /* LABELS_H */
@@ -0,0 +1,437 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout.h"
+#include "cfg.h"
+
+#define JMP_SIZE 10
+
+/* what happens to the jump at the end of a block once the blocks have moved. */
+typedef enum BlockEnd_t {
+    END_KEEP,
+    END_INVERT, /* the taken side follows now, branch to the old fallthrough instead */
+    END_JUMP, /* the fallthrough no longer follows, a jmp to it is appended */
+    END_DROP, /* the jmp goes to the block that follows now */
+} BlockEnd;
+
+typedef struct Edge_t {
+    size_t from;
+    size_t to;
+    uint64_t weight;
+} Edge;
+
+typedef struct Chain_t {
+    size_t head;
+    uint64_t weight; /* of its hottest block */
+    int rank; /* the entry, hot chains, cold ones, then the one running off the end */
+} Chain;
+
+static uint64_t executed(const Profile* profile, uint64_t ip) {
+    return ip < profile->size ? profile->executed[ip] : 0;
+}
+
+static uint64_t taken(const Profile* profile, uint64_t ip) {
+    return ip < profile->size ? profile->taken[ip] : 0;
+}
+
+static size_t index_of(const CFG* cfg, size_t count, uint64_t ip) {
+    size_t lo = 0;
+    size_t hi = count + 1;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (cfg->ip_of[mid] < ip)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* where the instruction at ip went, blocks keep their insides in order. */
+static uint64_t new_ip(const CFG* cfg, size_t count, const uint64_t* block_ip, uint64_t new_size, uint64_t ip) {
+    size_t index = index_of(cfg, count, ip);
+
+    if (index >= count)
+        return new_size;
+
+    const BasicBlock* bb = &cfg->blocks[cfg->block_of[index]];
+
+    return block_ip[cfg->block_of[index]] + ip - bb->ip;
+}
+
+static int falls_through(Instruction instruction) {
+    return instruction != INS_JMP && instruction != INS_RET && instruction != INS_HALT;
+}
+
+/* the block control falls into after block, CFG_NONE when it cannot or runs off the end. */
+static size_t fallthrough_of(const CFG* cfg, cvector_vector_type(ParsedInstruction) parsed_instructions, size_t block) {
+    const BasicBlock* bb = &cfg->blocks[block];
+
+    if (!falls_through(parsed_instructions[bb->end - 1].instruction) || bb->end >= cvector_size(parsed_instructions))
+        return CFG_NONE;
+
+    return cfg->block_of[bb->end];
+}
+
+static size_t target_of(const CFG* cfg, cvector_vector_type(ParsedInstruction) parsed_instructions, size_t block) {
+    const ParsedInstruction* last = &parsed_instructions[cfg->blocks[block].end - 1];
+
+    if (!cfg_is_jump(last->instruction))
+        return CFG_NONE;
+
+    return cfg->block_of[index_of(cfg, cvector_size(parsed_instructions), cfg_jump_target(last))];
+}
+
+static Instruction inverse_of(Instruction instruction) {
+    switch (instruction) {
+    case INS_JE:
+        return INS_JNE;
+    case INS_JNE:
+        return INS_JE;
+    case INS_JG:
+        return INS_JLE;
+    case INS_JLE:
+        return INS_JG;
+    case INS_JL:
+        return INS_JGE;
+    case INS_JGE:
+        return INS_JL;
+    default:
+        return INS_COUNT;
+    }
+}
+
+/* only a compare leaves exactly one of a jump and its inverse taken, before the first
+ * one all the flags are clear. so the compare has to be in the block itself. */
+static int invertible(cvector_vector_type(ParsedInstruction) parsed_instructions, const BasicBlock* bb) {
+    if (inverse_of(parsed_instructions[bb->end - 1].instruction) == INS_COUNT)
+        return 0;
+
+    for (size_t i = bb->end - 1; i-- > bb->first;) {
+        switch (parsed_instructions[i].instruction) {
+        case INS_CMP:
+        case INS_ICMP:
+        case INS_SCMP:
+        case INS_ISCMP:
+            return 1;
+        case INS_CALLNATIVE:
+            return 0;
+        default:
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/* marks the cache lines the size bytes at ip sit in. */
+static void touch_lines(uint8_t* lines, uint64_t ip, uint64_t size) {
+    for (uint64_t line = ip / LAYOUT_CACHE_LINE; line <= (ip + size - 1) / LAYOUT_CACHE_LINE; line++)
+        lines[line] = 1;
+}
+
+static uint64_t count_lines(const uint8_t* lines, uint64_t size) {
+    uint64_t count = 0;
+
+    for (uint64_t line = 0; line <= size / LAYOUT_CACHE_LINE; line++)
+        count += lines[line];
+
+    return count;
+}
+
+static ParsedInstruction jump_to(uint64_t ip) {
+    uint8_t operands[sizeof(uint64_t)];
+    memcpy(operands, &ip, sizeof(uint64_t));
+
+    return parsed_instruction_init(INS_JMP, operands, sizeof(operands), JMP_SIZE);
+}
+
+static size_t find(size_t* chain_of, size_t block) {
+    while (chain_of[block] != block) {
+        chain_of[block] = chain_of[chain_of[block]];
+        block = chain_of[block];
+    }
+
+    return block;
+}
+
+static int compare_edges(const void* lhs, const void* rhs) {
+    const Edge* a = lhs;
+    const Edge* b = rhs;
+
+    if (a->weight != b->weight)
+        return a->weight > b->weight ? -1 : 1;
+
+    if (a->from != b->from)
+        return a->from < b->from ? -1 : 1;
+
+    return a->to < b->to ? -1 : a->to > b->to;
+}
+
+static int compare_chains(const void* lhs, const void* rhs) {
+    const Chain* a = lhs;
+    const Chain* b = rhs;
+
+    if (a->rank != b->rank)
+        return a->rank - b->rank;
+
+    if (a->weight != b->weight)
+        return a->weight > b->weight ? -1 : 1;
+
+    return a->head < b->head ? -1 : a->head > b->head;
+}
+
+static void add_edge(cvector_vector_type(Edge)* edges, size_t from, size_t to, uint64_t weight) {
+    if (to == CFG_NONE || from == to || weight == 0)
+        return;
+
+    Edge edge = { .from = from, .to = to, .weight = weight };
+    cvector_push_back(*edges, edge);
+}
+
+/* pettis and hansen's bottom up positioning. the heaviest edges of the profiled run
+ * become fallthroughs first by gluing together the chains of blocks they join. hot chains
+ * go first, led by the entry, and the blocks the run never reached go last in source
+ * order. jumps are then dropped, inverted or added to match and every target, the start
+ * and the labels move with their blocks.
+ * returns -1 if the program cannot be analysed, it is left untouched then. */
+int layout_blocks(cvector_vector_type(ParsedInstruction)* parsed_instructions, uint64_t* start_rip, cvector_vector_type(Symbol) symbols, const Profile* profile, LayoutStats* stats) {
+    cvector_vector_type(ParsedInstruction) parsed = *parsed_instructions;
+    size_t count = cvector_size(parsed);
+    CFG* cfg = cfg_init(parsed, *start_rip, NULL);
+
+    if (!cfg)
+        return -1;
+
+    size_t block_count = cvector_size(cfg->blocks);
+    size_t* next = malloc(block_count * sizeof(size_t));
+    size_t* prev = malloc(block_count * sizeof(size_t));
+    size_t* chain_of = malloc(block_count * sizeof(size_t));
+    uint64_t* weight = malloc(block_count * sizeof(uint64_t));
+    uint64_t* block_ip = malloc(block_count * sizeof(uint64_t));
+    BlockEnd* ends = malloc(block_count * sizeof(BlockEnd));
+    cvector_vector_type(Edge) edges = NULL;
+    cvector_vector_type(Chain) chains = NULL;
+    cvector_vector_type(size_t) order = NULL;
+    size_t pinned = CFG_NONE;
+    LayoutStats local;
+
+    memset(&local, 0, sizeof(local));
+
+    for (size_t i = 0; i < count; i++)
+        local.dispatches_before += executed(profile, cfg->ip_of[i]);
+
+    local.dispatches_after = local.dispatches_before;
+
+    for (size_t block = 0; block < block_count; block++) {
+        const BasicBlock* bb = &cfg->blocks[block];
+        uint64_t last_ip = cfg->ip_of[bb->end - 1];
+        Instruction instruction = parsed[bb->end - 1].instruction;
+        uint64_t runs = executed(profile, last_ip);
+        uint64_t jumps = taken(profile, last_ip) <= runs ? taken(profile, last_ip) : runs;
+        size_t fallthrough = fallthrough_of(cfg, parsed, block);
+
+        next[block] = CFG_NONE;
+        prev[block] = CFG_NONE;
+        chain_of[block] = block;
+        weight[block] = executed(profile, bb->ip);
+
+        if (weight[block] > 0)
+            local.hot_size += cfg->ip_of[bb->end] - bb->ip;
+        else
+            local.cold_size += cfg->ip_of[bb->end] - bb->ip;
+
+        if (instruction == INS_JMP)
+            local.taken_before += runs;
+        else if (cfg_is_conditional_jump(instruction))
+            local.taken_before += jumps;
+
+        /* nothing can follow a block that runs off the end of the code. */
+        if (falls_through(instruction) && bb->end == count) {
+            pinned = block;
+            continue;
+        }
+
+        if (instruction == INS_JMP) {
+            add_edge(&edges, block, target_of(cfg, parsed, block), runs);
+        } else if (cfg_is_conditional_jump(instruction)) {
+            add_edge(&edges, block, target_of(cfg, parsed, block), jumps);
+            add_edge(&edges, block, fallthrough, runs - jumps);
+        } else {
+            add_edge(&edges, block, fallthrough, runs);
+        }
+    }
+
+    if (cvector_size(edges) > 0)
+        qsort(edges, cvector_size(edges), sizeof(Edge), compare_edges);
+
+    for (size_t i = 0; i < cvector_size(edges); i++) {
+        Edge edge = edges[i];
+
+        if (next[edge.from] != CFG_NONE || prev[edge.to] != CFG_NONE || find(chain_of, edge.from) == find(chain_of, edge.to))
+            continue;
+
+        next[edge.from] = edge.to;
+        prev[edge.to] = edge.from;
+        chain_of[find(chain_of, edge.to)] = find(chain_of, edge.from);
+    }
+
+    for (size_t block = 0; block < block_count; block++) {
+        if (prev[block] != CFG_NONE)
+            continue;
+
+        Chain chain = { .head = block, .weight = 0, .rank = 2 };
+        int entry = 0;
+
+        for (size_t member = block; member != CFG_NONE; member = next[member]) {
+            chain.weight = weight[member] > chain.weight ? weight[member] : chain.weight;
+            entry |= member == cfg->entry;
+
+            if (member == pinned)
+                chain.rank = 3;
+        }
+
+        if (chain.rank != 3 && chain.weight > 0)
+            chain.rank = entry ? 0 : 1;
+
+        cvector_push_back(chains, chain);
+    }
+
+    qsort(chains, cvector_size(chains), sizeof(Chain), compare_chains);
+
+    for (size_t i = 0; i < cvector_size(chains); i++) {
+        for (size_t member = chains[i].head; member != CFG_NONE; member = next[member])
+            cvector_push_back(order, member);
+    }
+
+    /* decide how each block ends now, which fixes where every block goes. */
+    uint64_t ip = 0;
+
+    for (size_t i = 0; i < block_count; i++) {
+        size_t block = order[i];
+        size_t following = i + 1 < block_count ? order[i + 1] : CFG_NONE;
+        const BasicBlock* bb = &cfg->blocks[block];
+        uint64_t last_ip = cfg->ip_of[bb->end - 1];
+        Instruction instruction = parsed[bb->end - 1].instruction;
+        size_t fallthrough = fallthrough_of(cfg, parsed, block);
+        uint64_t runs = executed(profile, last_ip);
+        uint64_t jumps = taken(profile, last_ip) <= runs ? taken(profile, last_ip) : runs;
+
+        ends[block] = END_KEEP;
+
+        if (instruction == INS_JMP) {
+            ends[block] = target_of(cfg, parsed, block) == following ? END_DROP : END_KEEP;
+            local.taken_after += ends[block] == END_DROP ? 0 : runs;
+            local.dispatches_after -= ends[block] == END_DROP ? runs : 0;
+        } else if (cfg_is_conditional_jump(instruction) && fallthrough != following && fallthrough != CFG_NONE) {
+            int invert = target_of(cfg, parsed, block) == following && invertible(parsed, bb);
+
+            ends[block] = invert ? END_INVERT : END_JUMP;
+            local.taken_after += invert ? runs - jumps : runs;
+            local.dispatches_after += invert ? 0 : runs - jumps;
+        } else if (cfg_is_conditional_jump(instruction)) {
+            local.taken_after += jumps;
+        } else if (fallthrough != CFG_NONE && fallthrough != following) {
+            ends[block] = END_JUMP;
+            local.taken_after += runs;
+            local.dispatches_after += runs;
+        }
+
+        block_ip[block] = ip;
+        ip += cfg->ip_of[bb->end] - bb->ip;
+        ip += ends[block] == END_JUMP ? JMP_SIZE : 0;
+        ip -= ends[block] == END_DROP ? JMP_SIZE : 0;
+    }
+
+    uint64_t new_size = ip;
+    cvector_vector_type(ParsedInstruction) laid_out = NULL;
+    uint8_t* lines_before = calloc(cfg->ip_of[count] / LAYOUT_CACHE_LINE + 1, 1);
+    uint8_t* lines_after = calloc(new_size / LAYOUT_CACHE_LINE + 1, 1);
+
+    /* the lines the run touched, the jmps a block now ends in count when they ran. */
+    for (size_t block = 0; block < block_count; block++) {
+        const BasicBlock* bb = &cfg->blocks[block];
+        uint64_t end_ip = block_ip[block] + cfg->ip_of[bb->end] - bb->ip;
+
+        for (size_t i = bb->first; i < bb->end; i++) {
+            uint64_t ip = cfg->ip_of[i];
+            uint64_t size = cfg->ip_of[i + 1] - ip;
+
+            if (executed(profile, ip) == 0)
+                continue;
+
+            touch_lines(lines_before, ip, size);
+
+            if (i + 1 < bb->end || ends[block] != END_DROP)
+                touch_lines(lines_after, block_ip[block] + ip - bb->ip, size);
+        }
+
+        if (ends[block] == END_JUMP && executed(profile, cfg->ip_of[bb->end - 1]) > taken(profile, cfg->ip_of[bb->end - 1]))
+            touch_lines(lines_after, end_ip, JMP_SIZE);
+    }
+
+    local.lines_before = count_lines(lines_before, cfg->ip_of[count]);
+    local.lines_after = count_lines(lines_after, new_size);
+    free(lines_after);
+    free(lines_before);
+
+    /* targets stay in the old ips until everything is in place. */
+    for (size_t i = 0; i < block_count; i++) {
+        size_t block = order[i];
+        const BasicBlock* bb = &cfg->blocks[block];
+        size_t fallthrough = fallthrough_of(cfg, parsed, block);
+
+        for (size_t j = bb->first; j < bb->end; j++) {
+            ParsedInstruction parsed_instruction = parsed[j];
+
+            if (j + 1 == bb->end && ends[block] == END_DROP)
+                continue;
+
+            if (j + 1 == bb->end && ends[block] == END_INVERT) {
+                parsed_instruction.instruction = inverse_of(parsed_instruction.instruction);
+                cfg_set_jump_target(&parsed_instruction, cfg->blocks[fallthrough].ip);
+            }
+
+            cvector_push_back(laid_out, parsed_instruction);
+        }
+
+        if (ends[block] == END_JUMP)
+            cvector_push_back(laid_out, jump_to(cfg->blocks[fallthrough].ip));
+    }
+
+    for (size_t i = 0; i < cvector_size(laid_out); i++) {
+        if (cfg_has_target(laid_out[i].instruction))
+            cfg_set_jump_target(&laid_out[i], new_ip(cfg, count, block_ip, new_size, cfg_jump_target(&laid_out[i])));
+    }
+
+    *start_rip = new_ip(cfg, count, block_ip, new_size, *start_rip);
+
+    for (size_t i = 0; i < cvector_size(symbols); i++) {
+        size_t index = index_of(cfg, count, symbols[i].ip);
+
+        if (index <= count && cfg->ip_of[index] == symbols[i].ip)
+            symbols[i].ip = new_ip(cfg, count, block_ip, new_size, symbols[i].ip);
+    }
+
+    cvector_free(*parsed_instructions);
+    *parsed_instructions = laid_out;
+
+    if (stats)
+        *stats = local;
+
+    cvector_free(order);
+    cvector_free(chains);
+    cvector_free(edges);
+    free(ends);
+    free(block_ip);
+    free(weight);
+    free(chain_of);
+    free(prev);
+    free(next);
+    cfg_deinit(cfg);
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdint.h>
+
+#include "cvector.h"
+#include "parser.h"
+#include "profile.h"
+
+#define LAYOUT_CACHE_LINE 64
+
+/* what the profiled run cost as the code was laid out and as it would be laid out now.
+ * every taken jump is a dispatch away from the next instruction, every instruction is a
+ * dispatch, and the hot lines are the LAYOUT_CACHE_LINE byte lines of code it executed. */
+typedef struct LayoutStats_t {
+    uint64_t taken_before;
+    uint64_t taken_after;
+    uint64_t dispatches_before; /* instructions executed, jmps dropped or added change it */
+    uint64_t dispatches_after;
+    uint64_t lines_before;
+    uint64_t lines_after;
+    uint64_t hot_size; /* bytes of blocks the run executed, all at the front */
+    uint64_t cold_size;
+} LayoutStats;
+
+int layout_blocks(cvector_vector_type(ParsedInstruction)* parsed_instructions, uint64_t* start_rip, cvector_vector_type(Symbol) symbols, const Profile* profile, LayoutStats* stats);
+
+#endif /* LAYOUT_H */
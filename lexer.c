@@ -5,10 +5,13 @@
 #include <errno.h>
 
 #include "lexer.h"
+#include "scan.h"
 
-static const char* g_input;
-static size_t g_col;
-static size_t g_line;
+/* the state is per thread, so chunks of one source can be lexed side by side. */
+static _Thread_local const char* g_start;
+static _Thread_local const char* g_input;
+static _Thread_local const char* g_error;
+static _Thread_local const ScanOps* g_scan;
 
 static int is_eof() {
     return *g_input == 0;
@@ -18,26 +21,17 @@ static void advance() {
     if (is_eof())
         return;
 
-    if (*g_input == '\n') {
-        g_line++;
-        g_col = 1;
-    } else {
-        g_col++;
-    }
-
     g_input++;
 }
 
 static void skip_whitespaces() {
-    while (!is_eof() && isspace(*g_input))
-        advance();
+    if (isspace(*g_input))
+        g_input += g_scan->whitespace(g_input);
 }
 
 static void skip_comments() {
     if (*g_input == ';') {
-        while (!is_eof() && *g_input != '\n')
-            advance();
-
+        g_input += g_scan->comment(g_input);
         skip_whitespaces();
     }
 }
@@ -46,9 +40,10 @@ int lexer_init(const char* input) {
     if (!input)
         return 0;
 
+    g_start = input;
     g_input = input;
-    g_col = 1;
-    g_line = 1;
+    g_error = NULL;
+    g_scan = scan_ops();
 
     return 1;
 }
@@ -58,105 +53,190 @@ Token lexer_get_token() {
     skip_comments();
 
     const char* current = g_input;
-    size_t line = g_line;
-    size_t col = g_col;
+
+    if ((size_t)(current - g_start) >= UINT32_MAX) {
+        g_error = "the source is too large";
+        return token_init(TOK_ERROR, span_init(g_start, 0));
+    }
 
     if (is_eof())
-        return token_init(TOK_EOF, span_init_null(), line, col);
+        return token_init(TOK_EOF, span_init(current, 0));
 
     switch (*current) {
     case ',':
         advance();
-        return token_init(TOK_COMMA, span_from(","), line, col);
+        return token_init(TOK_COMMA, span_init(current, 1));
     default:
         break;
     }
 
     if (isalpha(*current)) {
-        size_t len = 0;
+        size_t len = 1 + g_scan->alphas(current + 1);
 
-        do {
-            len++;
-            advance();
-        } while (!is_eof() && isalpha(*g_input));
+        g_input += len;
 
         Span span = span_init(current, len);
 
         if (span_equals(span, span_from("halt"))) {
-            return token_init(TOK_HALT, span, line, col);
+            return token_init(TOK_HALT, span);
         } else if (span_equals(span, span_from("add"))) {
-            return token_init(TOK_ADD, span, line, col);
+            return token_init(TOK_ADD, span);
         } else if (span_equals(span, span_from("sub"))) {
-            return token_init(TOK_SUB, span, line, col);
+            return token_init(TOK_SUB, span);
         } else if (span_equals(span, span_from("mul"))) {
-            return token_init(TOK_MUL, span, line, col);
+            return token_init(TOK_MUL, span);
         } else if (span_equals(span, span_from("div"))) {
-            return token_init(TOK_DIV, span, line, col);
+            return token_init(TOK_DIV, span);
+        } else if (span_equals(span, span_from("sdiv"))) {
+            return token_init(TOK_SDIV, span);
+        } else if (span_equals(span, span_from("addo"))) {
+            return token_init(TOK_ADDO, span);
+        } else if (span_equals(span, span_from("subo"))) {
+            return token_init(TOK_SUBO, span);
+        } else if (span_equals(span, span_from("mulo"))) {
+            return token_init(TOK_MULO, span);
+        } else if (span_equals(span, span_from("wmul"))) {
+            return token_init(TOK_WMUL, span);
         } else if (span_equals(span, span_from("push"))) {
-            return token_init(TOK_PUSH, span, line, col);
+            return token_init(TOK_PUSH, span);
         } else if (span_equals(span, span_from("pop"))) {
-            return token_init(TOK_POP, span, line, col);
+            return token_init(TOK_POP, span);
         } else if (span_equals(span, span_from("move"))) {
-            return token_init(TOK_MOVE, span, line, col);
+            return token_init(TOK_MOVE, span);
         } else if (span_equals(span, span_from("cmp"))) {
-            return token_init(TOK_CMP, span, line, col);
+            return token_init(TOK_CMP, span);
+        } else if (span_equals(span, span_from("scmp"))) {
+            return token_init(TOK_SCMP, span);
         } else if (span_equals(span, span_from("jmp"))) {
-            return token_init(TOK_JMP, span, line, col);
+            return token_init(TOK_JMP, span);
         } else if (span_equals(span, span_from("je"))) {
-            return token_init(TOK_JE, span, line, col);
+            return token_init(TOK_JE, span);
         } else if (span_equals(span, span_from("jne"))) {
-            return token_init(TOK_JNE, span, line, col);
+            return token_init(TOK_JNE, span);
         } else if (span_equals(span, span_from("jg"))) {
-            return token_init(TOK_JG, span, line, col);
+            return token_init(TOK_JG, span);
         } else if (span_equals(span, span_from("jl"))) {
-            return token_init(TOK_JL, span, line, col);
+            return token_init(TOK_JL, span);
         } else if (span_equals(span, span_from("jge"))) {
-            return token_init(TOK_JGE, span, line, col);
+            return token_init(TOK_JGE, span);
         } else if (span_equals(span, span_from("jle"))) {
-            return token_init(TOK_JLE, span, line, col);
-        } else if (span_equals(span, span_from("RA"))) {
-            return token_init(TOK_REG_A, span, line, col);
-        } else if (span_equals(span, span_from("RB"))) {
-            return token_init(TOK_REG_B, span, line, col);
-        } else if (span_equals(span, span_from("RC"))) {
-            return token_init(TOK_REG_C, span, line, col);
-        } else if (span_equals(span, span_from("RD"))) {
-            return token_init(TOK_REG_D, span, line, col);
+            return token_init(TOK_JLE, span);
+        } else if (span_equals(span, span_from("jo"))) {
+            return token_init(TOK_JO, span);
+        } else if (span_equals(span, span_from("jc"))) {
+            return token_init(TOK_JC, span);
+        } else if (span_equals(span, span_from("call"))) {
+            return token_init(TOK_CALL, span);
+        } else if (span_equals(span, span_from("callnative"))) {
+            return token_init(TOK_CALLNATIVE, span);
+        } else if (span_equals(span, span_from("ret"))) {
+            return token_init(TOK_RET, span);
+        } else if (span_equals(span, span_from("loadb"))) {
+            return token_init(TOK_LOADB, span);
+        } else if (span_equals(span, span_from("loadw"))) {
+            return token_init(TOK_LOADW, span);
+        } else if (span_equals(span, span_from("loadd"))) {
+            return token_init(TOK_LOADD, span);
+        } else if (span_equals(span, span_from("loadq"))) {
+            return token_init(TOK_LOADQ, span);
+        } else if (span_equals(span, span_from("storeb"))) {
+            return token_init(TOK_STOREB, span);
+        } else if (span_equals(span, span_from("storew"))) {
+            return token_init(TOK_STOREW, span);
+        } else if (span_equals(span, span_from("stored"))) {
+            return token_init(TOK_STORED, span);
+        } else if (span_equals(span, span_from("storeq"))) {
+            return token_init(TOK_STOREQ, span);
+        } else if (span_equals(span, span_from("memcpy"))) {
+            return token_init(TOK_MEMCPY, span);
+        } else if (span_equals(span, span_from("memset"))) {
+            return token_init(TOK_MEMSET, span);
+        } else if (span_equals(span, span_from("vadd"))) {
+            return token_init(TOK_VADD, span);
+        } else if (span_equals(span, span_from("vsub"))) {
+            return token_init(TOK_VSUB, span);
+        } else if (span_equals(span, span_from("vmul"))) {
+            return token_init(TOK_VMUL, span);
+        } else if (span_equals(span, span_from("vsum"))) {
+            return token_init(TOK_VSUM, span);
+        } else if (span_equals(span, span_from("vsplat"))) {
+            return token_init(TOK_VSPLAT, span);
+        } else if (span_equals(span, span_from("vload"))) {
+            return token_init(TOK_VLOAD, span);
+        } else if (span_equals(span, span_from("vstore"))) {
+            return token_init(TOK_VSTORE, span);
+        } else if (span.len == 2 && span.data[0] == 'R' && span.data[1] >= 'A' && span.data[1] <= 'P') {
+            /* RA through RP, laid out in order after TOK_REG_A. */
+            return token_init(TOK_REG_A + (span.data[1] - 'A'), span);
+        } else if (span_equals(span, span_from("VA"))) {
+            return token_init(TOK_VREG_A, span);
+        } else if (span_equals(span, span_from("VB"))) {
+            return token_init(TOK_VREG_B, span);
+        } else if (span_equals(span, span_from("VC"))) {
+            return token_init(TOK_VREG_C, span);
+        } else if (span_equals(span, span_from("VD"))) {
+            return token_init(TOK_VREG_D, span);
         } else {
             if (*g_input == ':') {
                 advance();
-                return token_init(TOK_LABLE, span, line, col);
+                return token_init(TOK_LABLE, span);
             }
 
-            return token_init(TOK_IDENTIFIER, span, line, col);
+            return token_init(TOK_IDENTIFIER, span);
         }
     }
 
-    if (isdigit(*current)) {
-        size_t len = 0;
+    /* a leading minus assembles to the two's complement of the number. */
+    int negative = *current == '-' && isdigit(current[1]);
+
+    if (isdigit(*current) || negative) {
+        size_t len = 1 + g_scan->digits(current + 1);
 
-        do {
-            len++;
-            advance();
-        } while (!is_eof() && isdigit(*g_input));
+        g_input += len;
 
         Span span = span_init(current, len);
 
-        strtoull(current, NULL, 10);
+        errno = 0;
 
-        if (errno == ERANGE) {
-            fprintf(stderr, "(%zu:%zu) ERROR: ", line, col);
-            span_print(stderr, span);
-            fprintf(stderr, ", immediate too large\n");
+        if (negative)
+            strtoll(current, NULL, 10);
+        else
+            strtoull(current, NULL, 10);
 
-            exit(1);
+        if (errno == ERANGE) {
+            g_error = "immediate too large";
+            return token_init(TOK_ERROR, span);
         }
 
-        return token_init(TOK_IMMEDIATE, span, line, col);
+        return token_init(TOK_IMMEDIATE, span);
     }
 
-    fprintf(stderr, "(%zu:%zu) ERROR: illegal token: %c\n", g_line, g_col, *g_input);
-    exit(1);
+    g_error = "illegal token";
+    return token_init(TOK_ERROR, span_init(g_input, 1));
+}
+
+/* why the last TOK_ERROR was returned. */
+const char* lexer_error() {
+    return g_error;
+}
+
+/* the text of a token from the input the lexer is on. */
+Span token_span(Token token) {
+    return span_init(g_start + token.offset, token.len);
+}
+
+void token_position(Token token, size_t* line, size_t* col) {
+    lexer_position(g_start, token.offset, line, col);
+}
+
+/* the line and column of offset in input, counted the way an editor does with a tab as
+ * one column. */
+void lexer_position(const char* input, size_t offset, size_t* line, size_t* col) {
+    size_t last = 0;
+    size_t newlines = scan_ops()->newlines(input, offset, &last);
+
+    *line = 1 + newlines;
+    *col = newlines > 0 ? offset - last : offset + 1;
 }
 
 Span span_init(const char* data, size_t len) {
@@ -202,11 +282,11 @@ void span_print(FILE* file, Span span) {
         fprintf(file, "%c", span.data[i]);
 }
 
-Token token_init(TokenKind kind, Span span, size_t line, size_t col) {
+/* span has to point into the input the lexer is on. */
+Token token_init(TokenKind kind, Span span) {
     return (Token) {
         .kind = kind,
-        .span = span,
-        .line = line,
-        .col = col,
+        .offset = (uint32_t)(span.data - g_start),
+        .len = (uint32_t)span.len,
     };
 }
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct Span_t {
     const char* data;
@@ -16,10 +17,16 @@ typedef enum TokenKind_t {
     TOK_SUB,
     TOK_MUL,
     TOK_DIV,
+    TOK_SDIV,
+    TOK_ADDO,
+    TOK_SUBO,
+    TOK_MULO,
+    TOK_WMUL,
     TOK_PUSH,
     TOK_POP,
     TOK_MOVE,
     TOK_CMP,
+    TOK_SCMP,
     TOK_JMP,
     TOK_JE,
     TOK_JNE,
@@ -27,25 +34,69 @@ typedef enum TokenKind_t {
     TOK_JL,
     TOK_JGE,
     TOK_JLE,
+    TOK_JO,
+    TOK_JC,
+    TOK_CALL,
+    TOK_CALLNATIVE,
+    TOK_RET,
+    TOK_LOADB,
+    TOK_LOADW,
+    TOK_LOADD,
+    TOK_LOADQ,
+    TOK_STOREB,
+    TOK_STOREW,
+    TOK_STORED,
+    TOK_STOREQ,
+    TOK_MEMCPY,
+    TOK_MEMSET,
+    TOK_VADD,
+    TOK_VSUB,
+    TOK_VMUL,
+    TOK_VSUM,
+    TOK_VSPLAT,
+    TOK_VLOAD,
+    TOK_VSTORE,
     TOK_REG_A,
     TOK_REG_B,
     TOK_REG_C,
     TOK_REG_D,
+    TOK_REG_E,
+    TOK_REG_F,
+    TOK_REG_G,
+    TOK_REG_H,
+    TOK_REG_I,
+    TOK_REG_J,
+    TOK_REG_K,
+    TOK_REG_L,
+    TOK_REG_M,
+    TOK_REG_N,
+    TOK_REG_O,
+    TOK_REG_P,
+    TOK_VREG_A,
+    TOK_VREG_B,
+    TOK_VREG_C,
+    TOK_VREG_D,
     TOK_COMMA,
     TOK_IMMEDIATE,
     TOK_LABLE,
     TOK_IDENTIFIER,
+    TOK_ERROR,
 } TokenKind;
 
+/* where in the input the lexer was started on, the line and column are only counted
+ * out when an error asks for them. inputs are limited to 4 GiB. */
 typedef struct Token_t {
     TokenKind kind;
-    Span span;
-    size_t line;
-    size_t col;
+    uint32_t offset;
+    uint32_t len;
 } Token;
 
 int lexer_init(const char* input);
 Token lexer_get_token();
+const char* lexer_error();
+Span token_span(Token token);
+void token_position(Token token, size_t* line, size_t* col);
+void lexer_position(const char* input, size_t offset, size_t* line, size_t* col);
 
 Span span_init(const char* data, size_t len);
 Span span_from(const char* data);
@@ -53,6 +104,6 @@ Span span_init_null();
 int span_equals(Span lhs, Span rhs);
 void span_print(FILE* file, Span span);
 
-Token token_init(TokenKind kind, Span span, size_t line, size_t col);
+Token token_init(TokenKind kind, Span span);
 
 #endif /* LEXER_H */
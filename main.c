@@ -1,44 +1,312 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-#include "cvector.h"
-#include "parser.h"
-#include "vm.h"
+#include "thorkell.h"
+#include "chunked.h"
+#include "stats.h"
+#include "replay.h"
 
-static cvector_vector_type(uint8_t) parsed_instructions_codegen(cvector_vector_type(ParsedInstruction) parsed_instructions) {
-    cvector_vector_type(uint8_t) instructions = NULL;
+static const char* g_default_program = "; this program is computing the factorial of 10\nfactorial: move RA, 1 move RB, 10 loop: mul RA, RB sub RB, 1 cmp RB, 0 jg loop halt start: jmp factorial";
 
-    for (uint64_t i = 0; i < cvector_size(parsed_instructions); i++) {
-        cvector_push_back(instructions, parsed_instructions[i].size);
-        cvector_push_back(instructions, parsed_instructions[i].instruction);
+static char* read_file(const char* path) {
+    FILE* file = fopen(path, "rb");
 
-        for (uint64_t j = 0; j < cvector_size(parsed_instructions[i].operands); j++)
-            cvector_push_back(instructions, parsed_instructions[i].operands[j]);
+    if (!file) {
+        fprintf(stderr, "ERROR: cannot open %s\n", path);
+        return NULL;
     }
 
-    return instructions;
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* source = malloc(len + 1);
+
+    if (fread(source, 1, len, file) != (size_t)len) {
+        fprintf(stderr, "ERROR: cannot read %s\n", path);
+        fclose(file);
+        free(source);
+        return NULL;
+    }
+
+    source[len] = 0;
+    fclose(file);
+
+    return source;
+}
+
+static void report(const ThorkellError* error) {
+    switch (error->status) {
+    case THORKELL_OK:
+        break;
+    case THORKELL_ERROR_SYNTAX:
+        fprintf(stderr, "(%zu:%zu) ERROR: %s\n", error->line, error->col, error->message);
+        break;
+    case THORKELL_ERROR_FAULT:
+    case THORKELL_ERROR_VERIFY:
+        fprintf(stderr, "ERROR: %s at rip %lu\n", error->message, error->rip);
+        break;
+    default:
+        fprintf(stderr, "ERROR: %s\n", error->message);
+        break;
+    }
 }
 
-int main(void) {
-    parser_init("; this program is computing the factorial of 10\nfactorial: move RA, 1 move RB, 10 loop: mul RA, RB sub RB, 1 cmp RB, 0 jg loop halt start: jmp factorial");
+/* callnative 0 prints RA, mostly useful for poking at programs from the command line. */
+static void native_print(VM* vm) {
+    printf("%lu\n", REG(0));
+}
+
+/* single steps the vm to count the instructions it executes, halt included. */
+static uint64_t execute_counted(VM* vm) {
+    uint64_t count = 0;
+
+    while (vm_run(vm, 0) == VM_RUNNING) {
+        vm_run(vm, 1);
+        count += 1;
+    }
+
+    return count;
+}
+
+/* runs the program once more without optimizations and compares the final states. */
+static int differential_check(const char* source, const VM* optimized, uint64_t optimized_count) {
+    ThorkellProgram program;
+    ThorkellError error;
+
+    if (thorkell_assemble(source, 0, &program, &error) != THORKELL_OK) {
+        report(&error);
+        return 0;
+    }
+
+    VM* vm = thorkell_load(&program, MEMORY_DEFAULT, &error);
+
+    if (!vm) {
+        report(&error);
+        thorkell_program_free(&program);
+        return 0;
+    }
 
-    uint64_t start_rip = 0;
-    cvector_vector_type(ParsedInstruction) parsed_instructions = parser_start(&start_rip);
+    uint64_t count = execute_counted(vm);
 
-    parser_deinit();
+    fprintf(stderr, "instructions executed: %lu -> %lu\n", count, optimized_count);
 
-    cvector_vector_type(uint8_t) instructions = parsed_instructions_codegen(parsed_instructions);
+    int same = memcmp(vm->registers, optimized->registers, sizeof(vm->registers)) == 0
+            && memcmp(vm->flags, optimized->flags, sizeof(vm->flags)) == 0
+            && vm->rsp == optimized->rsp
+            && memcmp(vm->stack, optimized->stack, vm->rsp) == 0
+            && vm->fault == optimized->fault;
 
-    VM* vm = vm_init(instructions, start_rip);
-    vm_execute(vm);
+    if (!same) {
+        fprintf(stderr, "ERROR: optimized program diverged\n");
 
-    for (uint8_t i = 0; i < REGISTER_MAX; i++)
-        printf("%lu\n", vm->registers[i]);
+        for (uint8_t i = 0; i < REGISTER_MAX; i++)
+            fprintf(stderr, "    R%c: %lu != %lu\n", 'A' + i, vm->registers[i], optimized->registers[i]);
+    }
 
     vm_deinit(vm);
+    thorkell_program_free(&program);
+
+    return same;
+}
+
+/* assembles with the layout of the profile at pgo when there is one, else on jobs
+ * threads when asked to. */
+static ThorkellStatus assemble(const char* source, int flags, const char* pgo, const char* jobs, ThorkellProgram* program, ThorkellError* error) {
+    if (!pgo && jobs)
+        return chunked_assemble(source, flags, strtoul(jobs, NULL, 10), program, error);
+
+    if (!pgo)
+        return thorkell_assemble(source, flags, program, error);
+
+    Profile* profile = profile_load(pgo);
+
+    if (!profile) {
+        snprintf(error->message, sizeof(error->message), "cannot read the profile %s", pgo);
+        error->status = THORKELL_ERROR_PROGRAM;
+        return THORKELL_ERROR_PROGRAM;
+    }
+
+    LayoutStats stats;
+    ThorkellStatus status = thorkell_assemble_profiled(source, flags, profile, program, &stats, error);
+
+    if (status == THORKELL_OK)
+        fprintf(stderr, "taken jumps: %lu -> %lu, dispatches: %lu -> %lu, hot cache lines: %lu -> %lu, hot bytes: %lu, cold bytes: %lu\n", stats.taken_before,
+                stats.taken_after, stats.dispatches_before, stats.dispatches_after, stats.lines_before, stats.lines_after, stats.hot_size, stats.cold_size);
+
+    profile_deinit(profile);
+
+    return status;
+}
+
+/* the vm of the recording at path after at instructions, for the program it was
+ * recorded on. */
+static VM* load_replay(const char* path, const ThorkellProgram* program, uint64_t at, Recording** recording, ThorkellError* error) {
+    VM* vm = NULL;
+
+    *recording = replay_load(path);
+    error->status = THORKELL_ERROR_PROGRAM;
+
+    if (!*recording)
+        snprintf(error->message, sizeof(error->message), "cannot read the recording %s", path);
+    else if (!replay_matches(*recording, program->code, cvector_size(program->code)))
+        snprintf(error->message, sizeof(error->message), "%s was recorded on another program", path);
+    else if (!(vm = replay_seek(*recording, program->code, at)))
+        snprintf(error->message, sizeof(error->message), "%s ends after %lu instructions", path, replay_length(*recording));
+
+    return vm;
+}
+
+/* runs vm to the end and saves the recording to path, returns the instructions it ran. */
+static uint64_t record(VM* vm, const ThorkellProgram* program, const char* path, int* status) {
+    Recording* recording = replay_init(program->code, cvector_size(program->code), vm->memory_size, 0);
+
+    if (!recording) {
+        fprintf(stderr, "ERROR: cannot allocate the recording\n");
+        *status = 1;
+        return 0;
+    }
+
+    replay_record(recording, vm);
+
+    if (!replay_save(recording, path)) {
+        fprintf(stderr, "ERROR: cannot write %s\n", path);
+        *status = 1;
+    }
+
+    uint64_t count = replay_length(recording);
+    replay_deinit(recording);
+
+    return count;
+}
+
+/* usage: thorkell [-O] [--diff] [--dump-cfg] [--emit-c name] [--embed name] [--profile out] [--pgo profile] [--jobs n] [--stats text|json]
+ *                 [--record out] [--replay recording [--at n]] [file]
+ * --profile runs the program instrumented and saves what it saw, --pgo lays the program
+ * out for such a profile, recorded with the same flags, before running it. --jobs parses
+ * large sources in chunks on n threads, 0 for one per cpu. --stats prints what the vm
+ * counted to stderr once it is done. --record saves what the run needs to be replayed,
+ * --replay runs the program from such a recording, made with the same flags, with the
+ * natives played back. --at stops the replay after n instructions, starting from the
+ * checkpoint before it, and prints the registers there. */
+int main(int argc, char** argv) {
+    int flags = 0;
+    int diff = 0;
+    int dump_cfg = 0;
+    const char* emit_c = NULL;
+    const char* embed = NULL;
+    const char* profile_out = NULL;
+    const char* pgo = NULL;
+    const char* jobs = NULL;
+    const char* stats = NULL;
+    const char* record_out = NULL;
+    const char* replay = NULL;
+    const char* at = NULL;
+    char* source = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-O") == 0) {
+            flags |= THORKELL_OPTIMIZE;
+        } else if (strcmp(argv[i], "--diff") == 0) {
+            flags |= THORKELL_OPTIMIZE;
+            diff = 1;
+        } else if (strcmp(argv[i], "--dump-cfg") == 0) {
+            dump_cfg = 1;
+        } else if (strcmp(argv[i], "--emit-c") == 0 && i + 1 < argc) {
+            emit_c = argv[++i];
+        } else if (strcmp(argv[i], "--embed") == 0 && i + 1 < argc) {
+            embed = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_out = argv[++i];
+        } else if (strcmp(argv[i], "--pgo") == 0 && i + 1 < argc) {
+            pgo = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            stats = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_out = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay = argv[++i];
+        } else if (strcmp(argv[i], "--at") == 0 && i + 1 < argc) {
+            at = argv[++i];
+        } else if (!(source = read_file(argv[i]))) {
+            return 1;
+        }
+    }
+
+    vm_register_native(0, "print", native_print);
+
+    const char* program_source = source ? source : g_default_program;
+    ThorkellProgram program;
+    ThorkellError error;
+    int status = 0;
+
+    if (embed) {
+        if (thorkell_embed(program_source, flags, embed, stdout, &error) != THORKELL_OK) {
+            report(&error);
+            status = 1;
+        }
+    } else if (emit_c) {
+        if (thorkell_emit_c(program_source, flags, emit_c, stdout, &error) != THORKELL_OK) {
+            report(&error);
+            status = 1;
+        }
+    } else if (dump_cfg) {
+        if (thorkell_dump_cfg(program_source, flags, stdout, &error) != THORKELL_OK) {
+            report(&error);
+            status = 1;
+        }
+    } else if (assemble(program_source, flags, pgo, jobs, &program, &error) != THORKELL_OK) {
+        report(&error);
+        status = 1;
+    } else {
+        Recording* recording = NULL;
+        VM* vm = replay ? load_replay(replay, &program, at ? strtoull(at, NULL, 10) : 0, &recording, &error) : thorkell_load(&program, MEMORY_DEFAULT, &error);
+        Profile* profile = vm && profile_out && !(replay && at) ? profile_init(program.code, cvector_size(program.code)) : NULL;
+        uint64_t count = vm && diff && !profile && !record_out ? execute_counted(vm) : 0;
+
+        if (profile) {
+            profile_run(vm, profile);
+
+            for (uint64_t ip = 0; ip < profile->size; ip++)
+                count += profile->executed[ip];
+
+            if (!profile_save(profile, profile_out)) {
+                fprintf(stderr, "ERROR: cannot write %s\n", profile_out);
+                status = 1;
+            }
+
+            profile_deinit(profile);
+        }
+
+        if (vm && record_out && !profile)
+            count = record(vm, &program, record_out, &status);
+
+        if (vm && replay && at) {
+            for (uint8_t i = 0; i < REGISTER_MAX; i++)
+                printf("%lu\n", vm->registers[i]);
+        } else if (vm && thorkell_execute(vm, &error) == THORKELL_OK) {
+            for (uint8_t i = 0; i < REGISTER_MAX; i++)
+                printf("%lu\n", vm->registers[i]);
+        } else {
+            report(&error);
+            status = 1;
+        }
+
+        if (vm && stats)
+            stats_dump_vm(stderr, vm, strcmp(stats, "json") == 0 ? STATS_JSON : STATS_TEXT);
+
+        if (vm && diff && !differential_check(program_source, vm, count))
+            status = 1;
+
+        vm_deinit(vm);
+        replay_deinit(recording);
+        thorkell_program_free(&program);
+    }
 
-    for (uint64_t i = 0; i < cvector_size(parsed_instructions); i++)
-        parsed_instruction_deinit(parsed_instructions[i]);
+    free(source);
 
-    cvector_free(instructions);
-    cvector_free(parsed_instructions);
+    return status;
 }
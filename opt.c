@@ -0,0 +1,1281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opt.h"
+#include "cfg.h"
+
+#define OPT_MAX_ROUNDS 8
+#define REGISTER_BIT(x) ((uint64_t)1 << (x))
+#define FLAGS_BIT REGISTER_BIT(REGISTER_MAX)
+#define ALL_LIVE ((FLAGS_BIT << 1) - 1)
+
+typedef enum ValueKind_t {
+    VALUE_UNDEF,
+    VALUE_CONST,
+    VALUE_VARYING,
+} ValueKind;
+
+typedef struct Value_t {
+    ValueKind kind;
+    uint64_t value;
+} Value;
+
+/* what is known about the registers and the flags at one program point. flags packs
+ * the six compare flags, the overflow and carry flags are never tracked. */
+typedef struct State_t {
+    Value registers[REGISTER_MAX];
+    Value flags;
+} State;
+
+static Value value_const(uint64_t value) {
+    return (Value) {
+        .kind = VALUE_CONST,
+        .value = value,
+    };
+}
+
+static Value value_varying() {
+    return (Value) {
+        .kind = VALUE_VARYING,
+        .value = 0,
+    };
+}
+
+static Value value_meet(Value lhs, Value rhs) {
+    if (lhs.kind == VALUE_UNDEF)
+        return rhs;
+
+    if (rhs.kind == VALUE_UNDEF)
+        return lhs;
+
+    if (lhs.kind == VALUE_CONST && rhs.kind == VALUE_CONST && lhs.value == rhs.value)
+        return lhs;
+
+    return value_varying();
+}
+
+static int state_meet(State* into, const State* from) {
+    int changed = 0;
+
+    for (uint8_t i = 0; i < REGISTER_MAX; i++) {
+        Value value = value_meet(into->registers[i], from->registers[i]);
+
+        changed |= value.kind != into->registers[i].kind;
+        into->registers[i] = value;
+    }
+
+    Value flags = value_meet(into->flags, from->flags);
+
+    changed |= flags.kind != into->flags.kind;
+    into->flags = flags;
+
+    return changed;
+}
+
+static uint64_t operand_immediate(const ParsedInstruction* parsed_instruction, uint8_t offset) {
+    uint64_t immediate = 0;
+    uint8_t* bytes = (uint8_t*)&immediate;
+
+    for (uint8_t i = offset; i < parsed_instruction->operand_count; i++)
+        bytes[i - offset] = parsed_instruction->operands[i];
+
+    return immediate;
+}
+
+static int is_immediate_arithmetic(Instruction instruction) {
+    return instruction >= INS_IADD && instruction <= INS_IDIV;
+}
+
+static int is_register_arithmetic(Instruction instruction) {
+    return instruction >= INS_ADD && instruction <= INS_DIV;
+}
+
+/* maps both the immediate and the register form to the same operator. */
+static int fold(Instruction instruction, uint64_t lhs, uint64_t rhs, uint64_t* result) {
+    switch (instruction) {
+    case INS_IADD:
+    case INS_ADD:
+        *result = lhs + rhs;
+        return 1;
+    case INS_ISUB:
+    case INS_SUB:
+        *result = lhs - rhs;
+        return 1;
+    case INS_IMUL:
+    case INS_MUL:
+        *result = lhs * rhs;
+        return 1;
+    case INS_IDIV:
+    case INS_DIV:
+        if (rhs == 0)
+            return 0;
+
+        *result = lhs / rhs;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* packs the flags in the same order as vm->flags. */
+static uint64_t compare_flags(uint64_t lhs, uint64_t rhs) {
+    return (uint64_t)(lhs == rhs) << 0
+         | (uint64_t)(lhs != rhs) << 1
+         | (uint64_t)(lhs >  rhs) << 2
+         | (uint64_t)(lhs <  rhs) << 3
+         | (uint64_t)(lhs >= rhs) << 4
+         | (uint64_t)(lhs <= rhs) << 5;
+}
+
+static uint64_t signed_compare_flags(int64_t lhs, int64_t rhs) {
+    return (uint64_t)(lhs == rhs) << 0
+         | (uint64_t)(lhs != rhs) << 1
+         | (uint64_t)(lhs >  rhs) << 2
+         | (uint64_t)(lhs <  rhs) << 3
+         | (uint64_t)(lhs >= rhs) << 4
+         | (uint64_t)(lhs <= rhs) << 5;
+}
+
+/* the jumps that only read the compare flags, jo and jc depend on flags that are not tracked. */
+static int is_compare_jump(Instruction instruction) {
+    return instruction >= INS_JE && instruction <= INS_JLE;
+}
+
+static int jump_taken(Instruction instruction, uint64_t flags) {
+    switch (instruction) {
+    case INS_JE:
+        return (flags >> 0) & 1;
+    case INS_JNE:
+        return (flags >> 1) & 1;
+    case INS_JG:
+        return (flags >> 2) & 1;
+    case INS_JL:
+        return (flags >> 3) & 1;
+    case INS_JGE:
+        return (flags >> 4) & 1;
+    case INS_JLE:
+        return (flags >> 5) & 1;
+    default:
+        return 1;
+    }
+}
+
+/* the value an arithmetic instruction leaves in its destination. */
+static Value arithmetic_result(const State* state, const ParsedInstruction* parsed_instruction) {
+    uint8_t dst = parsed_instruction->operands[0];
+    Value acc = state->registers[dst];
+
+    if (is_immediate_arithmetic(parsed_instruction->instruction)) {
+        uint64_t result = 0;
+
+        if (acc.kind == VALUE_CONST && fold(parsed_instruction->instruction, acc.value, operand_immediate(parsed_instruction, 1), &result))
+            return value_const(result);
+
+        return value_varying();
+    }
+
+    for (uint8_t i = 1; i < parsed_instruction->operand_count; i++) {
+        uint8_t src = parsed_instruction->operands[i];
+        Value rhs = src == dst ? acc : state->registers[src];
+        uint64_t result = 0;
+
+        if (acc.kind != VALUE_CONST || rhs.kind != VALUE_CONST || !fold(parsed_instruction->instruction, acc.value, rhs.value, &result))
+            return value_varying();
+
+        acc = value_const(result);
+    }
+
+    return acc;
+}
+
+static void transfer(State* state, const ParsedInstruction* parsed_instruction) {
+    const uint8_t* operands = parsed_instruction->operands;
+
+    switch (parsed_instruction->instruction) {
+    case INS_IADD:
+    case INS_ISUB:
+    case INS_IMUL:
+    case INS_IDIV:
+    case INS_ADD:
+    case INS_SUB:
+    case INS_MUL:
+    case INS_DIV:
+        state->registers[operands[0]] = arithmetic_result(state, parsed_instruction);
+        break;
+
+    case INS_IMOVE:
+        state->registers[operands[0]] = value_const(operand_immediate(parsed_instruction, 1));
+        break;
+
+    case INS_MOVE:
+        state->registers[operands[0]] = state->registers[operands[1]];
+        break;
+
+    case INS_POP:
+        state->registers[operands[0]] = value_varying();
+        break;
+
+    case INS_ICMP: {
+        Value lhs = state->registers[operands[0]];
+
+        if (lhs.kind == VALUE_CONST)
+            state->flags = value_const(compare_flags(lhs.value, operand_immediate(parsed_instruction, 1)));
+        else
+            state->flags = value_varying();
+
+        break;
+    }
+
+    case INS_CMP: {
+        Value lhs = state->registers[operands[0]];
+        Value rhs = state->registers[operands[1]];
+
+        if (lhs.kind == VALUE_CONST && rhs.kind == VALUE_CONST)
+            state->flags = value_const(compare_flags(lhs.value, rhs.value));
+        else
+            state->flags = value_varying();
+
+        break;
+    }
+
+    case INS_ISCMP: {
+        Value lhs = state->registers[operands[0]];
+
+        if (lhs.kind == VALUE_CONST)
+            state->flags = value_const(signed_compare_flags(lhs.value, operand_immediate(parsed_instruction, 1)));
+        else
+            state->flags = value_varying();
+
+        break;
+    }
+
+    case INS_SCMP: {
+        Value lhs = state->registers[operands[0]];
+        Value rhs = state->registers[operands[1]];
+
+        if (lhs.kind == VALUE_CONST && rhs.kind == VALUE_CONST)
+            state->flags = value_const(signed_compare_flags(lhs.value, rhs.value));
+        else
+            state->flags = value_varying();
+
+        break;
+    }
+
+    /* these only write the overflow and carry flags, which the packed flags leave out. */
+    case INS_SDIV:
+    case INS_ISDIV:
+    case INS_ADDO:
+    case INS_SUBO:
+    case INS_MULO:
+        state->registers[operands[0]] = value_varying();
+        break;
+
+    case INS_WMUL:
+        state->registers[operands[0]] = value_varying();
+        state->registers[operands[1]] = value_varying();
+        break;
+
+    case INS_LOADB:
+    case INS_LOADW:
+    case INS_LOADD:
+    case INS_LOADQ:
+        state->registers[operands[0]] = value_varying();
+        break;
+
+    case INS_STOREB:
+    case INS_STOREW:
+    case INS_STORED:
+    case INS_STOREQ:
+    case INS_MEMCPY:
+    case INS_MEMSET:
+    case INS_VADD:
+    case INS_VSUB:
+    case INS_VMUL:
+    case INS_VSPLAT:
+    case INS_VLOAD:
+    case INS_VSTORE:
+        break;
+
+    case INS_VSUM:
+        state->registers[operands[0]] = value_varying();
+        break;
+
+    case INS_LOOP: {
+        Value counter = state->registers[operands[0]];
+
+        if (counter.kind == VALUE_CONST) {
+            state->registers[operands[0]] = value_const(counter.value - 1);
+            state->flags = value_const(compare_flags(counter.value - 1, 0));
+        } else {
+            state->registers[operands[0]] = value_varying();
+            state->flags = value_varying();
+        }
+
+        break;
+    }
+
+    case INS_HALT:
+    case INS_IPUSH:
+    case INS_PUSH:
+    case INS_JMP:
+    case INS_JE:
+    case INS_JNE:
+    case INS_JG:
+    case INS_JL:
+    case INS_JGE:
+    case INS_JLE:
+    case INS_JO:
+    case INS_JC:
+        break;
+
+    default:
+        for (uint8_t i = 0; i < REGISTER_MAX; i++)
+            state->registers[i] = value_varying();
+
+        state->flags = value_varying();
+        break;
+    }
+}
+
+/* whether an instruction can fault. the host sees every register and flag at a fault,
+ * so such an instruction reads them all and no store before it is dead. */
+static int may_fault(const ParsedInstruction* parsed_instruction) {
+    switch (parsed_instruction->instruction) {
+    case INS_IDIV:
+        return operand_immediate(parsed_instruction, 1) == 0;
+
+    case INS_ISDIV: {
+        uint64_t divisor = operand_immediate(parsed_instruction, 1);
+        return divisor == 0 || divisor == UINT64_MAX;
+    }
+
+    case INS_DIV:
+    case INS_SDIV:
+    case INS_IPUSH:
+    case INS_PUSH:
+    case INS_POP:
+    case INS_CALL:
+    case INS_RET:
+    case INS_LOADB:
+    case INS_LOADW:
+    case INS_LOADD:
+    case INS_LOADQ:
+    case INS_STOREB:
+    case INS_STOREW:
+    case INS_STORED:
+    case INS_STOREQ:
+    case INS_MEMCPY:
+    case INS_MEMSET:
+    case INS_VLOAD:
+    case INS_VSTORE:
+    case INS_CALLNATIVE:
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+/* registers and flags read and written by an instruction, pure ones can be dropped when their result is dead. */
+static void instruction_effects(const ParsedInstruction* parsed_instruction, uint64_t* uses, uint64_t* defs, int* pure) {
+    const uint8_t* operands = parsed_instruction->operands;
+    size_t len = parsed_instruction->operand_count;
+
+    *uses = 0;
+    *defs = 0;
+    *pure = 0;
+
+    switch (parsed_instruction->instruction) {
+    case INS_IDIV:
+        *pure = operand_immediate(parsed_instruction, 1) != 0;
+        *uses = REGISTER_BIT(operands[0]);
+        *defs = REGISTER_BIT(operands[0]);
+        break;
+
+    case INS_IADD:
+    case INS_ISUB:
+    case INS_IMUL:
+        *pure = 1;
+        *uses = REGISTER_BIT(operands[0]);
+        *defs = REGISTER_BIT(operands[0]);
+        break;
+
+    case INS_ADD:
+    case INS_SUB:
+    case INS_MUL:
+    case INS_DIV:
+        *pure = parsed_instruction->instruction != INS_DIV;
+
+        for (size_t i = 0; i < len; i++)
+            *uses |= REGISTER_BIT(operands[i]);
+
+        *defs = REGISTER_BIT(operands[0]);
+        break;
+
+    case INS_IMOVE:
+        *pure = 1;
+        *defs = REGISTER_BIT(operands[0]);
+        break;
+
+    case INS_MOVE:
+        *pure = 1;
+        *uses = REGISTER_BIT(operands[1]);
+        *defs = REGISTER_BIT(operands[0]);
+        break;
+
+    case INS_PUSH:
+        for (size_t i = 0; i < len; i++)
+            *uses |= REGISTER_BIT(operands[i]);
+
+        break;
+
+    case INS_POP:
+        *defs = REGISTER_BIT(operands[0]);
+        break;
+
+    case INS_ICMP:
+        *pure = 1;
+        *uses = REGISTER_BIT(operands[0]);
+        *defs = FLAGS_BIT;
+        break;
+
+    case INS_CMP:
+    case INS_SCMP:
+        *pure = 1;
+        *uses = REGISTER_BIT(operands[0]) | REGISTER_BIT(operands[1]);
+        *defs = FLAGS_BIT;
+        break;
+
+    case INS_ISCMP:
+        *pure = 1;
+        *uses = REGISTER_BIT(operands[0]);
+        *defs = FLAGS_BIT;
+        break;
+
+    /* division faults on a zero divisor and on INT64_MIN / -1. */
+    case INS_ISDIV: {
+        uint64_t divisor = operand_immediate(parsed_instruction, 1);
+
+        *pure = divisor != 0 && divisor != UINT64_MAX;
+        *uses = REGISTER_BIT(operands[0]);
+        *defs = REGISTER_BIT(operands[0]);
+        break;
+    }
+
+    case INS_SDIV:
+        for (size_t i = 0; i < len; i++)
+            *uses |= REGISTER_BIT(operands[i]);
+
+        *defs = REGISTER_BIT(operands[0]);
+        break;
+
+    /* the compare flags pass through untouched, so they stay live across these. */
+    case INS_ADDO:
+    case INS_SUBO:
+    case INS_MULO:
+        *uses = REGISTER_BIT(operands[0]) | REGISTER_BIT(operands[1]) | FLAGS_BIT;
+        *defs = REGISTER_BIT(operands[0]) | FLAGS_BIT;
+        break;
+
+    case INS_WMUL:
+        *pure = 1;
+        *uses = REGISTER_BIT(operands[1]) | REGISTER_BIT(operands[2]);
+        *defs = REGISTER_BIT(operands[0]) | REGISTER_BIT(operands[1]);
+        break;
+
+    case INS_JE:
+    case INS_JNE:
+    case INS_JG:
+    case INS_JL:
+    case INS_JGE:
+    case INS_JLE:
+    case INS_JO:
+    case INS_JC:
+        *uses = FLAGS_BIT;
+        break;
+
+    case INS_LOOP:
+        *uses = REGISTER_BIT(operands[0]);
+        *defs = REGISTER_BIT(operands[0]) | FLAGS_BIT;
+        break;
+
+    /* memory accesses may fault, so none of them is pure. */
+    case INS_LOADB:
+    case INS_LOADW:
+    case INS_LOADD:
+    case INS_LOADQ:
+        *uses = REGISTER_BIT(operands[1]);
+        *defs = REGISTER_BIT(operands[0]);
+        break;
+
+    case INS_STOREB:
+    case INS_STOREW:
+    case INS_STORED:
+    case INS_STOREQ:
+        *uses = REGISTER_BIT(operands[0]) | REGISTER_BIT(operands[1]);
+        break;
+
+    case INS_MEMCPY:
+    case INS_MEMSET:
+        *uses = REGISTER_BIT(operands[0]) | REGISTER_BIT(operands[1]) | REGISTER_BIT(operands[2]);
+        break;
+
+    /* vector registers are not tracked, so anything writing them has to stay. */
+    case INS_VADD:
+    case INS_VSUB:
+    case INS_VMUL:
+        break;
+
+    case INS_VSUM:
+        *pure = 1;
+        *defs = REGISTER_BIT(operands[0]);
+        break;
+
+    case INS_VSPLAT:
+        *uses = REGISTER_BIT(operands[1]);
+        break;
+
+    case INS_VLOAD:
+    case INS_VSTORE:
+        *uses = REGISTER_BIT(operands[1]);
+        break;
+
+    case INS_IPUSH:
+    case INS_JMP:
+        break;
+
+    /* the host reads every register and flag once the vm halts. */
+    case INS_HALT:
+        *uses = ALL_LIVE;
+        break;
+
+    /* a native may read and write any register, the flags and the stack. */
+    case INS_CALLNATIVE:
+    default:
+        *uses = ALL_LIVE;
+        *defs = ALL_LIVE;
+        break;
+    }
+
+    if (may_fault(parsed_instruction))
+        *uses = ALL_LIVE;
+}
+
+static void rewrite_immediate(ParsedInstruction* parsed_instruction, Instruction instruction, uint64_t value) {
+    uint8_t operands[1 + sizeof(uint64_t)];
+
+    operands[0] = parsed_instruction->operands[0];
+    memcpy(&operands[1], &value, sizeof(uint64_t));
+
+    *parsed_instruction = parsed_instruction_init(instruction, operands, sizeof(operands), 3 + sizeof(uint64_t));
+}
+
+/* forward dataflow over the reachable blocks, returns the state at every block entry. */
+static State* solve_constants(cvector_vector_type(ParsedInstruction) parsed_instructions, const CFG* cfg) {
+    size_t count = cvector_size(cfg->blocks);
+    State* in = calloc(count, sizeof(State));
+    uint8_t* queued = calloc(count, 1);
+    cvector_vector_type(size_t) worklist = NULL;
+
+    for (size_t block = 0; block < count; block++) {
+        if (!cfg->blocks[block].root)
+            continue;
+
+        for (uint8_t i = 0; i < REGISTER_MAX; i++)
+            in[block].registers[i] = value_varying();
+
+        in[block].flags = value_varying();
+
+        cvector_push_back(worklist, block);
+        queued[block] = 1;
+    }
+
+    while (cvector_size(worklist) != 0) {
+        size_t block = worklist[cvector_size(worklist) - 1];
+        cvector_pop_back(worklist);
+        queued[block] = 0;
+
+        State state = in[block];
+
+        for (size_t i = cfg->blocks[block].first; i < cfg->blocks[block].end; i++)
+            transfer(&state, &parsed_instructions[i]);
+
+        for (size_t i = 0; i < cvector_size(cfg->blocks[block].succs); i++) {
+            size_t succ = cfg->blocks[block].succs[i];
+
+            if (state_meet(&in[succ], &state) && !queued[succ]) {
+                queued[succ] = 1;
+                cvector_push_back(worklist, succ);
+            }
+        }
+    }
+
+    cvector_free(worklist);
+    free(queued);
+
+    return in;
+}
+
+/* folds what the dataflow proved constant. */
+static int propagate_constants(cvector_vector_type(ParsedInstruction) parsed_instructions, const CFG* cfg, uint8_t* removed) {
+    size_t count = cvector_size(cfg->blocks);
+    State* in = solve_constants(parsed_instructions, cfg);
+    int changed = 0;
+
+    for (size_t block = 0; block < count; block++) {
+        if (!cfg->blocks[block].reachable)
+            continue;
+
+        State state = in[block];
+
+        for (size_t i = cfg->blocks[block].first; i < cfg->blocks[block].end; i++) {
+            ParsedInstruction* parsed_instruction = &parsed_instructions[i];
+            Instruction instruction = parsed_instruction->instruction;
+
+            if (is_immediate_arithmetic(instruction) || is_register_arithmetic(instruction)) {
+                Value result = arithmetic_result(&state, parsed_instruction);
+
+                if (result.kind == VALUE_CONST) {
+                    rewrite_immediate(parsed_instruction, INS_IMOVE, result.value);
+                    changed = 1;
+                }
+            } else if (is_compare_jump(instruction) && state.flags.kind == VALUE_CONST) {
+                if (jump_taken(instruction, state.flags.value))
+                    parsed_instruction->instruction = INS_JMP;
+                else
+                    removed[i] = 1;
+
+                changed = 1;
+            }
+
+            transfer(&state, parsed_instruction);
+        }
+    }
+
+    free(in);
+
+    return changed;
+}
+
+static uint64_t block_live_in(cvector_vector_type(ParsedInstruction) parsed_instructions, const BasicBlock* block, const uint8_t* removed, uint64_t live) {
+    for (size_t i = block->end; i-- > block->first;) {
+        if (removed[i])
+            continue;
+
+        uint64_t uses = 0;
+        uint64_t defs = 0;
+        int pure = 0;
+
+        instruction_effects(&parsed_instructions[i], &uses, &defs, &pure);
+        live = (live & ~defs) | uses;
+    }
+
+    return live;
+}
+
+/* backward dataflow of the registers and flags still read later, per block exit.
+ * blocks without successors fall off the code and keep everything live. */
+static uint64_t* compute_liveness(cvector_vector_type(ParsedInstruction) parsed_instructions, const CFG* cfg, const uint8_t* removed) {
+    size_t count = cvector_size(cfg->blocks);
+    uint64_t* live_in = calloc(count, sizeof(uint64_t));
+    uint64_t* live_out = calloc(count, sizeof(uint64_t));
+    uint8_t* queued = calloc(count, 1);
+    cvector_vector_type(size_t) worklist = NULL;
+
+    for (size_t block = 0; block < count; block++) {
+        if (cvector_size(cfg->blocks[block].succs) == 0)
+            live_out[block] = ALL_LIVE;
+
+        cvector_push_back(worklist, block);
+        queued[block] = 1;
+    }
+
+    while (cvector_size(worklist) != 0) {
+        size_t block = worklist[cvector_size(worklist) - 1];
+        cvector_pop_back(worklist);
+        queued[block] = 0;
+
+        const BasicBlock* bb = &cfg->blocks[block];
+
+        for (size_t i = 0; i < cvector_size(bb->succs); i++)
+            live_out[block] |= live_in[bb->succs[i]];
+
+        uint64_t live = block_live_in(parsed_instructions, bb, removed, live_out[block]);
+
+        if (live == live_in[block])
+            continue;
+
+        live_in[block] = live;
+
+        for (size_t i = 0; i < cvector_size(bb->preds); i++) {
+            size_t pred = bb->preds[i];
+
+            if (!queued[pred]) {
+                queued[pred] = 1;
+                cvector_push_back(worklist, pred);
+            }
+        }
+    }
+
+    cvector_free(worklist);
+    free(queued);
+    free(live_in);
+
+    return live_out;
+}
+
+/* drops pure instructions, moves and compares included, whose result is never read. */
+static int eliminate_dead_stores(cvector_vector_type(ParsedInstruction) parsed_instructions, const CFG* cfg, uint8_t* removed) {
+    uint64_t* live_out = compute_liveness(parsed_instructions, cfg, removed);
+    int changed = 0;
+
+    for (size_t block = 0; block < cvector_size(cfg->blocks); block++) {
+        uint64_t live = live_out[block];
+
+        for (size_t i = cfg->blocks[block].end; i-- > cfg->blocks[block].first;) {
+            if (removed[i])
+                continue;
+
+            uint64_t uses = 0;
+            uint64_t defs = 0;
+            int pure = 0;
+
+            instruction_effects(&parsed_instructions[i], &uses, &defs, &pure);
+
+            if (pure && defs != 0 && (defs & live) == 0) {
+                removed[i] = 1;
+                changed = 1;
+                continue;
+            }
+
+            live = (live & ~defs) | uses;
+        }
+    }
+
+    free(live_out);
+
+    return changed;
+}
+
+/* forgets every copy that involves a register about to be overwritten. */
+static void kill_copies(uint8_t* copy_of, uint64_t defs) {
+    for (uint8_t i = 0; i < REGISTER_MAX; i++) {
+        if ((defs & REGISTER_BIT(i)) || (defs & REGISTER_BIT(copy_of[i])))
+            copy_of[i] = i;
+    }
+}
+
+/* walks one block with the copies known at its entry, rewriting reads of a copy into
+ * reads of the original when asked to. returns whether anything was rewritten. */
+static int copy_block(cvector_vector_type(ParsedInstruction) parsed_instructions, const BasicBlock* block, uint8_t* removed, uint8_t* copy_of, int rewrite) {
+    int changed = 0;
+
+    for (size_t i = block->first; i < block->end; i++) {
+        if (removed[i])
+            continue;
+
+        ParsedInstruction* parsed_instruction = &parsed_instructions[i];
+        uint8_t* operands = parsed_instruction->operands;
+        size_t len = parsed_instruction->operand_count;
+        size_t first_use = len;
+
+        switch (parsed_instruction->instruction) {
+        case INS_ADD:
+        case INS_SUB:
+        case INS_MUL:
+        case INS_DIV:
+        case INS_MOVE:
+            first_use = 1;
+            break;
+        case INS_PUSH:
+        case INS_CMP:
+        case INS_SCMP:
+            first_use = 0;
+            break;
+        case INS_ICMP:
+        case INS_ISCMP:
+            first_use = 0;
+            len = 1;
+            break;
+        case INS_LOADB:
+        case INS_LOADW:
+        case INS_LOADD:
+        case INS_LOADQ:
+            first_use = 1;
+            len = 2;
+            break;
+        case INS_STOREB:
+        case INS_STOREW:
+        case INS_STORED:
+        case INS_STOREQ:
+            first_use = 0;
+            len = 2;
+            break;
+        case INS_MEMCPY:
+        case INS_MEMSET:
+            first_use = 0;
+            break;
+        case INS_VSPLAT:
+        case INS_VLOAD:
+        case INS_VSTORE:
+            first_use = 1;
+            len = 2;
+            break;
+        default:
+            break;
+        }
+
+        for (size_t j = first_use; rewrite && j < len; j++) {
+            uint8_t original = copy_of[operands[j]];
+
+            /* reads of the destination register mid instruction see it already updated. */
+            if (is_register_arithmetic(parsed_instruction->instruction) && (operands[j] == operands[0] || original == operands[0]))
+                continue;
+
+            if (original == operands[j])
+                continue;
+
+            operands[j] = original;
+            changed = 1;
+        }
+
+        if (rewrite && parsed_instruction->instruction == INS_MOVE && operands[0] == operands[1]) {
+            removed[i] = 1;
+            changed = 1;
+            continue;
+        }
+
+        uint64_t uses = 0;
+        uint64_t defs = 0;
+        int pure = 0;
+
+        instruction_effects(parsed_instruction, &uses, &defs, &pure);
+        kill_copies(copy_of, defs);
+
+        if (parsed_instruction->instruction == INS_MOVE && operands[0] != operands[1])
+            copy_of[operands[0]] = operands[1];
+    }
+
+    return changed;
+}
+
+/* rewrites reads of a register that holds a copy into reads of the original, which
+ * leaves the move itself dead for eliminate_dead_stores. a block with a single
+ * predecessor starts from the copies that predecessor left behind. */
+static int propagate_copies(cvector_vector_type(ParsedInstruction) parsed_instructions, const CFG* cfg, uint8_t* removed) {
+    size_t count = cvector_size(cfg->blocks);
+    uint8_t (*exit)[REGISTER_MAX] = malloc(count * sizeof(*exit));
+    int changed = 0;
+
+    for (size_t block = 0; block < count; block++) {
+        for (uint8_t i = 0; i < REGISTER_MAX; i++)
+            exit[block][i] = i;
+
+        copy_block(parsed_instructions, &cfg->blocks[block], removed, exit[block], 0);
+    }
+
+    for (size_t block = 0; block < count; block++) {
+        const BasicBlock* bb = &cfg->blocks[block];
+        uint8_t copy_of[REGISTER_MAX];
+
+        for (uint8_t i = 0; i < REGISTER_MAX; i++)
+            copy_of[i] = i;
+
+        if (cvector_size(bb->preds) == 1 && bb->preds[0] != block && !bb->root)
+            memcpy(copy_of, exit[bb->preds[0]], sizeof(copy_of));
+
+        changed |= copy_block(parsed_instructions, bb, removed, copy_of, 1);
+    }
+
+    free(exit);
+
+    return changed;
+}
+
+/* the operands of the compare that produced the current flags. */
+typedef struct KnownCompare_t {
+    int valid;
+    Instruction instruction;
+    uint8_t lhs;
+    uint8_t rhs;
+    uint64_t immediate;
+} KnownCompare;
+
+static int same_compare(const KnownCompare* known, const ParsedInstruction* parsed_instruction) {
+    if (!known->valid || known->instruction != parsed_instruction->instruction || known->lhs != parsed_instruction->operands[0])
+        return 0;
+
+    if (parsed_instruction->instruction == INS_ICMP)
+        return known->immediate == operand_immediate(parsed_instruction, 1);
+
+    return known->rhs == parsed_instruction->operands[1];
+}
+
+static void track_compare(KnownCompare* known, const ParsedInstruction* parsed_instruction) {
+    uint64_t uses = 0;
+    uint64_t defs = 0;
+    int pure = 0;
+
+    instruction_effects(parsed_instruction, &uses, &defs, &pure);
+
+    if (parsed_instruction->instruction == INS_ICMP || parsed_instruction->instruction == INS_CMP) {
+        known->valid = 1;
+        known->instruction = parsed_instruction->instruction;
+        known->lhs = parsed_instruction->operands[0];
+        known->rhs = parsed_instruction->instruction == INS_CMP ? parsed_instruction->operands[1] : 0;
+        known->immediate = parsed_instruction->instruction == INS_ICMP ? operand_immediate(parsed_instruction, 1) : 0;
+        return;
+    }
+
+    if ((defs & FLAGS_BIT) || (defs & REGISTER_BIT(known->lhs)) || (known->instruction == INS_CMP && (defs & REGISTER_BIT(known->rhs))))
+        known->valid = 0;
+}
+
+/* removes compares that would recompute the flags they already hold, a block
+ * with a single predecessor starts from what that predecessor left behind. */
+static int eliminate_redundant_compares(cvector_vector_type(ParsedInstruction) parsed_instructions, const CFG* cfg, uint8_t* removed) {
+    size_t count = cvector_size(cfg->blocks);
+    KnownCompare* exit = calloc(count, sizeof(KnownCompare));
+    int changed = 0;
+
+    for (size_t block = 0; block < count; block++) {
+        for (size_t i = cfg->blocks[block].first; i < cfg->blocks[block].end; i++) {
+            if (!removed[i])
+                track_compare(&exit[block], &parsed_instructions[i]);
+        }
+    }
+
+    for (size_t block = 0; block < count; block++) {
+        const BasicBlock* bb = &cfg->blocks[block];
+        KnownCompare known = { .valid = 0 };
+
+        if (cvector_size(bb->preds) == 1 && bb->preds[0] != block && !bb->root)
+            known = exit[bb->preds[0]];
+
+        for (size_t i = bb->first; i < bb->end; i++) {
+            if (removed[i])
+                continue;
+
+            if (same_compare(&known, &parsed_instructions[i])) {
+                removed[i] = 1;
+                changed = 1;
+                continue;
+            }
+
+            track_compare(&known, &parsed_instructions[i]);
+        }
+    }
+
+    free(exit);
+
+    return changed;
+}
+
+/* finds a block ending in sub reg, 1 / cmp reg, 0 / jg or jne, the shape every counting loop has. */
+static int match_countdown(cvector_vector_type(ParsedInstruction) parsed_instructions, const BasicBlock* block, const uint8_t* removed, size_t* sub, size_t* cmp, size_t* jump) {
+    size_t found[3];
+    size_t count = 0;
+
+    for (size_t i = block->end; i-- > block->first && count < 3;) {
+        if (!removed[i])
+            found[count++] = i;
+    }
+
+    if (count < 3)
+        return 0;
+
+    *jump = found[0];
+    *cmp = found[1];
+    *sub = found[2];
+
+    const ParsedInstruction* sub_instruction = &parsed_instructions[*sub];
+    const ParsedInstruction* cmp_instruction = &parsed_instructions[*cmp];
+    Instruction jump_instruction = parsed_instructions[*jump].instruction;
+
+    return sub_instruction->instruction == INS_ISUB && operand_immediate(sub_instruction, 1) == 1
+        && cmp_instruction->instruction == INS_ICMP && operand_immediate(cmp_instruction, 1) == 0
+        && cmp_instruction->operands[0] == sub_instruction->operands[0]
+        && (jump_instruction == INS_JG || jump_instruction == INS_JNE);
+}
+
+/* the state flowing into a loop header from outside of the loop. */
+static State loop_entry_state(cvector_vector_type(ParsedInstruction) parsed_instructions, const CFG* cfg, const State* in, size_t header) {
+    State entry;
+    memset(&entry, 0, sizeof(entry));
+
+    const BasicBlock* bb = &cfg->blocks[header];
+
+    for (size_t i = 0; i < cvector_size(bb->preds); i++) {
+        size_t pred = bb->preds[i];
+
+        if (pred == header || !cfg->blocks[pred].reachable)
+            continue;
+
+        State out = in[pred];
+
+        for (size_t j = cfg->blocks[pred].first; j < cfg->blocks[pred].end; j++)
+            transfer(&out, &parsed_instructions[j]);
+
+        state_meet(&entry, &out);
+    }
+
+    return entry;
+}
+
+/* single block loops that only add loop invariant amounts to registers while counting down
+ * a counter with a known start are replaced by their closed form:
+ *
+ *     loop: add RA, 3 / sub RB, 1 / cmp RB, 0 / jg loop
+ *
+ * with RB = n on entry becomes add RA, 3 * n / move RB, 0 / cmp RB, 0. */
+static int reduce_counting_loops(cvector_vector_type(ParsedInstruction) parsed_instructions, const CFG* cfg, uint8_t* removed) {
+    State* in = NULL;
+    int changed = 0;
+
+    for (size_t l = 0; l < cvector_size(cfg->loops); l++) {
+        const Loop* loop = &cfg->loops[l];
+        const BasicBlock* bb = &cfg->blocks[loop->header];
+        size_t sub = 0;
+        size_t cmp = 0;
+        size_t jump = 0;
+
+        if (cvector_size(loop->blocks) != 1 || cfg->blocks[loop->header].root)
+            continue;
+
+        if (!match_countdown(parsed_instructions, bb, removed, &sub, &cmp, &jump) || cfg_jump_target(&parsed_instructions[jump]) != bb->ip)
+            continue;
+
+        if (!in)
+            in = solve_constants(parsed_instructions, cfg);
+
+        uint8_t counter = parsed_instructions[sub].operands[0];
+        State entry = loop_entry_state(parsed_instructions, cfg, in, loop->header);
+
+        if (entry.registers[counter].kind != VALUE_CONST || entry.registers[counter].value == 0)
+            continue;
+
+        uint64_t written = REGISTER_BIT(counter);
+
+        for (size_t i = bb->first; i < sub; i++) {
+            if (!removed[i] && parsed_instructions[i].operand_count != 0)
+                written |= REGISTER_BIT(parsed_instructions[i].operands[0]);
+        }
+
+        uint64_t delta[REGISTER_MAX] = { 0 };
+        size_t first_slot[REGISTER_MAX];
+        int reducible = 1;
+
+        for (uint8_t i = 0; i < REGISTER_MAX; i++)
+            first_slot[i] = CFG_NONE;
+
+        for (size_t i = bb->first; i < sub && reducible; i++) {
+            if (removed[i])
+                continue;
+
+            const ParsedInstruction* parsed_instruction = &parsed_instructions[i];
+            const uint8_t* operands = parsed_instruction->operands;
+            uint64_t amount = 0;
+
+            switch (parsed_instruction->instruction) {
+            case INS_IADD:
+            case INS_ISUB:
+                amount = operand_immediate(parsed_instruction, 1);
+                break;
+
+            case INS_ADD:
+            case INS_SUB:
+                if (parsed_instruction->operand_count != 2 || (written & REGISTER_BIT(operands[1])) || entry.registers[operands[1]].kind != VALUE_CONST) {
+                    reducible = 0;
+                    break;
+                }
+
+                amount = entry.registers[operands[1]].value;
+                break;
+
+            default:
+                reducible = 0;
+                break;
+            }
+
+            if (!reducible || operands[0] == counter) {
+                reducible = 0;
+                break;
+            }
+
+            if (parsed_instruction->instruction == INS_ISUB || parsed_instruction->instruction == INS_SUB)
+                delta[operands[0]] -= amount;
+            else
+                delta[operands[0]] += amount;
+
+            if (first_slot[operands[0]] == CFG_NONE)
+                first_slot[operands[0]] = i;
+        }
+
+        if (!reducible)
+            continue;
+
+        uint64_t trips = entry.registers[counter].value;
+
+        for (size_t i = bb->first; i < sub; i++) {
+            if (removed[i])
+                continue;
+
+            uint8_t dst = parsed_instructions[i].operands[0];
+
+            if (first_slot[dst] == i)
+                rewrite_immediate(&parsed_instructions[i], INS_IADD, delta[dst] * trips);
+            else
+                removed[i] = 1;
+        }
+
+        rewrite_immediate(&parsed_instructions[sub], INS_IMOVE, 0);
+        removed[jump] = 1;
+        changed = 1;
+    }
+
+    free(in);
+
+    return changed;
+}
+
+/* turns every remaining sub reg, 1 / cmp reg, 0 / jg target into a single loop instruction. */
+static int fuse_countdowns(cvector_vector_type(ParsedInstruction) parsed_instructions, const CFG* cfg, uint8_t* removed) {
+    int changed = 0;
+
+    for (size_t block = 0; block < cvector_size(cfg->blocks); block++) {
+        size_t sub = 0;
+        size_t cmp = 0;
+        size_t jump = 0;
+
+        if (!match_countdown(parsed_instructions, &cfg->blocks[block], removed, &sub, &cmp, &jump))
+            continue;
+
+        uint64_t target = cfg_jump_target(&parsed_instructions[jump]);
+        uint8_t operands[1 + sizeof(uint64_t)];
+
+        operands[0] = parsed_instructions[sub].operands[0];
+        memcpy(&operands[1], &target, sizeof(uint64_t));
+
+        parsed_instructions[sub] = parsed_instruction_init(INS_LOOP, operands, sizeof(operands), 3 + sizeof(uint64_t));
+
+        removed[cmp] = 1;
+        removed[jump] = 1;
+        changed = 1;
+    }
+
+    return changed;
+}
+
+static int eliminate_unreachable(const CFG* cfg, uint8_t* removed) {
+    int changed = 0;
+
+    for (size_t block = 0; block < cvector_size(cfg->blocks); block++) {
+        if (cfg->blocks[block].reachable)
+            continue;
+
+        for (size_t i = cfg->blocks[block].first; i < cfg->blocks[block].end; i++)
+            removed[i] = 1;
+
+        changed = 1;
+    }
+
+    return changed;
+}
+
+static size_t index_of_ip(const CFG* cfg, size_t count, uint64_t ip) {
+    size_t lo = 0;
+    size_t hi = count + 1;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (cfg->ip_of[mid] < ip)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* removes the marked instructions and moves every jump target, the start and the labels with them.
+ * a target that was removed now points at the next instruction that survived. */
+static void compact(cvector_vector_type(ParsedInstruction)* parsed_instructions, const CFG* cfg, const uint8_t* removed, uint64_t* start_rip, cvector_vector_type(Symbol) symbols) {
+    size_t count = cvector_size(*parsed_instructions);
+    uint64_t* new_ip = malloc((count + 1) * sizeof(uint64_t));
+    uint64_t ip = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        new_ip[i] = ip;
+
+        if (!removed[i])
+            ip += (*parsed_instructions)[i].size;
+    }
+
+    new_ip[count] = ip;
+
+    cvector_vector_type(ParsedInstruction) compacted = NULL;
+
+    for (size_t i = 0; i < count; i++) {
+        ParsedInstruction parsed_instruction = (*parsed_instructions)[i];
+
+        if (removed[i])
+            continue;
+
+        if (cfg_has_target(parsed_instruction.instruction))
+            cfg_set_jump_target(&parsed_instruction, new_ip[index_of_ip(cfg, count, cfg_jump_target(&parsed_instruction))]);
+
+        cvector_push_back(compacted, parsed_instruction);
+    }
+
+    *start_rip = new_ip[index_of_ip(cfg, count, *start_rip)];
+
+    for (size_t i = 0; i < cvector_size(symbols); i++) {
+        size_t index = index_of_ip(cfg, count, symbols[i].ip);
+
+        if (index <= count && cfg->ip_of[index] == symbols[i].ip)
+            symbols[i].ip = new_ip[index];
+    }
+
+    cvector_free(*parsed_instructions);
+    *parsed_instructions = compacted;
+
+    free(new_ip);
+}
+
+/* constant propagation, copy propagation, redundant compare removal, loop reduction and
+ * dead code elimination, repeated until nothing changes. with symbol_entries every
+ * label is a place the host may start at too, so nothing is assumed on entering one.
+ * returns the number of instructions removed or -1 if the program cannot be analysed. */
+int optimize(cvector_vector_type(ParsedInstruction)* parsed_instructions, uint64_t* start_rip, cvector_vector_type(Symbol) symbols, int symbol_entries) {
+    size_t before = cvector_size(*parsed_instructions);
+
+    for (int round = 0; round < OPT_MAX_ROUNDS; round++) {
+        CFG* cfg = cfg_init(*parsed_instructions, *start_rip, symbol_entries ? symbols : NULL);
+
+        if (!cfg)
+            return round == 0 ? -1 : (int)(before - cvector_size(*parsed_instructions));
+
+        uint8_t* removed = calloc(cvector_size(*parsed_instructions), 1);
+        int changed = 0;
+
+        changed |= eliminate_unreachable(cfg, removed);
+        changed |= propagate_constants(*parsed_instructions, cfg, removed);
+        changed |= propagate_copies(*parsed_instructions, cfg, removed);
+        changed |= eliminate_redundant_compares(*parsed_instructions, cfg, removed);
+        changed |= reduce_counting_loops(*parsed_instructions, cfg, removed);
+        changed |= fuse_countdowns(*parsed_instructions, cfg, removed);
+        changed |= eliminate_dead_stores(*parsed_instructions, cfg, removed);
+
+        compact(parsed_instructions, cfg, removed, start_rip, symbols);
+
+        free(removed);
+        cfg_deinit(cfg);
+
+        if (!changed)
+            break;
+    }
+
+    return (int)(before - cvector_size(*parsed_instructions));
+}
@@ -0,0 +1,11 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include <stdint.h>
+
+#include "cvector.h"
+#include "parser.h"
+
+int optimize(cvector_vector_type(ParsedInstruction)* parsed_instructions, uint64_t* start_rip, cvector_vector_type(Symbol) symbols, int symbol_entries);
+
+#endif /* OPT_H */
@@ -1,14 +1,12 @@
+#include <setjmp.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "parser.h"
 #include "lexer.h"
 
-typedef struct Symbol_t {
-    Span span;
-    uint64_t ip;
-} Symbol;
-
 static Symbol symbol_init(Span span, uint64_t ip) {
     return (Symbol) {
         .span = span,
@@ -16,9 +14,47 @@ static Symbol symbol_init(Span span, uint64_t ip) {
     };
 }
 
-static Token g_current;
+/* like the lexer the state is per thread. */
+static _Thread_local Token g_current;
+
+/* errors unwind straight back to parser_start, which frees what was parsed so far. */
+static _Thread_local jmp_buf g_error_jmp;
+static _Thread_local ParseError g_error;
+static _Thread_local int g_failed;
+static _Thread_local cvector_vector_type(ParsedInstruction) g_parsed_instructions = NULL;
+static _Thread_local uint8_t g_operands[PARSED_OPERANDS_MAX]; /* of the instruction being parsed */
+static _Thread_local uint8_t g_operand_count;
+
+/* the position is only counted out here, tokens do not carry it. */
+__attribute__((noreturn))
+static void parse_error(Token token, const char* format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(g_error.message, sizeof(g_error.message), format, args);
+    va_end(args);
+
+    token_position(token, &g_error.line, &g_error.col);
+
+    longjmp(g_error_jmp, 1);
+}
+
+static void push_operand(Token token, uint8_t operand) {
+    if (g_operand_count == PARSED_OPERANDS_MAX)
+        parse_error(token, "too many operands, at most %d bytes", PARSED_OPERANDS_MAX);
+
+    g_operands[g_operand_count++] = operand;
+}
+
+/* the instruction being built with the operands collected so far. */
+static ParsedInstruction take_instruction(Instruction instruction, uint8_t size) {
+    ParsedInstruction parsed_instruction = parsed_instruction_init(instruction, g_operands, g_operand_count, size);
+    g_operand_count = 0;
+
+    return parsed_instruction;
+}
 
-static cvector_vector_type(Symbol) g_symtab = NULL;
+static _Thread_local cvector_vector_type(Symbol) g_symtab = NULL;
 
 static int symtab_lookup(Span span) {
     for (int i = 0; i < cvector_size(g_symtab); i++) {
@@ -29,6 +65,40 @@ static int symtab_lookup(Span span) {
     return -1;
 }
 
+static _Thread_local cvector_vector_type(Relocation) g_relocations = NULL;
+static _Thread_local int g_relocating;
+static _Thread_local int g_section; /* stop at the next label */
+
+static Relocation relocation_init(Token label, uint64_t offset) {
+    return (Relocation) {
+        .label = token_span(label),
+        .offset = offset,
+    };
+}
+
+/* the target of the jump being parsed at rip, which follows its size and opcode bytes. a
+ * section has no idea where it will end up, so there every label becomes a relocation. */
+static void push_label_target(Token id, uint64_t rip) {
+    uint64_t ip = 0;
+
+    if (g_relocating) {
+        cvector_push_back(g_relocations, relocation_init(id, rip + 2));
+    } else {
+        int index = symtab_lookup(token_span(id));
+
+        if (index == -1) {
+            parse_error(id, "the lable: %.*s does not exist", (int)token_span(id).len, token_span(id).data);
+        }
+
+        ip = g_symtab[index].ip;
+    }
+
+    uint8_t* bytes = (uint8_t*)&ip;
+
+    for (uint8_t i = 0; i < sizeof(uint64_t); i++)
+        push_operand(id, bytes[i]);
+}
+
 int parser_init(const char* input) {
     if (!lexer_init(input))
         return 0;
@@ -40,6 +110,13 @@ int parser_init(const char* input) {
 void parser_deinit() {
     if (g_symtab != NULL)
         cvector_free(g_symtab);
+
+    g_symtab = NULL;
+}
+
+/* the labels seen by the last parser_start, valid until parser_deinit. */
+cvector_vector_type(Symbol) parser_symbols() {
+    return g_symtab;
 }
 
 static int expect(TokenKind kind) {
@@ -50,72 +127,152 @@ static int is_eof() {
     return expect(TOK_EOF);
 }
 
+static int is_register(TokenKind kind) {
+    return kind >= TOK_REG_A && kind <= TOK_REG_P;
+}
+
+/* registers keep the one byte encoding, so RA-RD programs assemble to the same bytes as before. */
 static uint8_t token_to_register(Token token) {
+    if (!is_register(token.kind)) {
+        parse_error(token, "cannot convert non register to byte");
+    }
+
+    return (uint8_t)(token.kind - TOK_REG_A);
+}
+
+static uint8_t token_to_vector_register(Token token) {
     switch (token.kind) {
-    case TOK_REG_A:
+    case TOK_VREG_A:
         return 0x00;
-    case TOK_REG_B:
+    case TOK_VREG_B:
         return 0x01;
-    case TOK_REG_C:
+    case TOK_VREG_C:
         return 0x02;
-    case TOK_REG_D:
+    case TOK_VREG_D:
         return 0x03;
     default:
-        fprintf(stderr, "ERROR: cannot convert non register to byte!\n");
-        exit(1);
+        parse_error(token, "cannot convert non vector register to byte");
+    }
+}
+
+static Instruction token_to_vector_instruction(Token token) {
+    switch (token.kind) {
+    case TOK_VADD:
+        return INS_VADD;
+    case TOK_VSUB:
+        return INS_VSUB;
+    case TOK_VMUL:
+        return INS_VMUL;
+    case TOK_VSUM:
+        return INS_VSUM;
+    case TOK_VSPLAT:
+        return INS_VSPLAT;
+    case TOK_VLOAD:
+        return INS_VLOAD;
+    case TOK_VSTORE:
+        return INS_VSTORE;
+    default:
+        parse_error(token, "cannot convert non vector token to instruction");
+    }
+}
+
+static Instruction token_to_memory_instruction(Token token) {
+    switch (token.kind) {
+    case TOK_LOADB:
+        return INS_LOADB;
+    case TOK_LOADW:
+        return INS_LOADW;
+    case TOK_LOADD:
+        return INS_LOADD;
+    case TOK_LOADQ:
+        return INS_LOADQ;
+    case TOK_STOREB:
+        return INS_STOREB;
+    case TOK_STOREW:
+        return INS_STOREW;
+    case TOK_STORED:
+        return INS_STORED;
+    case TOK_STOREQ:
+        return INS_STOREQ;
+    case TOK_MEMCPY:
+        return INS_MEMCPY;
+    case TOK_MEMSET:
+        return INS_MEMSET;
+    default:
+        parse_error(token, "cannot convert non memory token to instruction");
+    }
+}
+
+static Instruction token_to_checked_instruction(Token token) {
+    switch (token.kind) {
+    case TOK_ADDO:
+        return INS_ADDO;
+    case TOK_SUBO:
+        return INS_SUBO;
+    case TOK_MULO:
+        return INS_MULO;
+    default:
+        parse_error(token, "cannot convert non checked arithmetic token to instruction");
     }
 }
 
 static void advance() {
     if (!expect(TOK_EOF))
         g_current = lexer_get_token();
+
+    if (expect(TOK_ERROR))
+        parse_error(g_current, "%s: %.*s", lexer_error(), (int)token_span(g_current).len, token_span(g_current).data);
 }
 
 static void match(TokenKind kind) {
     if (!expect(kind)) {
-        fprintf(stderr, "(%zu:%zu) ERROR: unexpected token: ", g_current.line, g_current.col);
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
+        parse_error(g_current, "unexpected token: %.*s", (int)token_span(g_current).len, token_span(g_current).data);
     }
 
     advance();
 }
 
 static void match_register() {
+    if (!is_register(g_current.kind)) {
+        parse_error(g_current, "expected register but got: %.*s", (int)token_span(g_current).len, token_span(g_current).data);
+    }
+
+    advance();
+}
+
+static void match_vector_register() {
     switch (g_current.kind) {
-    case TOK_REG_A:
-    case TOK_REG_B:
-    case TOK_REG_C:
-    case TOK_REG_D:
+    case TOK_VREG_A:
+    case TOK_VREG_B:
+    case TOK_VREG_C:
+    case TOK_VREG_D:
         advance();
         break;
     default:
-        fprintf(stderr, "(%zu:%zu) ERROR: expected register but got: ", g_current.line, g_current.col);
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
+        parse_error(g_current, "expected vector register but got: %.*s", (int)token_span(g_current).len, token_span(g_current).data);
     }
 }
 
-cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
-    cvector_vector_type(ParsedInstruction) parsed_instructions = NULL;
-
+static void parse_program(uint64_t* start_rip) {
     uint64_t rip = 0;
 
     while (!is_eof()) {
         if (expect(TOK_LABLE)) {
-            if (span_equals(span_from("start"), g_current.span))
+            /* in a section the next label starts the next section. */
+            if (g_section && (cvector_size(g_symtab) > 0 || cvector_size(g_parsed_instructions) > 0))
+                break;
+
+            if (span_equals(span_from("start"), token_span(g_current)))
                 *start_rip = rip;
 
-            cvector_push_back(g_symtab, symbol_init(g_current.span, rip));
+            cvector_push_back(g_symtab, symbol_init(token_span(g_current), rip));
             advance();
 
             continue;
         }
 
         if (expect(TOK_HALT)) {
-            cvector_push_back(parsed_instructions, parsed_instruction_init(INS_HALT, NULL, 2));
+            cvector_push_back(g_parsed_instructions, take_instruction(INS_HALT, 2));
             advance();
 
             rip += 2;
@@ -132,8 +289,7 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             match(TOK_COMMA);
 
-            cvector_vector_type(uint8_t) operands = NULL;
-            cvector_push_back(operands, token_to_register(dst_reg));
+            push_operand(dst_reg, token_to_register(dst_reg));
 
             if (expect(TOK_IMMEDIATE)) {
                 size += sizeof(uint64_t);
@@ -141,14 +297,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
                 Token immediate = g_current;
                 advance();
 
-                uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+                uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
                 uint8_t* bytes = (uint8_t*)&immediate_value;
 
                 for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
+                    push_operand(g_current, bytes[i]);
 
-                ParsedInstruction iop = parsed_instruction_init(INS_IADD, operands, size);
-                cvector_push_back(parsed_instructions, iop);
+                ParsedInstruction iop = take_instruction(INS_IADD, size);
+                cvector_push_back(g_parsed_instructions, iop);
 
                 rip += size;
                 continue;
@@ -163,14 +319,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
                 Token src_reg = g_current;
                 match_register();
 
-                cvector_push_back(operands, token_to_register(src_reg));
+                push_operand(src_reg, token_to_register(src_reg));
                 
                 iteration += 1;
                 size += 1;
             } while (!is_eof() && expect(TOK_COMMA));
 
-            ParsedInstruction op = parsed_instruction_init(INS_ADD, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_ADD, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
@@ -186,8 +342,7 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             match(TOK_COMMA);
 
-            cvector_vector_type(uint8_t) operands = NULL;
-            cvector_push_back(operands, token_to_register(dst_reg));
+            push_operand(dst_reg, token_to_register(dst_reg));
 
             if (expect(TOK_IMMEDIATE)) {
                 size += sizeof(uint64_t);
@@ -195,14 +350,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
                 Token immediate = g_current;
                 advance();
 
-                uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+                uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
                 uint8_t* bytes = (uint8_t*)&immediate_value;
 
                 for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
+                    push_operand(g_current, bytes[i]);
 
-                ParsedInstruction iop = parsed_instruction_init(INS_ISUB, operands, size);
-                cvector_push_back(parsed_instructions, iop);
+                ParsedInstruction iop = take_instruction(INS_ISUB, size);
+                cvector_push_back(g_parsed_instructions, iop);
 
                 rip += size;
                 continue;
@@ -217,14 +372,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
                 Token src_reg = g_current;
                 match_register();
 
-                cvector_push_back(operands, token_to_register(src_reg));
+                push_operand(src_reg, token_to_register(src_reg));
                 
                 iteration += 1;
                 size += 1;
             } while (!is_eof() && expect(TOK_COMMA));
 
-            ParsedInstruction op = parsed_instruction_init(INS_SUB, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_SUB, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
@@ -240,8 +395,7 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             match(TOK_COMMA);
 
-            cvector_vector_type(uint8_t) operands = NULL;
-            cvector_push_back(operands, token_to_register(dst_reg));
+            push_operand(dst_reg, token_to_register(dst_reg));
 
             if (expect(TOK_IMMEDIATE)) {
                 size += sizeof(uint64_t);
@@ -249,14 +403,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
                 Token immediate = g_current;
                 advance();
 
-                uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+                uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
                 uint8_t* bytes = (uint8_t*)&immediate_value;
 
                 for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
+                    push_operand(g_current, bytes[i]);
 
-                ParsedInstruction iop = parsed_instruction_init(INS_IMUL, operands, size);
-                cvector_push_back(parsed_instructions, iop);
+                ParsedInstruction iop = take_instruction(INS_IMUL, size);
+                cvector_push_back(g_parsed_instructions, iop);
 
                 rip += size;
                 continue;
@@ -271,14 +425,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
                 Token src_reg = g_current;
                 match_register();
 
-                cvector_push_back(operands, token_to_register(src_reg));
+                push_operand(src_reg, token_to_register(src_reg));
                 
                 iteration += 1;
                 size += 1;
             } while (!is_eof() && expect(TOK_COMMA));
 
-            ParsedInstruction op = parsed_instruction_init(INS_MUL, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_MUL, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
@@ -294,8 +448,61 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             match(TOK_COMMA);
 
-            cvector_vector_type(uint8_t) operands = NULL;
-            cvector_push_back(operands, token_to_register(dst_reg));
+            push_operand(dst_reg, token_to_register(dst_reg));
+
+            if (expect(TOK_IMMEDIATE)) {
+                size += sizeof(uint64_t);
+
+                Token immediate = g_current;
+                advance();
+
+                uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
+                uint8_t* bytes = (uint8_t*)&immediate_value;
+
+                for (uint8_t i = 0; i < sizeof(uint64_t); i++)
+                    push_operand(g_current, bytes[i]);
+
+                ParsedInstruction iop = take_instruction(INS_IDIV, size);
+                cvector_push_back(g_parsed_instructions, iop);
+
+                rip += size;
+                continue;
+            }
+
+            uint8_t iteration = 0;
+
+            do {
+                if (iteration != 0 && expect(TOK_COMMA))
+                    advance();
+
+                Token src_reg = g_current;
+                match_register();
+
+                push_operand(src_reg, token_to_register(src_reg));
+                
+                iteration += 1;
+                size += 1;
+            } while (!is_eof() && expect(TOK_COMMA));
+
+            ParsedInstruction op = take_instruction(INS_DIV, size);
+            cvector_push_back(g_parsed_instructions, op);
+
+            rip += size;
+            continue;
+        }
+
+        /* sdiv divides as two's complement, the quotient truncated toward zero. */
+        if (expect(TOK_SDIV)) {
+            uint8_t size = 3;
+
+            advance();
+
+            Token dst_reg = g_current;
+            match_register();
+
+            match(TOK_COMMA);
+
+            push_operand(dst_reg, token_to_register(dst_reg));
 
             if (expect(TOK_IMMEDIATE)) {
                 size += sizeof(uint64_t);
@@ -303,14 +510,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
                 Token immediate = g_current;
                 advance();
 
-                uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+                uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
                 uint8_t* bytes = (uint8_t*)&immediate_value;
 
                 for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
+                    push_operand(g_current, bytes[i]);
 
-                ParsedInstruction iop = parsed_instruction_init(INS_IDIV, operands, size);
-                cvector_push_back(parsed_instructions, iop);
+                ParsedInstruction iop = take_instruction(INS_ISDIV, size);
+                cvector_push_back(g_parsed_instructions, iop);
 
                 rip += size;
                 continue;
@@ -325,14 +532,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
                 Token src_reg = g_current;
                 match_register();
 
-                cvector_push_back(operands, token_to_register(src_reg));
+                push_operand(src_reg, token_to_register(src_reg));
                 
                 iteration += 1;
                 size += 1;
             } while (!is_eof() && expect(TOK_COMMA));
 
-            ParsedInstruction op = parsed_instruction_init(INS_DIV, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_SDIV, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
@@ -343,22 +550,20 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             advance();
 
-            cvector_vector_type(uint8_t) operands = NULL;
-
             if (expect(TOK_IMMEDIATE)) {
                 size += sizeof(uint64_t);
 
                 Token immediate = g_current;
                 advance();
 
-                uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+                uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
                 uint8_t* bytes = (uint8_t*)&immediate_value;
 
                 for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
+                    push_operand(g_current, bytes[i]);
 
-                ParsedInstruction iop = parsed_instruction_init(INS_IPUSH, operands, size);
-                cvector_push_back(parsed_instructions, iop);
+                ParsedInstruction iop = take_instruction(INS_IPUSH, size);
+                cvector_push_back(g_parsed_instructions, iop);
 
                 rip += size;
                 continue;
@@ -373,14 +578,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
                 Token src_reg = g_current;
                 match_register();
 
-                cvector_push_back(operands, token_to_register(src_reg));
+                push_operand(src_reg, token_to_register(src_reg));
                 
                 iteration += 1;
                 size += 1;
             } while (!is_eof() && expect(TOK_COMMA));
 
-            ParsedInstruction op = parsed_instruction_init(INS_PUSH, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_PUSH, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
@@ -394,11 +599,10 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
             Token dst_reg = g_current;
             match_register();
 
-            cvector_vector_type(uint8_t) operands = NULL;
-            cvector_push_back(operands, token_to_register(dst_reg));
+            push_operand(dst_reg, token_to_register(dst_reg));
 
-            ParsedInstruction op = parsed_instruction_init(INS_POP, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_POP, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
@@ -414,8 +618,7 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             match(TOK_COMMA);
 
-            cvector_vector_type(uint8_t) operands = NULL;
-            cvector_push_back(operands, token_to_register(dst_reg));
+            push_operand(dst_reg, token_to_register(dst_reg));
 
             if (expect(TOK_IMMEDIATE)) {
                 size += sizeof(uint64_t);
@@ -423,14 +626,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
                 Token immediate = g_current;
                 advance();
 
-                uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+                uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
                 uint8_t* bytes = (uint8_t*)&immediate_value;
 
                 for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
+                    push_operand(g_current, bytes[i]);
 
-                ParsedInstruction iop = parsed_instruction_init(INS_IMOVE, operands, size);
-                cvector_push_back(parsed_instructions, iop);
+                ParsedInstruction iop = take_instruction(INS_IMOVE, size);
+                cvector_push_back(g_parsed_instructions, iop);
 
                 rip += size;
                 continue;
@@ -438,12 +641,12 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             Token src_reg = g_current;
             match_register();
-            cvector_push_back(operands, token_to_register(src_reg));
+            push_operand(src_reg, token_to_register(src_reg));
 
             size += 1;
 
-            ParsedInstruction op = parsed_instruction_init(INS_MOVE, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_MOVE, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
@@ -459,8 +662,7 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             match(TOK_COMMA);
 
-            cvector_vector_type(uint8_t) operands = NULL;
-            cvector_push_back(operands, token_to_register(lhs));
+            push_operand(lhs, token_to_register(lhs));
 
             if (expect(TOK_IMMEDIATE)) {
                 size += sizeof(uint64_t);
@@ -468,14 +670,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
                 Token immediate = g_current;
                 advance();
 
-                uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+                uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
                 uint8_t* bytes = (uint8_t*)&immediate_value;
 
                 for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
+                    push_operand(g_current, bytes[i]);
 
-                ParsedInstruction iop = parsed_instruction_init(INS_ICMP, operands, size);
-                cvector_push_back(parsed_instructions, iop);
+                ParsedInstruction iop = take_instruction(INS_ICMP, size);
+                cvector_push_back(g_parsed_instructions, iop);
 
                 rip += size;
                 continue;
@@ -483,45 +685,75 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             Token src_reg = g_current;
             match_register();
-            cvector_push_back(operands, token_to_register(src_reg));
+            push_operand(src_reg, token_to_register(src_reg));
 
             size += 1;
 
-            ParsedInstruction op = parsed_instruction_init(INS_CMP, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_CMP, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
         }
 
-        if (expect(TOK_JMP)) {
-            uint8_t size = 10;
+        /* scmp sets the flags for a signed comparison, jg and friends then branch on it. */
+        if (expect(TOK_SCMP)) {
+            uint8_t size = 3;
 
             advance();
 
-            cvector_vector_type(uint8_t) operands = NULL;
+            Token lhs = g_current;
+            match_register();
 
-            if (expect(TOK_IDENTIFIER)) {
-                Token id = g_current;
-                advance();
+            match(TOK_COMMA);
 
-                int index = symtab_lookup(id.span);
+            push_operand(lhs, token_to_register(lhs));
 
-                if (index == -1) {
-                    fprintf(stderr, "(%zu:%zu) ERROR: the lable: ", id.line, id.col);
-                    span_print(stderr, id.span);
-                    fprintf(stderr, "does not exist\n");
+            if (expect(TOK_IMMEDIATE)) {
+                size += sizeof(uint64_t);
 
-                    exit(1);
-                }
+                Token immediate = g_current;
+                advance();
 
-                uint8_t* bytes = (uint8_t*)&g_symtab[index].ip;
+                uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
+                uint8_t* bytes = (uint8_t*)&immediate_value;
 
                 for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
+                    push_operand(g_current, bytes[i]);
 
-                ParsedInstruction op = parsed_instruction_init(INS_JMP, operands, size);
-                cvector_push_back(parsed_instructions, op);
+                ParsedInstruction iop = take_instruction(INS_ISCMP, size);
+                cvector_push_back(g_parsed_instructions, iop);
+
+                rip += size;
+                continue;
+            }
+
+            Token src_reg = g_current;
+            match_register();
+            push_operand(src_reg, token_to_register(src_reg));
+
+            size += 1;
+
+            ParsedInstruction op = take_instruction(INS_SCMP, size);
+            cvector_push_back(g_parsed_instructions, op);
+
+            rip += size;
+            continue;
+        }
+
+        if (expect(TOK_JMP)) {
+            uint8_t size = 10;
+
+            advance();
+
+            if (expect(TOK_IDENTIFIER)) {
+                Token id = g_current;
+                advance();
+
+                push_label_target(id, rip);
+
+                ParsedInstruction op = take_instruction(INS_JMP, size);
+                cvector_push_back(g_parsed_instructions, op);
 
                 rip += size;
                 continue;
@@ -530,14 +762,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
             Token immediate = g_current;
             match(TOK_IMMEDIATE);
 
-            uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+            uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
             uint8_t* bytes = (uint8_t*)&immediate_value;
 
             for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                cvector_push_back(operands, bytes[i]);
+                push_operand(g_current, bytes[i]);
 
-            ParsedInstruction op = parsed_instruction_init(INS_JMP, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_JMP, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
@@ -548,29 +780,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             advance();
 
-            cvector_vector_type(uint8_t) operands = NULL;
-
             if (expect(TOK_IDENTIFIER)) {
                 Token id = g_current;
                 advance();
 
-                int index = symtab_lookup(id.span);
-
-                if (index == -1) {
-                    fprintf(stderr, "(%zu:%zu) ERROR: the lable: ", id.line, id.col);
-                    span_print(stderr, id.span);
-                    fprintf(stderr, "does not exist\n");
-
-                    exit(1);
-                }
-
-                uint8_t* bytes = (uint8_t*)&g_symtab[index].ip;
+                push_label_target(id, rip);
 
-                for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
-
-                ParsedInstruction op = parsed_instruction_init(INS_JE, operands, size);
-                cvector_push_back(parsed_instructions, op);
+                ParsedInstruction op = take_instruction(INS_JE, size);
+                cvector_push_back(g_parsed_instructions, op);
 
                 rip += size;
                 continue;
@@ -579,14 +796,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
             Token immediate = g_current;
             match(TOK_IMMEDIATE);
 
-            uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+            uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
             uint8_t* bytes = (uint8_t*)&immediate_value;
 
             for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                cvector_push_back(operands, bytes[i]);
+                push_operand(g_current, bytes[i]);
 
-            ParsedInstruction op = parsed_instruction_init(INS_JE, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_JE, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
@@ -597,29 +814,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             advance();
 
-            cvector_vector_type(uint8_t) operands = NULL;
-
             if (expect(TOK_IDENTIFIER)) {
                 Token id = g_current;
                 advance();
 
-                int index = symtab_lookup(id.span);
-
-                if (index == -1) {
-                    fprintf(stderr, "(%zu:%zu) ERROR: the lable: ", id.line, id.col);
-                    span_print(stderr, id.span);
-                    fprintf(stderr, "does not exist\n");
+                push_label_target(id, rip);
 
-                    exit(1);
-                }
-
-                uint8_t* bytes = (uint8_t*)&g_symtab[index].ip;
-
-                for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
-
-                ParsedInstruction op = parsed_instruction_init(INS_JNE, operands, size);
-                cvector_push_back(parsed_instructions, op);
+                ParsedInstruction op = take_instruction(INS_JNE, size);
+                cvector_push_back(g_parsed_instructions, op);
 
                 rip += size;
                 continue;
@@ -628,14 +830,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
             Token immediate = g_current;
             match(TOK_IMMEDIATE);
 
-            uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+            uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
             uint8_t* bytes = (uint8_t*)&immediate_value;
 
             for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                cvector_push_back(operands, bytes[i]);
+                push_operand(g_current, bytes[i]);
 
-            ParsedInstruction op = parsed_instruction_init(INS_JNE, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_JNE, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
@@ -646,29 +848,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             advance();
 
-            cvector_vector_type(uint8_t) operands = NULL;
-
             if (expect(TOK_IDENTIFIER)) {
                 Token id = g_current;
                 advance();
 
-                int index = symtab_lookup(id.span);
-
-                if (index == -1) {
-                    fprintf(stderr, "(%zu:%zu) ERROR: the lable: ", id.line, id.col);
-                    span_print(stderr, id.span);
-                    fprintf(stderr, "does not exist\n");
+                push_label_target(id, rip);
 
-                    exit(1);
-                }
-
-                uint8_t* bytes = (uint8_t*)&g_symtab[index].ip;
-
-                for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
-
-                ParsedInstruction op = parsed_instruction_init(INS_JG, operands, size);
-                cvector_push_back(parsed_instructions, op);
+                ParsedInstruction op = take_instruction(INS_JG, size);
+                cvector_push_back(g_parsed_instructions, op);
 
                 rip += size;
                 continue;
@@ -677,14 +864,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
             Token immediate = g_current;
             match(TOK_IMMEDIATE);
 
-            uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+            uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
             uint8_t* bytes = (uint8_t*)&immediate_value;
 
             for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                cvector_push_back(operands, bytes[i]);
+                push_operand(g_current, bytes[i]);
 
-            ParsedInstruction op = parsed_instruction_init(INS_JG, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_JG, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
@@ -695,29 +882,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             advance();
 
-            cvector_vector_type(uint8_t) operands = NULL;
-
             if (expect(TOK_IDENTIFIER)) {
                 Token id = g_current;
                 advance();
 
-                int index = symtab_lookup(id.span);
-
-                if (index == -1) {
-                    fprintf(stderr, "(%zu:%zu) ERROR: the lable: ", id.line, id.col);
-                    span_print(stderr, id.span);
-                    fprintf(stderr, "does not exist\n");
-
-                    exit(1);
-                }
-
-                uint8_t* bytes = (uint8_t*)&g_symtab[index].ip;
-
-                for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
+                push_label_target(id, rip);
 
-                ParsedInstruction op = parsed_instruction_init(INS_JL, operands, size);
-                cvector_push_back(parsed_instructions, op);
+                ParsedInstruction op = take_instruction(INS_JL, size);
+                cvector_push_back(g_parsed_instructions, op);
 
                 rip += size;
                 continue;
@@ -726,14 +898,14 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
             Token immediate = g_current;
             match(TOK_IMMEDIATE);
 
-            uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+            uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
             uint8_t* bytes = (uint8_t*)&immediate_value;
 
             for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                cvector_push_back(operands, bytes[i]);
+                push_operand(g_current, bytes[i]);
 
-            ParsedInstruction op = parsed_instruction_init(INS_JL, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_JL, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
@@ -744,29 +916,48 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
 
             advance();
 
-            cvector_vector_type(uint8_t) operands = NULL;
-
             if (expect(TOK_IDENTIFIER)) {
                 Token id = g_current;
                 advance();
 
-                int index = symtab_lookup(id.span);
+                push_label_target(id, rip);
 
-                if (index == -1) {
-                    fprintf(stderr, "(%zu:%zu) ERROR: the lable: ", id.line, id.col);
-                    span_print(stderr, id.span);
-                    fprintf(stderr, "does not exist\n");
+                ParsedInstruction op = take_instruction(INS_JGE, size);
+                cvector_push_back(g_parsed_instructions, op);
 
-                    exit(1);
-                }
+                rip += size;
+                continue;
+            }
 
-                uint8_t* bytes = (uint8_t*)&g_symtab[index].ip;
+            Token immediate = g_current;
+            match(TOK_IMMEDIATE);
 
-                for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
+            uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
+            uint8_t* bytes = (uint8_t*)&immediate_value;
+
+            for (uint8_t i = 0; i < sizeof(uint64_t); i++)
+                push_operand(g_current, bytes[i]);
+
+            ParsedInstruction op = take_instruction(INS_JGE, size);
+            cvector_push_back(g_parsed_instructions, op);
+
+            rip += size;
+            continue;
+        }
+
+        if (expect(TOK_JLE)) {
+            uint8_t size = 10;
+
+            advance();
+
+            if (expect(TOK_IDENTIFIER)) {
+                Token id = g_current;
+                advance();
+
+                push_label_target(id, rip);
 
-                ParsedInstruction op = parsed_instruction_init(INS_JGE, operands, size);
-                cvector_push_back(parsed_instructions, op);
+                ParsedInstruction op = take_instruction(INS_JLE, size);
+                cvector_push_back(g_parsed_instructions, op);
 
                 rip += size;
                 continue;
@@ -775,47 +966,68 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
             Token immediate = g_current;
             match(TOK_IMMEDIATE);
 
-            uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+            uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
             uint8_t* bytes = (uint8_t*)&immediate_value;
 
             for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                cvector_push_back(operands, bytes[i]);
+                push_operand(g_current, bytes[i]);
 
-            ParsedInstruction op = parsed_instruction_init(INS_JGE, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(INS_JLE, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
         }
 
-        if (expect(TOK_JLE)) {
+        /* jo and jc branch on the overflow and carry flags left by addo, subo and mulo. */
+        if (expect(TOK_JO) || expect(TOK_JC)) {
             uint8_t size = 10;
+            Instruction instruction = expect(TOK_JO) ? INS_JO : INS_JC;
 
             advance();
 
-            cvector_vector_type(uint8_t) operands = NULL;
-
             if (expect(TOK_IDENTIFIER)) {
                 Token id = g_current;
                 advance();
 
-                int index = symtab_lookup(id.span);
+                push_label_target(id, rip);
 
-                if (index == -1) {
-                    fprintf(stderr, "(%zu:%zu) ERROR: the lable: ", id.line, id.col);
-                    span_print(stderr, id.span);
-                    fprintf(stderr, "does not exist\n");
+                ParsedInstruction op = take_instruction(instruction, size);
+                cvector_push_back(g_parsed_instructions, op);
 
-                    exit(1);
-                }
+                rip += size;
+                continue;
+            }
 
-                uint8_t* bytes = (uint8_t*)&g_symtab[index].ip;
+            Token immediate = g_current;
+            match(TOK_IMMEDIATE);
 
-                for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                    cvector_push_back(operands, bytes[i]);
+            uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
+            uint8_t* bytes = (uint8_t*)&immediate_value;
+
+            for (uint8_t i = 0; i < sizeof(uint64_t); i++)
+                push_operand(g_current, bytes[i]);
 
-                ParsedInstruction op = parsed_instruction_init(INS_JLE, operands, size);
-                cvector_push_back(parsed_instructions, op);
+            ParsedInstruction op = take_instruction(instruction, size);
+            cvector_push_back(g_parsed_instructions, op);
+
+            rip += size;
+            continue;
+        }
+
+        if (expect(TOK_CALL)) {
+            uint8_t size = 10;
+
+            advance();
+
+            if (expect(TOK_IDENTIFIER)) {
+                Token id = g_current;
+                advance();
+
+                push_label_target(id, rip);
+
+                ParsedInstruction op = take_instruction(INS_CALL, size);
+                cvector_push_back(g_parsed_instructions, op);
 
                 rip += size;
                 continue;
@@ -824,38 +1036,354 @@ cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
             Token immediate = g_current;
             match(TOK_IMMEDIATE);
 
-            uint64_t immediate_value = strtoul(immediate.span.data, NULL, 10);
+            uint64_t immediate_value = strtoul(token_span(immediate).data, NULL, 10);
             uint8_t* bytes = (uint8_t*)&immediate_value;
 
             for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-                cvector_push_back(operands, bytes[i]);
+                push_operand(g_current, bytes[i]);
+
+            ParsedInstruction op = take_instruction(INS_CALL, size);
+            cvector_push_back(g_parsed_instructions, op);
+
+            rip += size;
+            continue;
+        }
+
+        /* loadq reg, base[, offset] reads memory[base + offset], storeq writes reg there. */
+        if (expect(TOK_LOADB) || expect(TOK_LOADW) || expect(TOK_LOADD) || expect(TOK_LOADQ)
+                || expect(TOK_STOREB) || expect(TOK_STOREW) || expect(TOK_STORED) || expect(TOK_STOREQ)) {
+            uint8_t size = 4 + sizeof(uint64_t);
+            Instruction instruction = token_to_memory_instruction(g_current);
+
+            advance();
+
+            Token reg = g_current;
+            match_register();
+
+            match(TOK_COMMA);
+
+            Token base = g_current;
+            match_register();
+
+            push_operand(reg, token_to_register(reg));
+            push_operand(base, token_to_register(base));
+
+            uint64_t offset_value = 0;
+
+            if (expect(TOK_COMMA)) {
+                advance();
+
+                Token offset = g_current;
+                match(TOK_IMMEDIATE);
+
+                offset_value = strtoul(token_span(offset).data, NULL, 10);
+            }
+
+            uint8_t* bytes = (uint8_t*)&offset_value;
+
+            for (uint8_t i = 0; i < sizeof(uint64_t); i++)
+                push_operand(g_current, bytes[i]);
+
+            ParsedInstruction op = take_instruction(instruction, size);
+            cvector_push_back(g_parsed_instructions, op);
+
+            rip += size;
+            continue;
+        }
+
+        /* memcpy dst, src, len and memset dst, value, len, all registers. */
+        if (expect(TOK_MEMCPY) || expect(TOK_MEMSET)) {
+            uint8_t size = 5;
+            Instruction instruction = token_to_memory_instruction(g_current);
+
+            advance();
 
-            ParsedInstruction op = parsed_instruction_init(INS_JLE, operands, size);
-            cvector_push_back(parsed_instructions, op);
+            for (uint8_t i = 0; i < 3; i++) {
+                if (i != 0)
+                    match(TOK_COMMA);
+
+                Token reg = g_current;
+                match_register();
+
+                push_operand(reg, token_to_register(reg));
+            }
+
+            ParsedInstruction op = take_instruction(instruction, size);
+            cvector_push_back(g_parsed_instructions, op);
 
             rip += size;
             continue;
         }
 
-        fprintf(stderr, "(%zu:%zu) ERROR: illegal instruction: ", g_current.line, g_current.col);
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
+        /* vadd dst, src with both vector registers, lane wise. */
+        if (expect(TOK_VADD) || expect(TOK_VSUB) || expect(TOK_VMUL)) {
+            uint8_t size = 4;
+            Instruction instruction = token_to_vector_instruction(g_current);
+
+            advance();
+
+            Token dst_reg = g_current;
+            match_vector_register();
+
+            match(TOK_COMMA);
+
+            Token src_reg = g_current;
+            match_vector_register();
+
+            push_operand(dst_reg, token_to_vector_register(dst_reg));
+            push_operand(src_reg, token_to_vector_register(src_reg));
+
+            ParsedInstruction op = take_instruction(instruction, size);
+            cvector_push_back(g_parsed_instructions, op);
+
+            rip += size;
+            continue;
+        }
+
+        /* vsum reg, vreg adds up the lanes, vsplat vreg, reg copies reg into every lane. */
+        if (expect(TOK_VSUM) || expect(TOK_VSPLAT)) {
+            uint8_t size = 4;
+            Instruction instruction = token_to_vector_instruction(g_current);
+
+            advance();
+
+            Token dst_reg = g_current;
+
+            if (instruction == INS_VSUM) {
+                match_register();
+                push_operand(dst_reg, token_to_register(dst_reg));
+            } else {
+                match_vector_register();
+                push_operand(dst_reg, token_to_vector_register(dst_reg));
+            }
+
+            match(TOK_COMMA);
+
+            Token src_reg = g_current;
+
+            if (instruction == INS_VSUM) {
+                match_vector_register();
+                push_operand(src_reg, token_to_vector_register(src_reg));
+            } else {
+                match_register();
+                push_operand(src_reg, token_to_register(src_reg));
+            }
+
+            ParsedInstruction op = take_instruction(instruction, size);
+            cvector_push_back(g_parsed_instructions, op);
+
+            rip += size;
+            continue;
+        }
+
+        /* vload vreg, base[, offset] reads all lanes from memory[base + offset], vstore writes them. */
+        if (expect(TOK_VLOAD) || expect(TOK_VSTORE)) {
+            uint8_t size = 4 + sizeof(uint64_t);
+            Instruction instruction = token_to_vector_instruction(g_current);
+
+            advance();
+
+            Token reg = g_current;
+            match_vector_register();
+
+            match(TOK_COMMA);
 
-        exit(1);
+            Token base = g_current;
+            match_register();
+
+            push_operand(reg, token_to_vector_register(reg));
+            push_operand(base, token_to_register(base));
+
+            uint64_t offset_value = 0;
+
+            if (expect(TOK_COMMA)) {
+                advance();
+
+                Token offset = g_current;
+                match(TOK_IMMEDIATE);
+
+                offset_value = strtoul(token_span(offset).data, NULL, 10);
+            }
+
+            uint8_t* bytes = (uint8_t*)&offset_value;
+
+            for (uint8_t i = 0; i < sizeof(uint64_t); i++)
+                push_operand(g_current, bytes[i]);
+
+            ParsedInstruction op = take_instruction(instruction, size);
+            cvector_push_back(g_parsed_instructions, op);
+
+            rip += size;
+            continue;
+        }
+
+        /* addo dst, src and friends wrap like add but record overflow in OF and carry in CF. */
+        if (expect(TOK_ADDO) || expect(TOK_SUBO) || expect(TOK_MULO)) {
+            uint8_t size = 4;
+            Instruction instruction = token_to_checked_instruction(g_current);
+
+            advance();
+
+            Token dst_reg = g_current;
+            match_register();
+
+            match(TOK_COMMA);
+
+            Token src_reg = g_current;
+            match_register();
+
+            push_operand(dst_reg, token_to_register(dst_reg));
+            push_operand(src_reg, token_to_register(src_reg));
+
+            ParsedInstruction op = take_instruction(instruction, size);
+            cvector_push_back(g_parsed_instructions, op);
+
+            rip += size;
+            continue;
+        }
+
+        /* wmul hi, lo, src stores the 128 bit product of lo and src in hi:lo. */
+        if (expect(TOK_WMUL)) {
+            uint8_t size = 5;
+
+            advance();
+
+            for (uint8_t i = 0; i < 3; i++) {
+                if (i != 0)
+                    match(TOK_COMMA);
+
+                Token reg = g_current;
+                match_register();
+
+                push_operand(reg, token_to_register(reg));
+            }
+
+            ParsedInstruction op = take_instruction(INS_WMUL, size);
+            cvector_push_back(g_parsed_instructions, op);
+
+            rip += size;
+            continue;
+        }
+
+        /* callnative id hands the vm over to the host function registered under id. */
+        if (expect(TOK_CALLNATIVE)) {
+            uint8_t size = 3;
+
+            advance();
+
+            Token id = g_current;
+            match(TOK_IMMEDIATE);
+
+            uint64_t id_value = strtoul(token_span(id).data, NULL, 10);
+
+            if (id_value >= NATIVE_MAX) {
+                parse_error(id, "native id %lu is out of range", id_value);
+            }
+
+            push_operand(id, (uint8_t)id_value);
+
+            ParsedInstruction op = take_instruction(INS_CALLNATIVE, size);
+            cvector_push_back(g_parsed_instructions, op);
+
+            rip += size;
+            continue;
+        }
+
+        if (expect(TOK_RET)) {
+            cvector_push_back(g_parsed_instructions, take_instruction(INS_RET, 2));
+            advance();
+
+            rip += 2;
+            continue;
+        }
+
+        parse_error(g_current, "illegal instruction: %.*s", (int)token_span(g_current).len, token_span(g_current).data);
+    }
+}
+
+/* returns NULL with parser_error set when the source does not assemble. */
+cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip) {
+    g_parsed_instructions = NULL;
+    g_failed = 0;
+
+    if (setjmp(g_error_jmp)) {
+        cvector_free(g_parsed_instructions);
+        g_parsed_instructions = NULL;
+        g_operand_count = 0;
+        g_failed = 1;
+
+        return NULL;
     }
 
+    if (expect(TOK_ERROR))
+        parse_error(g_current, "%s: %.*s", lexer_error(), (int)token_span(g_current).len, token_span(g_current).data);
+
+    parse_program(start_rip);
+
+    cvector_vector_type(ParsedInstruction) parsed_instructions = g_parsed_instructions;
+    g_parsed_instructions = NULL;
+
+    return parsed_instructions;
+}
+
+/* parses one section of a larger program as if it started at ip 0, up to the first label
+ * that does not start the input. every jump target is left as zero with a relocation, in
+ * relocations, for the caller to patch once the sections are laid out. returns NULL with
+ * parser_error set on failure, relocations then has those before the error. */
+cvector_vector_type(ParsedInstruction) parser_start_section(uint64_t* start_rip, cvector_vector_type(Relocation)* relocations) {
+    g_section = 1;
+
+    cvector_vector_type(ParsedInstruction) parsed_instructions = parser_start_chunk(start_rip, relocations);
+
+    g_section = 0;
+
+    return parsed_instructions;
+}
+
+/* parses all of a chunk of a larger program as if it started at ip 0. like a section
+ * every jump target becomes a relocation, its own labels are in parser_symbols. */
+cvector_vector_type(ParsedInstruction) parser_start_chunk(uint64_t* start_rip, cvector_vector_type(Relocation)* relocations) {
+    g_relocating = 1;
+    g_relocations = NULL;
+
+    cvector_vector_type(ParsedInstruction) parsed_instructions = parser_start(start_rip);
+
+    *relocations = g_relocations;
+    g_relocations = NULL;
+    g_relocating = 0;
+
     return parsed_instructions;
 }
 
-ParsedInstruction parsed_instruction_init(Instruction instruction, cvector_vector_type(uint8_t) operands, uint8_t size) {
-    return (ParsedInstruction) {
+/* the error of the last parser_start, NULL if it succeeded. */
+const ParseError* parser_error() {
+    return g_failed ? &g_error : NULL;
+}
+
+/* operand_count is at most PARSED_OPERANDS_MAX. */
+ParsedInstruction parsed_instruction_init(Instruction instruction, const uint8_t* operands, uint8_t operand_count, uint8_t size) {
+    ParsedInstruction parsed_instruction = {
         .instruction = instruction,
-        .operands = operands,
         .size = size,
+        .operand_count = operand_count,
     };
+
+    if (operand_count > 0)
+        memcpy(parsed_instruction.operands, operands, operand_count);
+
+    return parsed_instruction;
 }
 
-void parsed_instruction_deinit(ParsedInstruction parsed_instruction) {
-    if (parsed_instruction.operands != NULL)
-        cvector_free(parsed_instruction.operands);
+cvector_vector_type(uint8_t) parsed_instructions_codegen(cvector_vector_type(ParsedInstruction) parsed_instructions) {
+    cvector_vector_type(uint8_t) instructions = NULL;
+
+    for (uint64_t i = 0; i < cvector_size(parsed_instructions); i++) {
+        cvector_push_back(instructions, parsed_instructions[i].size);
+        cvector_push_back(instructions, parsed_instructions[i].instruction);
+
+        for (uint64_t j = 0; j < parsed_instructions[i].operand_count; j++)
+            cvector_push_back(instructions, parsed_instructions[i].operands[j]);
+    }
+
+    return instructions;
 }
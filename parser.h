@@ -5,17 +5,45 @@
 #include "vm.h"
 #include "lexer.h"
 
+typedef struct Symbol_t {
+    Span span;
+    uint64_t ip;
+} Symbol;
+
+/* a jump target left for whoever lays out the section, the label and where its eight
+ * bytes sit in the section's code. lexer_position finds the label in the source. */
+typedef struct Relocation_t {
+    Span label;
+    uint64_t offset;
+} Relocation;
+
+#define PARSE_ERROR_MAX 256
+
+typedef struct ParseError_t {
+    size_t line;
+    size_t col;
+    char message[PARSE_ERROR_MAX];
+} ParseError;
+
+#define PARSED_OPERANDS_MAX 18 /* fills the instruction up to 24 bytes */
+
+/* the operands are kept inline, a register and an immediate or a list of registers. */
 typedef struct ParsedInstruction_t {
     Instruction instruction;
-    cvector_vector_type(uint8_t) operands;
     uint8_t size;
+    uint8_t operand_count;
+    uint8_t operands[PARSED_OPERANDS_MAX];
 } ParsedInstruction;
 
-ParsedInstruction parsed_instruction_init(Instruction instruction, cvector_vector_type(uint8_t) operands, uint8_t size);
-void parsed_instruction_deinit(ParsedInstruction parsed_instruction);
+ParsedInstruction parsed_instruction_init(Instruction instruction, const uint8_t* operands, uint8_t operand_count, uint8_t size);
+cvector_vector_type(uint8_t) parsed_instructions_codegen(cvector_vector_type(ParsedInstruction) parsed_instructions);
 
 int parser_init(const char* input);
 void parser_deinit();
 cvector_vector_type(ParsedInstruction) parser_start(uint64_t* start_rip);
+cvector_vector_type(ParsedInstruction) parser_start_section(uint64_t* start_rip, cvector_vector_type(Relocation)* relocations);
+cvector_vector_type(ParsedInstruction) parser_start_chunk(uint64_t* start_rip, cvector_vector_type(Relocation)* relocations);
+cvector_vector_type(Symbol) parser_symbols();
+const ParseError* parser_error();
 
 #endif /* PARSER_H */
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+#include "cache.h"
+#include "cfg.h"
+
+/* the header is followed by count records of the instructions that ran. */
+typedef struct ProfileFileHeader_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t code_hash;
+    uint64_t code_size;
+    uint64_t count;
+} ProfileFileHeader;
+
+typedef struct ProfileRecord_t {
+    uint64_t ip;
+    uint64_t executed;
+    uint64_t taken;
+} ProfileRecord;
+
+static Profile* profile_alloc(uint64_t size, uint64_t code_hash) {
+    Profile* profile = malloc(sizeof(Profile));
+
+    if (!profile)
+        return NULL;
+
+    profile->executed = calloc(size + 1, sizeof(uint64_t));
+    profile->taken = calloc(size + 1, sizeof(uint64_t));
+    profile->size = size;
+    profile->code_hash = code_hash;
+
+    if (!profile->executed || !profile->taken) {
+        profile_deinit(profile);
+        return NULL;
+    }
+
+    return profile;
+}
+
+/* an empty profile for code. */
+Profile* profile_init(const uint8_t* code, uint64_t size) {
+    return profile_alloc(size, cache_hash((const char*)code, size, 0));
+}
+
+void profile_deinit(Profile* profile) {
+    if (!profile)
+        return;
+
+    free(profile->executed);
+    free(profile->taken);
+    free(profile);
+}
+
+int profile_matches(const Profile* profile, const uint8_t* code, uint64_t size) {
+    return profile->size == size && profile->code_hash == cache_hash((const char*)code, size, 0);
+}
+
+/* runs vm to the end one instruction at a time, counting into profile. a jump counts as
+ * taken when it did not land on the instruction after it. */
+VMStatus profile_run(VM* vm, Profile* profile) {
+    while (vm_run(vm, 0) == VM_RUNNING) {
+        uint64_t ip = vm->rip;
+        uint8_t size = FETCH(0);
+        Instruction instruction = FETCH(1);
+
+        vm_run(vm, 1);
+
+        if (ip >= profile->size)
+            continue;
+
+        profile->executed[ip] += 1;
+
+        if (cfg_is_conditional_jump(instruction) && vm->fault == VM_FAULT_NONE && vm->rip != ip + size)
+            profile->taken[ip] += 1;
+    }
+
+    return vm_run(vm, 0);
+}
+
+int profile_save(const Profile* profile, const char* path) {
+    FILE* file = fopen(path, "wb");
+
+    if (!file)
+        return 0;
+
+    ProfileFileHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, PROFILE_MAGIC, sizeof(PROFILE_MAGIC));
+    header.version = PROFILE_VERSION;
+    header.code_hash = profile->code_hash;
+    header.code_size = profile->size;
+
+    for (uint64_t ip = 0; ip < profile->size; ip++)
+        header.count += profile->executed[ip] != 0;
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (uint64_t ip = 0; ok && ip < profile->size; ip++) {
+        if (profile->executed[ip] == 0)
+            continue;
+
+        ProfileRecord record = {
+            .ip = ip,
+            .executed = profile->executed[ip],
+            .taken = profile->taken[ip],
+        };
+
+        ok = fwrite(&record, sizeof(record), 1, file) == 1;
+    }
+
+    return fclose(file) == 0 && ok;
+}
+
+Profile* profile_load(const char* path) {
+    FILE* file = fopen(path, "rb");
+
+    if (!file)
+        return NULL;
+
+    ProfileFileHeader header;
+    int ok = fread(&header, sizeof(header), 1, file) == 1
+            && memcmp(header.magic, PROFILE_MAGIC, sizeof(PROFILE_MAGIC)) == 0
+            && header.version == PROFILE_VERSION
+            && header.count <= header.code_size;
+
+    Profile* profile = ok ? profile_alloc(header.code_size, header.code_hash) : NULL;
+
+    for (uint64_t i = 0; profile && i < header.count; i++) {
+        ProfileRecord record;
+
+        if (fread(&record, sizeof(record), 1, file) != 1 || record.ip >= header.code_size) {
+            profile_deinit(profile);
+            profile = NULL;
+            break;
+        }
+
+        profile->executed[record.ip] = record.executed;
+        profile->taken[record.ip] = record.taken;
+    }
+
+    fclose(file);
+
+    return profile;
+}
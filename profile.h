@@ -0,0 +1,27 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+#define PROFILE_MAGIC "THKPROF"
+#define PROFILE_VERSION 1
+
+/* what an instrumented run saw, by the ip of each instruction. it belongs to the exact
+ * bytes it was recorded on, code_hash tells when those changed. */
+typedef struct Profile_t {
+    uint64_t* executed;
+    uint64_t* taken; /* only counted for conditional jumps */
+    uint64_t size; /* of the code */
+    uint64_t code_hash;
+} Profile;
+
+Profile* profile_init(const uint8_t* code, uint64_t size);
+void profile_deinit(Profile* profile);
+int profile_matches(const Profile* profile, const uint8_t* code, uint64_t size);
+VMStatus profile_run(VM* vm, Profile* profile);
+int profile_save(const Profile* profile, const char* path);
+Profile* profile_load(const char* path);
+
+#endif /* PROFILE_H */
@@ -0,0 +1,594 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+#include "cache.h"
+#include "cvector.h"
+
+#define REPLAY_BLOCK 64 /* what a native changed on the stack is found and kept in blocks of this many bytes */
+
+/* the header is followed by the checkpoints, the natives, the values, the changes and
+ * the data. */
+typedef struct ReplayFileHeader_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t code_hash;
+    uint64_t code_size;
+    uint64_t memory_size;
+    uint64_t interval;
+    uint64_t length;
+    uint64_t checkpoint_count;
+    uint64_t native_count;
+    uint64_t value_count;
+    uint64_t change_count;
+    uint64_t data_size;
+} ReplayFileHeader;
+
+/* the whole vm, its stack, call stack and memory follow each other at data. */
+typedef struct ReplayCheckpoint_t {
+    uint64_t count; /* instructions since the recording started */
+    uint64_t native; /* natives called before it */
+    uint64_t value; /* and the values and changes they left */
+    uint64_t change;
+    uint64_t registers[REGISTER_MAX];
+    uint64_t vregisters[VREGISTER_MAX][VECTOR_LANES];
+    uint8_t flags[FLAGS_MAX];
+    uint64_t rip;
+    uint64_t rsp;
+    uint64_t rcsp;
+    uint64_t fault;
+    uint64_t fault_rip;
+    uint64_t data;
+} ReplayCheckpoint;
+
+/* what a native changed, most change a register or two and nothing else. the new value
+ * of every register, vector register and flag with its bit set follows the ones of the
+ * natives before it in values, in that order, and its changes follow theirs. */
+typedef struct ReplayNative_t {
+    uint8_t id;
+    uint8_t fault; /* raised by the native */
+    uint8_t vregisters;
+    uint8_t flags;
+    uint16_t registers;
+    uint16_t rsp;
+    uint32_t change_count;
+} ReplayNative;
+
+typedef struct ReplayChange_t {
+    uint64_t memory; /* 1 for memory, 0 for the stack */
+    uint64_t offset;
+    uint64_t len;
+    uint64_t data;
+} ReplayChange;
+
+struct Recording_t {
+    uint64_t code_hash;
+    uint64_t code_size;
+    uint64_t memory_size;
+    uint64_t interval;
+    uint64_t length; /* in instructions */
+    cvector_vector_type(ReplayCheckpoint) checkpoints;
+    cvector_vector_type(ReplayNative) natives;
+    cvector_vector_type(uint64_t) values;
+    cvector_vector_type(ReplayChange) changes;
+    cvector_vector_type(uint8_t) data;
+    cvector_vector_type(ReplayChange) writes; /* what the native being recorded took to write */
+    uint8_t stack[STACK_MAX]; /* the stack before the native being recorded */
+    uint64_t base; /* the vm's instruction count when recording started */
+    size_t cursor; /* the next native to play back, its first value and change */
+    size_t value_cursor;
+    size_t change_cursor;
+};
+
+static Recording* replay_alloc(uint64_t code_hash, uint64_t code_size, uint64_t memory_size, uint64_t interval) {
+    Recording* recording = calloc(1, sizeof(Recording));
+
+    if (!recording)
+        return NULL;
+
+    recording->code_hash = code_hash;
+    recording->code_size = code_size;
+    recording->memory_size = memory_size;
+    recording->interval = interval == 0 ? REPLAY_DEFAULT_INTERVAL : interval;
+
+    return recording;
+}
+
+/* an empty recording of code run with memory_size bytes of memory, with a checkpoint
+ * every interval instructions, 0 for the default. */
+Recording* replay_init(const uint8_t* code, uint64_t size, uint64_t memory_size, uint64_t interval) {
+    return replay_alloc(cache_hash((const char*)code, size, 0), size, memory_size, interval);
+}
+
+/* every vm replayed from the recording has to be gone before it. */
+void replay_deinit(Recording* recording) {
+    if (!recording)
+        return;
+
+    cvector_free(recording->checkpoints);
+    cvector_free(recording->natives);
+    cvector_free(recording->values);
+    cvector_free(recording->changes);
+    cvector_free(recording->data);
+    cvector_free(recording->writes);
+    free(recording);
+}
+
+int replay_matches(const Recording* recording, const uint8_t* code, uint64_t size) {
+    return recording->code_size == size && recording->code_hash == cache_hash((const char*)code, size, 0);
+}
+
+uint64_t replay_length(const Recording* recording) {
+    return recording->length;
+}
+
+/* grows by doubling like push_back does, a checkpoint is one copy and not one push
+ * per byte. */
+static uint64_t data_append(Recording* recording, const void* bytes, uint64_t len) {
+    uint64_t offset = cvector_size(recording->data);
+
+    if (len == 0)
+        return offset;
+
+    if (cvector_capacity(recording->data) < offset + len) {
+        size_t capacity = cvector_capacity(recording->data) * 2;
+
+        cvector_grow(recording->data, capacity > offset + len ? capacity : offset + len);
+    }
+
+    memcpy(&recording->data[offset], bytes, len);
+    cvector_set_size(recording->data, offset + len);
+
+    return offset;
+}
+
+static void checkpoint(Recording* recording, const VM* vm) {
+    ReplayCheckpoint checkpoint;
+    memset(&checkpoint, 0, sizeof(checkpoint));
+
+    checkpoint.count = vm->stats.instructions - recording->base;
+    checkpoint.native = cvector_size(recording->natives);
+    checkpoint.value = cvector_size(recording->values);
+    checkpoint.change = cvector_size(recording->changes);
+    memcpy(checkpoint.registers, vm->registers, sizeof(checkpoint.registers));
+    memcpy(checkpoint.vregisters, vm->vregisters, sizeof(checkpoint.vregisters));
+    memcpy(checkpoint.flags, vm->flags, sizeof(checkpoint.flags));
+    checkpoint.rip = vm->rip;
+    checkpoint.rsp = vm->rsp;
+    checkpoint.rcsp = vm->rcsp;
+    checkpoint.fault = vm->fault;
+    checkpoint.fault_rip = vm->fault_rip;
+
+    checkpoint.data = data_append(recording, vm->stack, vm->rsp);
+    data_append(recording, vm->call_stack, vm->rcsp * sizeof(uint64_t));
+    data_append(recording, vm->memory, vm->memory_size);
+
+    cvector_push_back(recording->checkpoints, checkpoint);
+}
+
+static uint64_t block_len(uint64_t offset, uint64_t len) {
+    return len - offset < REPLAY_BLOCK ? len - offset : REPLAY_BLOCK;
+}
+
+/* bytes past known were not there before, they count as changed. */
+static int block_changed(const uint8_t* before, const uint8_t* after, uint64_t known, uint64_t offset, uint64_t len) {
+    uint64_t n = block_len(offset, len);
+
+    return offset + n > known || memcmp(&before[offset], &after[offset], n) != 0;
+}
+
+static void record_stack_changes(Recording* recording, const uint8_t* before, const uint8_t* after, uint64_t known, uint64_t len) {
+    for (uint64_t offset = 0; offset < len;) {
+        if (!block_changed(before, after, known, offset, len)) {
+            offset += block_len(offset, len);
+            continue;
+        }
+
+        uint64_t start = offset;
+
+        while (offset < len && block_changed(before, after, known, offset, len))
+            offset += block_len(offset, len);
+
+        ReplayChange change = {
+            .memory = 0,
+            .offset = start,
+            .len = offset - start,
+            .data = data_append(recording, &after[start], offset - start),
+        };
+
+        cvector_push_back(recording->changes, change);
+    }
+}
+
+static void record_write(VM* vm, uint64_t address, uint64_t len, void* data) {
+    Recording* recording = data;
+    ReplayChange write = { .memory = 1, .offset = address, .len = len, .data = 0 };
+    (void)vm;
+
+    cvector_push_back(recording->writes, write);
+}
+
+/* runs the native as vm_call_native would and keeps what it changed. the registers and
+ * flags are compared against what they were before the call, the stack is compared up
+ * to rsp and of the memory only what the native took from vm_native_memory is kept. */
+static void record_native(VM* vm, uint8_t id, NativeFunction function, void* data) {
+    Recording* recording = data;
+    uint64_t registers[REGISTER_MAX];
+    uint64_t vregisters[VREGISTER_MAX][VECTOR_LANES];
+    uint8_t flags[FLAGS_MAX];
+    uint64_t rsp = vm->rsp;
+
+    memcpy(registers, vm->registers, sizeof(registers));
+    memcpy(vregisters, vm->vregisters, sizeof(vregisters));
+    memcpy(flags, vm->flags, sizeof(flags));
+    memcpy(recording->stack, vm->stack, rsp);
+    cvector_clear(recording->writes);
+
+    if (function)
+        function(vm);
+    else
+        vm_fault(vm, VM_FAULT_UNKNOWN_NATIVE);
+
+    ReplayNative native;
+    memset(&native, 0, sizeof(native));
+
+    native.id = id;
+    native.fault = vm->fault;
+    native.rsp = vm->rsp;
+
+    for (uint8_t i = 0; i < REGISTER_MAX; i++) {
+        if (vm->registers[i] != registers[i]) {
+            native.registers |= 1 << i;
+            cvector_push_back(recording->values, vm->registers[i]);
+        }
+    }
+
+    for (uint8_t i = 0; i < VREGISTER_MAX; i++) {
+        if (memcmp(vm->vregisters[i], vregisters[i], sizeof(vregisters[i])) != 0) {
+            native.vregisters |= 1 << i;
+
+            for (uint8_t lane = 0; lane < VECTOR_LANES; lane++)
+                cvector_push_back(recording->values, vm->vregisters[i][lane]);
+        }
+    }
+
+    for (uint8_t i = 0; i < FLAGS_MAX; i++) {
+        if (vm->flags[i] != flags[i]) {
+            native.flags |= 1 << i;
+            cvector_push_back(recording->values, vm->flags[i]);
+        }
+    }
+
+    size_t change = cvector_size(recording->changes);
+
+    record_stack_changes(recording, recording->stack, vm->stack, rsp, vm->rsp);
+
+    for (size_t i = 0; i < cvector_size(recording->writes); i++) {
+        ReplayChange write = recording->writes[i];
+
+        write.data = data_append(recording, &vm->memory[write.offset], write.len);
+        cvector_push_back(recording->changes, write);
+    }
+
+    native.change_count = cvector_size(recording->changes) - change;
+
+    cvector_push_back(recording->natives, native);
+}
+
+/* runs vm to the end into an empty recording. vm has to have the memory size the
+ * recording was made for, else it is left as it is. natives must not map other memory
+ * into the vm while it is recorded, and memory they write around vm_native_memory is
+ * not in the recording. */
+VMStatus replay_record(Recording* recording, VM* vm) {
+    if (vm->memory_size != recording->memory_size || cvector_size(recording->checkpoints) != 0)
+        return vm_run(vm, 0);
+
+    NativeHook hook = vm->native_hook;
+    void* hook_data = vm->native_hook_data;
+
+    recording->base = vm->stats.instructions;
+    checkpoint(recording, vm);
+
+    NativeWriteHook write_hook = vm->native_write_hook;
+
+    vm->native_hook = record_native;
+    vm->native_write_hook = record_write;
+    vm->native_hook_data = recording;
+
+    while (vm_run(vm, recording->interval) == VM_RUNNING)
+        checkpoint(recording, vm);
+
+    vm->native_hook = hook;
+    vm->native_write_hook = write_hook;
+    vm->native_hook_data = hook_data;
+    recording->length = vm->stats.instructions - recording->base;
+
+    return vm_run(vm, 0);
+}
+
+/* how many values a native left in values. */
+static uint64_t native_values(const ReplayNative* native) {
+    return __builtin_popcount(native->registers)
+            + __builtin_popcount(native->vregisters) * VECTOR_LANES
+            + __builtin_popcount(native->flags);
+}
+
+/* plays back the next native, a call the recorded run did not make is a native fault. */
+static void replay_native(VM* vm, uint8_t id, NativeFunction function, void* data) {
+    Recording* recording = data;
+    (void)function;
+
+    if (recording->cursor >= cvector_size(recording->natives) || recording->natives[recording->cursor].id != id) {
+        vm_fault(vm, VM_FAULT_NATIVE);
+        return;
+    }
+
+    const ReplayNative* native = &recording->natives[recording->cursor++];
+    const uint64_t* value = &recording->values[recording->value_cursor];
+
+    for (uint8_t i = 0; i < REGISTER_MAX; i++) {
+        if (native->registers & (1 << i))
+            vm->registers[i] = *value++;
+    }
+
+    for (uint8_t i = 0; i < VREGISTER_MAX; i++) {
+        if (native->vregisters & (1 << i)) {
+            memcpy(vm->vregisters[i], value, sizeof(vm->vregisters[i]));
+            value += VECTOR_LANES;
+        }
+    }
+
+    for (uint8_t i = 0; i < FLAGS_MAX; i++) {
+        if (native->flags & (1 << i))
+            vm->flags[i] = (uint8_t)*value++;
+    }
+
+    recording->value_cursor += native_values(native);
+    vm->rsp = native->rsp;
+
+    for (uint64_t i = 0; i < native->change_count; i++) {
+        const ReplayChange* change = &recording->changes[recording->change_cursor++];
+        uint8_t* target = change->memory ? vm->memory : vm->stack;
+
+        memcpy(&target[change->offset], &recording->data[change->data], change->len);
+    }
+
+    if (native->fault != VM_FAULT_NONE)
+        vm_fault(vm, native->fault);
+}
+
+/* a vm in the state the recorded run had after count instructions, NULL past its end.
+ * the vm plays back the recorded natives from there on and can be run further, up to
+ * the end of the recording. each seek takes the playback over from the vm of the one
+ * before, only the last one may still be run. nothing in a recording file proves its
+ * checkpoints stack safe, so like a restored vm the replayed one starts unverified. */
+VM* replay_seek(Recording* recording, const uint8_t* code, uint64_t count) {
+    size_t low = 0;
+    size_t high = cvector_size(recording->checkpoints);
+
+    if (high == 0 || count > recording->length)
+        return NULL;
+
+    /* the last checkpoint at or before count, the first one is at 0 */
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+
+        if (recording->checkpoints[middle].count <= count)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    const ReplayCheckpoint* checkpoint = &recording->checkpoints[low];
+    VM* vm = vm_init(code, checkpoint->rip, recording->memory_size);
+
+    if (!vm || vm->memory_size != recording->memory_size) {
+        vm_deinit(vm);
+        return NULL;
+    }
+
+    const uint8_t* data = &recording->data[checkpoint->data];
+
+    memcpy(vm->registers, checkpoint->registers, sizeof(checkpoint->registers));
+    memcpy(vm->vregisters, checkpoint->vregisters, sizeof(checkpoint->vregisters));
+    memcpy(vm->flags, checkpoint->flags, sizeof(checkpoint->flags));
+    vm->rsp = checkpoint->rsp;
+    vm->rcsp = checkpoint->rcsp;
+    vm->fault = checkpoint->fault;
+    vm->fault_rip = checkpoint->fault_rip;
+    vm->stats.instructions = checkpoint->count;
+
+    memcpy(vm->stack, data, checkpoint->rsp);
+    memcpy(vm->call_stack, &data[checkpoint->rsp], checkpoint->rcsp * sizeof(uint64_t));
+
+    if (recording->memory_size)
+        memcpy(vm->memory, &data[checkpoint->rsp + checkpoint->rcsp * sizeof(uint64_t)], recording->memory_size);
+
+    recording->cursor = checkpoint->native;
+    recording->value_cursor = checkpoint->value;
+    recording->change_cursor = checkpoint->change;
+    vm->native_hook = replay_native;
+    vm->native_hook_data = recording;
+
+    if (count > checkpoint->count)
+        vm_run(vm, count - checkpoint->count);
+
+    return vm;
+}
+
+/* an empty vector is a NULL pointer, which fwrite must not be given. */
+static int write_array(FILE* file, const void* data, size_t size, uint64_t count) {
+    return count == 0 || fwrite(data, size, count, file) == count;
+}
+
+int replay_save(const Recording* recording, const char* path) {
+    FILE* file = fopen(path, "wb");
+
+    if (!file)
+        return 0;
+
+    ReplayFileHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+    header.version = REPLAY_VERSION;
+    header.code_hash = recording->code_hash;
+    header.code_size = recording->code_size;
+    header.memory_size = recording->memory_size;
+    header.interval = recording->interval;
+    header.length = recording->length;
+    header.checkpoint_count = cvector_size(recording->checkpoints);
+    header.native_count = cvector_size(recording->natives);
+    header.value_count = cvector_size(recording->values);
+    header.change_count = cvector_size(recording->changes);
+    header.data_size = cvector_size(recording->data);
+
+    int ok = write_array(file, &header, sizeof(header), 1)
+            && write_array(file, recording->checkpoints, sizeof(ReplayCheckpoint), header.checkpoint_count)
+            && write_array(file, recording->natives, sizeof(ReplayNative), header.native_count)
+            && write_array(file, recording->values, sizeof(uint64_t), header.value_count)
+            && write_array(file, recording->changes, sizeof(ReplayChange), header.change_count)
+            && write_array(file, recording->data, 1, header.data_size);
+
+    return fclose(file) == 0 && ok;
+}
+
+/* everything a replay reads from the values and the data has to be in them, and each
+ * checkpoint has to pick up the natives where the ones before it leave off. like a
+ * snapshot the state itself is trusted, a recording is only ever made by replay_record. */
+static int recording_valid(const Recording* recording) {
+    uint64_t data_size = cvector_size(recording->data);
+    uint64_t value_count = cvector_size(recording->values);
+    uint64_t change_count = cvector_size(recording->changes);
+    uint64_t checkpoint_count = cvector_size(recording->checkpoints);
+    uint64_t native_count = cvector_size(recording->natives);
+    uint64_t previous = 0;
+
+    for (size_t i = 0; i < checkpoint_count; i++) {
+        const ReplayCheckpoint* checkpoint = &recording->checkpoints[i];
+        uint64_t len = checkpoint->rsp + checkpoint->rcsp * sizeof(uint64_t) + recording->memory_size;
+
+        if ((i == 0 ? checkpoint->count != 0 : checkpoint->count < previous)
+                || checkpoint->count > recording->length
+                || checkpoint->rip >= recording->code_size
+                || checkpoint->rsp > STACK_MAX
+                || checkpoint->rcsp > CALL_STACK_MAX
+                || checkpoint->fault >= VM_FAULT_COUNT
+                || checkpoint->data > data_size
+                || len > data_size - checkpoint->data)
+            return 0;
+
+        previous = checkpoint->count;
+    }
+
+    size_t next = 0; /* the checkpoint to compare against the running positions */
+    uint64_t value = 0;
+    uint64_t change = 0;
+
+    for (size_t i = 0; i <= native_count; i++) {
+        for (; next < checkpoint_count && recording->checkpoints[next].native == i; next++) {
+            if (recording->checkpoints[next].value != value || recording->checkpoints[next].change != change)
+                return 0;
+        }
+
+        if (i == native_count)
+            break;
+
+        const ReplayNative* native = &recording->natives[i];
+
+        if (native->rsp > STACK_MAX
+                || native->fault >= VM_FAULT_COUNT
+                || native_values(native) > value_count - value
+                || native->change_count > change_count - change)
+            return 0;
+
+        value += native_values(native);
+        change += native->change_count;
+    }
+
+    if (next != checkpoint_count)
+        return 0;
+
+    for (size_t i = 0; i < change_count; i++) {
+        const ReplayChange* change = &recording->changes[i];
+        uint64_t size = change->memory ? recording->memory_size : STACK_MAX;
+
+        if (change->offset > size
+                || change->len > size - change->offset
+                || change->data > data_size
+                || change->len > data_size - change->data)
+            return 0;
+    }
+
+    return checkpoint_count != 0;
+}
+
+/* count elements of size bytes into a vector read whole, ok as long as every read was. */
+#define READ_ARRAY(file, vector, count, ok) do { \
+    if ((ok) && (count) != 0) { \
+        cvector_grow((vector), (count)); \
+        (ok) = fread((vector), sizeof(*(vector)), (count), (file)) == (count); \
+        cvector_set_size((vector), (ok) ? (count) : 0); \
+    } \
+} while (0)
+
+/* what the header says follows it has to be in the file before anything is allocated
+ * for it. */
+static int header_fits(FILE* file, const ReplayFileHeader* header) {
+    uint64_t counts[] = { header->checkpoint_count, header->native_count, header->value_count, header->change_count, header->data_size };
+    uint64_t sizes[] = { sizeof(ReplayCheckpoint), sizeof(ReplayNative), sizeof(uint64_t), sizeof(ReplayChange), 1 };
+    uint64_t total = sizeof(ReplayFileHeader);
+
+    if (fseek(file, 0, SEEK_END) != 0)
+        return 0;
+
+    long file_size = ftell(file);
+
+    if (file_size < 0 || fseek(file, sizeof(ReplayFileHeader), SEEK_SET) != 0)
+        return 0;
+
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        if (counts[i] > ((uint64_t)file_size - total) / sizes[i])
+            return 0;
+
+        total += counts[i] * sizes[i];
+    }
+
+    return total == (uint64_t)file_size;
+}
+
+Recording* replay_load(const char* path) {
+    FILE* file = fopen(path, "rb");
+
+    if (!file)
+        return NULL;
+
+    ReplayFileHeader header;
+    int ok = fread(&header, sizeof(header), 1, file) == 1
+            && memcmp(header.magic, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) == 0
+            && header.version == REPLAY_VERSION
+            && header_fits(file, &header);
+
+    Recording* recording = ok ? replay_alloc(header.code_hash, header.code_size, header.memory_size, header.interval) : NULL;
+
+    if (recording) {
+        recording->length = header.length;
+
+        READ_ARRAY(file, recording->checkpoints, header.checkpoint_count, ok);
+        READ_ARRAY(file, recording->natives, header.native_count, ok);
+        READ_ARRAY(file, recording->values, header.value_count, ok);
+        READ_ARRAY(file, recording->changes, header.change_count, ok);
+        READ_ARRAY(file, recording->data, header.data_size, ok);
+    }
+
+    if (recording && !(ok && recording_valid(recording))) {
+        replay_deinit(recording);
+        recording = NULL;
+    }
+
+    fclose(file);
+
+    return recording;
+}
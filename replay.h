@@ -0,0 +1,29 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+#define REPLAY_MAGIC "THKREPL"
+#define REPLAY_VERSION 3
+#define REPLAY_DEFAULT_INTERVAL (1 << 20) /* instructions between checkpoints */
+
+/* a run of a vm kept as what the bytecode cannot work out again by itself: the state
+ * it started from, what every native it called did, and the full state every interval
+ * instructions. a replay starts from the last checkpoint at or before the instruction
+ * asked for and executes the rest with the natives played back, so the state is the
+ * one the recorded run had there. like a profile it belongs to the exact bytes it was
+ * recorded on. */
+typedef struct Recording_t Recording;
+
+Recording* replay_init(const uint8_t* code, uint64_t size, uint64_t memory_size, uint64_t interval);
+void replay_deinit(Recording* recording);
+int replay_matches(const Recording* recording, const uint8_t* code, uint64_t size);
+uint64_t replay_length(const Recording* recording);
+VMStatus replay_record(Recording* recording, VM* vm);
+VM* replay_seek(Recording* recording, const uint8_t* code, uint64_t count);
+int replay_save(const Recording* recording, const char* path);
+Recording* replay_load(const char* path);
+
+#endif /* REPLAY_H */
@@ -0,0 +1,310 @@
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "scan.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+static size_t scalar_whitespace(const char* text) {
+    size_t len = 0;
+
+    while (text[len] && isspace(text[len]))
+        len++;
+
+    return len;
+}
+
+static size_t scalar_comment(const char* text) {
+    size_t len = 0;
+
+    while (text[len] && text[len] != '\n')
+        len++;
+
+    return len;
+}
+
+static size_t scalar_digits(const char* text) {
+    size_t len = 0;
+
+    while (text[len] && isdigit(text[len]))
+        len++;
+
+    return len;
+}
+
+static size_t scalar_alphas(const char* text) {
+    size_t len = 0;
+
+    while (text[len] && isalpha(text[len]))
+        len++;
+
+    return len;
+}
+
+static size_t scalar_newlines(const char* text, size_t len, size_t* last) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\n') {
+            count++;
+            *last = i;
+        }
+    }
+
+    return count;
+}
+
+static const ScanOps g_scalar_ops = {
+    .name = "scalar",
+    .whitespace = scalar_whitespace,
+    .comment = scalar_comment,
+    .digits = scalar_digits,
+    .alphas = scalar_alphas,
+    .newlines = scalar_newlines,
+};
+
+#ifdef SCAN_X86
+
+/* the vector runs load whole aligned blocks, which never cross into the next page, so
+ * reading past the NUL is safe even though the sanitizers cannot know that. the bytes in
+ * front of text are masked off. */
+#define SCAN_BLOCK_LOOP(width, load, stop_mask)                                         \
+    const char* block = (const char*)((uintptr_t)text & ~(uintptr_t)((width) - 1));     \
+    uint64_t stop = stop_mask(load(block)) >> (text - block) << (text - block);          \
+                                                                                         \
+    while (stop == 0) {                                                                  \
+        block += (width);                                                                \
+        stop = stop_mask(load(block));                                                   \
+    }                                                                                    \
+                                                                                         \
+    return (size_t)(block + __builtin_ctzll(stop) - text);
+
+__attribute__((no_sanitize_address))
+static inline __m128i sse2_load(const char* block) {
+    return _mm_load_si128((const __m128i*)block);
+}
+
+/* bytes - low <= high - low, unsigned, for the ranges of the C locale classes. */
+static __m128i sse2_in_range(__m128i bytes, char low, char high) {
+    __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8(low));
+    __m128i limit = _mm_set1_epi8((char)(high - low));
+
+    return _mm_cmpeq_epi8(_mm_min_epu8(offset, limit), offset);
+}
+
+static uint64_t sse2_stop_whitespace(__m128i bytes) {
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), sse2_in_range(bytes, '\t', '\r'));
+
+    return ~(uint64_t)_mm_movemask_epi8(space) & 0xffff;
+}
+
+static uint64_t sse2_stop_comment(__m128i bytes) {
+    __m128i end = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(bytes, _mm_setzero_si128()));
+
+    return (uint64_t)_mm_movemask_epi8(end);
+}
+
+static uint64_t sse2_stop_digits(__m128i bytes) {
+    return ~(uint64_t)_mm_movemask_epi8(sse2_in_range(bytes, '0', '9')) & 0xffff;
+}
+
+static uint64_t sse2_stop_alphas(__m128i bytes) {
+    __m128i lower = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+
+    return ~(uint64_t)_mm_movemask_epi8(sse2_in_range(lower, 'a', 'z')) & 0xffff;
+}
+
+__attribute__((no_sanitize_address))
+static size_t sse2_whitespace(const char* text) {
+    SCAN_BLOCK_LOOP(16, sse2_load, sse2_stop_whitespace)
+}
+
+__attribute__((no_sanitize_address))
+static size_t sse2_comment(const char* text) {
+    SCAN_BLOCK_LOOP(16, sse2_load, sse2_stop_comment)
+}
+
+__attribute__((no_sanitize_address))
+static size_t sse2_digits(const char* text) {
+    SCAN_BLOCK_LOOP(16, sse2_load, sse2_stop_digits)
+}
+
+__attribute__((no_sanitize_address))
+static size_t sse2_alphas(const char* text) {
+    SCAN_BLOCK_LOOP(16, sse2_load, sse2_stop_alphas)
+}
+
+/* len is inside the text, so only its own blocks are read. */
+__attribute__((no_sanitize_address))
+static size_t sse2_newlines(const char* text, size_t len, size_t* last) {
+    const char* end = text + len;
+    const char* block = (const char*)((uintptr_t)text & ~(uintptr_t)15);
+    size_t count = 0;
+
+    for (; block < end; block += 16) {
+        uint64_t mask = (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(sse2_load(block), _mm_set1_epi8('\n')));
+
+        if (block < text)
+            mask = mask >> (text - block) << (text - block);
+
+        if (end - block < 16)
+            mask &= ((uint64_t)1 << (end - block)) - 1;
+
+        if (mask == 0)
+            continue;
+
+        count += __builtin_popcountll(mask);
+        *last = (size_t)(block + 63 - __builtin_clzll(mask) - text);
+    }
+
+    return count;
+}
+
+static const ScanOps g_sse2_ops = {
+    .name = "sse2",
+    .whitespace = sse2_whitespace,
+    .comment = sse2_comment,
+    .digits = sse2_digits,
+    .alphas = sse2_alphas,
+    .newlines = sse2_newlines,
+};
+
+__attribute__((target("avx2"), no_sanitize_address))
+static inline __m256i avx2_load(const char* block) {
+    return _mm256_load_si256((const __m256i*)block);
+}
+
+__attribute__((target("avx2")))
+static __m256i avx2_in_range(__m256i bytes, char low, char high) {
+    __m256i offset = _mm256_sub_epi8(bytes, _mm256_set1_epi8(low));
+    __m256i limit = _mm256_set1_epi8((char)(high - low));
+
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, limit), offset);
+}
+
+__attribute__((target("avx2")))
+static uint64_t avx2_stop_whitespace(__m256i bytes) {
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')), avx2_in_range(bytes, '\t', '\r'));
+
+    return ~(uint64_t)(uint32_t)_mm256_movemask_epi8(space) & 0xffffffff;
+}
+
+__attribute__((target("avx2")))
+static uint64_t avx2_stop_comment(__m256i bytes) {
+    __m256i end = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(bytes, _mm256_setzero_si256()));
+
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8(end);
+}
+
+__attribute__((target("avx2")))
+static uint64_t avx2_stop_digits(__m256i bytes) {
+    return ~(uint64_t)(uint32_t)_mm256_movemask_epi8(avx2_in_range(bytes, '0', '9')) & 0xffffffff;
+}
+
+__attribute__((target("avx2")))
+static uint64_t avx2_stop_alphas(__m256i bytes) {
+    __m256i lower = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+
+    return ~(uint64_t)(uint32_t)_mm256_movemask_epi8(avx2_in_range(lower, 'a', 'z')) & 0xffffffff;
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static size_t avx2_whitespace(const char* text) {
+    SCAN_BLOCK_LOOP(32, avx2_load, avx2_stop_whitespace)
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static size_t avx2_comment(const char* text) {
+    SCAN_BLOCK_LOOP(32, avx2_load, avx2_stop_comment)
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static size_t avx2_digits(const char* text) {
+    SCAN_BLOCK_LOOP(32, avx2_load, avx2_stop_digits)
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static size_t avx2_alphas(const char* text) {
+    SCAN_BLOCK_LOOP(32, avx2_load, avx2_stop_alphas)
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static size_t avx2_newlines(const char* text, size_t len, size_t* last) {
+    const char* end = text + len;
+    const char* block = (const char*)((uintptr_t)text & ~(uintptr_t)31);
+    size_t count = 0;
+
+    for (; block < end; block += 32) {
+        uint64_t mask = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(avx2_load(block), _mm256_set1_epi8('\n')));
+
+        if (block < text)
+            mask = mask >> (text - block) << (text - block);
+
+        if (end - block < 32)
+            mask &= ((uint64_t)1 << (end - block)) - 1;
+
+        if (mask == 0)
+            continue;
+
+        count += __builtin_popcountll(mask);
+        *last = (size_t)(block + 63 - __builtin_clzll(mask) - text);
+    }
+
+    return count;
+}
+
+static const ScanOps g_avx2_ops = {
+    .name = "avx2",
+    .whitespace = avx2_whitespace,
+    .comment = avx2_comment,
+    .digits = avx2_digits,
+    .alphas = avx2_alphas,
+    .newlines = avx2_newlines,
+};
+
+#endif /* SCAN_X86 */
+
+static const ScanOps* g_ops = &g_scalar_ops;
+static pthread_once_t g_ops_once = PTHREAD_ONCE_INIT;
+
+static void pick_ops() {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        g_ops = &g_avx2_ops;
+    else if (__builtin_cpu_supports("sse2"))
+        g_ops = &g_sse2_ops;
+#endif
+}
+
+/* picks the widest implementation the cpu supports, checked through cpuid once. lexers
+ * on several threads may ask at the same time. */
+const ScanOps* scan_ops() {
+    pthread_once(&g_ops_once, pick_ops);
+
+    return g_ops;
+}
+
+/* the implementation called name, NULL when there is none or the cpu cannot run it. */
+const ScanOps* scan_ops_named(const char* name) {
+    if (strcmp(name, g_scalar_ops.name) == 0)
+        return &g_scalar_ops;
+
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+
+    if (strcmp(name, g_sse2_ops.name) == 0 && __builtin_cpu_supports("sse2"))
+        return &g_sse2_ops;
+
+    if (strcmp(name, g_avx2_ops.name) == 0 && __builtin_cpu_supports("avx2"))
+        return &g_avx2_ops;
+#endif
+
+    return NULL;
+}
@@ -0,0 +1,20 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+/* byte classifiers for the lexer. the runs stop at the first byte outside their class and
+ * never step past the terminating NUL, which is in none of them. */
+typedef struct ScanOps_t {
+    const char* name;
+    size_t (*whitespace)(const char* text); /* isspace in the C locale */
+    size_t (*comment)(const char* text); /* up to the end of the line */
+    size_t (*digits)(const char* text);
+    size_t (*alphas)(const char* text);
+    size_t (*newlines)(const char* text, size_t len, size_t* last); /* the count and where the last one is */
+} ScanOps;
+
+const ScanOps* scan_ops();
+const ScanOps* scan_ops_named(const char* name);
+
+#endif /* SCAN_H */
@@ -0,0 +1,361 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "scheduler.h"
+
+/* a ring buffer of vms, the owning worker takes from the front and
+ * requeues at the back, thieves take from the back. */
+typedef struct RunQueue_t {
+    pthread_mutex_t lock;
+    VM** items;
+    size_t head;
+    size_t len;
+    size_t cap;
+} RunQueue;
+
+struct Scheduler_t {
+    RunQueue* queues;
+    size_t workers;
+    uint64_t quantum;
+    uint64_t time_quantum; /* nanoseconds a slice goes on for, 0 for a single quantum */
+    size_t next;
+    atomic_size_t live;
+    atomic_size_t queued; /* vms waiting in all the queues together */
+    atomic_size_t idle; /* workers parked on wake */
+    pthread_mutex_t idle_lock;
+    pthread_cond_t wake;
+    StatsAggregate* stats; /* every finished vm is recorded here when set */
+};
+
+typedef struct Worker_t {
+    Scheduler* scheduler;
+    size_t id;
+} Worker;
+
+static void run_queue_init(RunQueue* queue) {
+    pthread_mutex_init(&queue->lock, NULL);
+
+    queue->items = NULL;
+    queue->head = 0;
+    queue->len = 0;
+    queue->cap = 0;
+}
+
+static void run_queue_deinit(RunQueue* queue) {
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->items);
+}
+
+/* makes room for len vms, returns 0 when out of memory. must be called with the queue locked. */
+static int run_queue_reserve(RunQueue* queue, size_t len) {
+    if (len <= queue->cap)
+        return 1;
+
+    size_t cap = queue->cap == 0 ? 64 : queue->cap;
+
+    while (cap < len)
+        cap *= 2;
+
+    VM** items = malloc(cap * sizeof(VM*));
+
+    if (!items)
+        return 0;
+
+    for (size_t i = 0; i < queue->len; i++)
+        items[i] = queue->items[(queue->head + i) % queue->cap];
+
+    free(queue->items);
+
+    queue->items = items;
+    queue->head = 0;
+    queue->cap = cap;
+
+    return 1;
+}
+
+/* never grows the queue, scheduler_spawn reserves room for every live vm up front. */
+static void run_queue_push(RunQueue* queue, VM* vm) {
+    pthread_mutex_lock(&queue->lock);
+
+    queue->items[(queue->head + queue->len) % queue->cap] = vm;
+    queue->len += 1;
+
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static VM* run_queue_pop(RunQueue* queue) {
+    VM* vm = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->len != 0) {
+        vm = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->cap;
+        queue->len -= 1;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return vm;
+}
+
+/* wakes a parked worker when there is one, with the lock it parks under so the wake
+ * cannot come between its check and its wait. */
+static void wake_idle(Scheduler* scheduler, int all) {
+    if (atomic_load(&scheduler->idle) == 0)
+        return;
+
+    pthread_mutex_lock(&scheduler->idle_lock);
+
+    if (all)
+        pthread_cond_broadcast(&scheduler->wake);
+    else
+        pthread_cond_signal(&scheduler->wake);
+
+    pthread_mutex_unlock(&scheduler->idle_lock);
+}
+
+static void scheduler_push(Scheduler* scheduler, size_t id, VM* vm) {
+    run_queue_push(&scheduler->queues[id], vm);
+    atomic_fetch_add(&scheduler->queued, 1);
+    wake_idle(scheduler, 0);
+}
+
+/* moves half of the victim's queue (at least one vm) into the thief's queue
+ * and returns one of the stolen vms to run right away. */
+static VM* run_queue_steal(Scheduler* scheduler, RunQueue* victim, size_t thief) {
+    VM* stolen[256];
+    size_t count = 0;
+
+    if (pthread_mutex_trylock(&victim->lock) != 0)
+        return NULL;
+
+    count = (victim->len + 1) / 2;
+
+    if (count > sizeof(stolen) / sizeof(stolen[0]))
+        count = sizeof(stolen) / sizeof(stolen[0]);
+
+    for (size_t i = 0; i < count; i++) {
+        victim->len -= 1;
+        stolen[i] = victim->items[(victim->head + victim->len) % victim->cap];
+    }
+
+    pthread_mutex_unlock(&victim->lock);
+
+    if (count == 0)
+        return NULL;
+
+    atomic_fetch_sub(&scheduler->queued, count);
+
+    for (size_t i = 1; i < count; i++)
+        scheduler_push(scheduler, thief, stolen[i]);
+
+    return stolen[0];
+}
+
+static VM* scheduler_next(Scheduler* scheduler, size_t id) {
+    VM* vm = run_queue_pop(&scheduler->queues[id]);
+
+    if (vm) {
+        atomic_fetch_sub(&scheduler->queued, 1);
+        return vm;
+    }
+
+    for (size_t i = 1; i < scheduler->workers; i++) {
+        size_t victim = (id + i) % scheduler->workers;
+
+        vm = run_queue_steal(scheduler, &scheduler->queues[victim], id);
+
+        if (vm)
+            return vm;
+    }
+
+    return NULL;
+}
+
+static uint64_t now_nanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/* a slice is timed as a whole and only when stats are kept or it has a time quantum,
+ * vm_run does no timing. with a time quantum the slice goes on quantum instructions at
+ * a time until the time is used up. */
+static VMStatus run_slice(Scheduler* scheduler, VM* vm) {
+    if (!scheduler->stats && scheduler->time_quantum == 0)
+        return vm_run(vm, scheduler->quantum);
+
+    uint64_t started = now_nanoseconds();
+    uint64_t now;
+    VMStatus status;
+
+    do {
+        status = vm_run(vm, scheduler->quantum);
+        now = now_nanoseconds();
+    } while (status == VM_RUNNING && now - started < scheduler->time_quantum);
+
+    if (scheduler->stats)
+        vm->stats.nanoseconds += now - started;
+
+    return status;
+}
+
+/* waits until a vm is queued or the last one finished. a vm being run is in no queue,
+ * so with fewer vms than workers the rest sleep here rather than spin. */
+static void park(Scheduler* scheduler) {
+    pthread_mutex_lock(&scheduler->idle_lock);
+    atomic_fetch_add(&scheduler->idle, 1);
+
+    while (atomic_load(&scheduler->live) != 0 && atomic_load(&scheduler->queued) == 0)
+        pthread_cond_wait(&scheduler->wake, &scheduler->idle_lock);
+
+    atomic_fetch_sub(&scheduler->idle, 1);
+    pthread_mutex_unlock(&scheduler->idle_lock);
+}
+
+static void* worker_main(void* arg) {
+    Worker* worker = arg;
+    Scheduler* scheduler = worker->scheduler;
+
+    while (atomic_load_explicit(&scheduler->live, memory_order_acquire) != 0) {
+        VM* vm = scheduler_next(scheduler, worker->id);
+
+        if (!vm) {
+            park(scheduler);
+            continue;
+        }
+
+        /* a faulted vm is finished as well, the host reads vm->fault afterwards. */
+        if (run_slice(scheduler, vm) != VM_RUNNING) {
+            if (scheduler->stats)
+                stats_record(scheduler->stats, vm);
+
+            if (atomic_fetch_sub(&scheduler->live, 1) == 1)
+                wake_idle(scheduler, 1);
+
+            continue;
+        }
+
+        scheduler_push(scheduler, worker->id, vm);
+    }
+
+    return NULL;
+}
+
+Scheduler* scheduler_init(size_t workers, uint64_t quantum) {
+    if (workers == 0 || quantum == 0)
+        return NULL;
+
+    Scheduler* scheduler = malloc(sizeof(Scheduler));
+
+    if (!scheduler)
+        return NULL;
+
+    scheduler->queues = malloc(workers * sizeof(RunQueue));
+
+    if (!scheduler->queues) {
+        free(scheduler);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < workers; i++)
+        run_queue_init(&scheduler->queues[i]);
+
+    scheduler->workers = workers;
+    scheduler->quantum = quantum;
+    scheduler->time_quantum = 0;
+    scheduler->next = 0;
+    scheduler->stats = NULL;
+    atomic_init(&scheduler->live, 0);
+    atomic_init(&scheduler->queued, 0);
+    atomic_init(&scheduler->idle, 0);
+    pthread_mutex_init(&scheduler->idle_lock, NULL);
+    pthread_cond_init(&scheduler->wake, NULL);
+
+    return scheduler;
+}
+
+void scheduler_deinit(Scheduler* scheduler) {
+    if (!scheduler)
+        return;
+
+    for (size_t i = 0; i < scheduler->workers; i++)
+        run_queue_deinit(&scheduler->queues[i]);
+
+    pthread_cond_destroy(&scheduler->wake);
+    pthread_mutex_destroy(&scheduler->idle_lock);
+    free(scheduler->queues);
+    free(scheduler);
+}
+
+/* set before scheduler_run, the aggregate has to outlive the run. */
+void scheduler_set_stats(Scheduler* scheduler, StatsAggregate* stats) {
+    scheduler->stats = stats;
+}
+
+/* set before scheduler_run. a slice then runs quantum instructions at a time until
+ * nanoseconds have passed or the vm stops, so a switch comes after about the same time
+ * whatever the instructions cost. 0, the default, switches after a single quantum. */
+void scheduler_set_time_quantum(Scheduler* scheduler, uint64_t nanoseconds) {
+    scheduler->time_quantum = nanoseconds;
+}
+
+/* vms are handed out round robin, work stealing evens out the rest. every queue gets
+ * room for all live vms, so requeueing and stealing never allocate. returns 0 and
+ * leaves vm with the caller when out of memory. */
+int scheduler_spawn(Scheduler* scheduler, VM* vm) {
+    if (!vm)
+        return 0;
+
+    size_t live = atomic_load_explicit(&scheduler->live, memory_order_relaxed) + 1;
+
+    for (size_t i = 0; i < scheduler->workers; i++) {
+        RunQueue* queue = &scheduler->queues[i];
+
+        pthread_mutex_lock(&queue->lock);
+        int ok = run_queue_reserve(queue, live);
+        pthread_mutex_unlock(&queue->lock);
+
+        if (!ok)
+            return 0;
+    }
+
+    atomic_fetch_add_explicit(&scheduler->live, 1, memory_order_relaxed);
+
+    scheduler_push(scheduler, scheduler->next, vm);
+    scheduler->next = (scheduler->next + 1) % scheduler->workers;
+
+    return 1;
+}
+
+/* runs every spawned vm until it halts, the calling thread acts as worker 0. when
+ * threads cannot be had, the ones that started steal the queues of the others. */
+void scheduler_run(Scheduler* scheduler) {
+    pthread_t* threads = malloc(scheduler->workers * sizeof(pthread_t));
+    Worker* workers = malloc(scheduler->workers * sizeof(Worker));
+    Worker first = {
+        .scheduler = scheduler,
+        .id = 0,
+    };
+    size_t started = 1;
+
+    for (size_t i = 0; workers && i < scheduler->workers; i++) {
+        workers[i].scheduler = scheduler;
+        workers[i].id = i;
+    }
+
+    while (threads && workers && started < scheduler->workers && pthread_create(&threads[started], NULL, worker_main, &workers[started]) == 0)
+        started += 1;
+
+    worker_main(&first);
+
+    for (size_t i = 1; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    free(workers);
+    free(threads);
+}
@@ -0,0 +1,21 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vm.h"
+#include "stats.h"
+
+#define SCHED_DEFAULT_QUANTUM 4096
+
+typedef struct Scheduler_t Scheduler;
+
+Scheduler* scheduler_init(size_t workers, uint64_t quantum);
+void scheduler_deinit(Scheduler* scheduler);
+int scheduler_spawn(Scheduler* scheduler, VM* vm);
+void scheduler_run(Scheduler* scheduler);
+void scheduler_set_stats(Scheduler* scheduler, StatsAggregate* stats);
+void scheduler_set_time_quantum(Scheduler* scheduler, uint64_t nanoseconds);
+
+#endif /* SCHEDULER_H */
@@ -0,0 +1,181 @@
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "simd.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#endif
+
+static void scalar_add(uint64_t* dst, const uint64_t* src) {
+    for (uint8_t i = 0; i < VECTOR_LANES; i++)
+        dst[i] += src[i];
+}
+
+static void scalar_sub(uint64_t* dst, const uint64_t* src) {
+    for (uint8_t i = 0; i < VECTOR_LANES; i++)
+        dst[i] -= src[i];
+}
+
+static void scalar_mul(uint64_t* dst, const uint64_t* src) {
+    for (uint8_t i = 0; i < VECTOR_LANES; i++)
+        dst[i] *= src[i];
+}
+
+static uint64_t scalar_sum(const uint64_t* src) {
+    uint64_t sum = 0;
+
+    for (uint8_t i = 0; i < VECTOR_LANES; i++)
+        sum += src[i];
+
+    return sum;
+}
+
+static const SimdOps g_scalar_ops = {
+    .name = "scalar",
+    .add = scalar_add,
+    .sub = scalar_sub,
+    .mul = scalar_mul,
+    .sum = scalar_sum,
+};
+
+#ifdef SIMD_X86
+
+/* there is no 64 bit lane multiply before avx512, so it is built from 32 bit halves:
+ * lo(a) * lo(b) + ((hi(a) * lo(b) + lo(a) * hi(b)) << 32). */
+static __m128i sse2_mullo_epi64(__m128i a, __m128i b) {
+    __m128i lo = _mm_mul_epu32(a, b);
+    __m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b), _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+
+    return _mm_add_epi64(lo, _mm_slli_epi64(cross, 32));
+}
+
+static void sse2_add(uint64_t* dst, const uint64_t* src) {
+    for (uint8_t i = 0; i < VECTOR_LANES; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i*)&dst[i]);
+        __m128i b = _mm_loadu_si128((const __m128i*)&src[i]);
+
+        _mm_storeu_si128((__m128i*)&dst[i], _mm_add_epi64(a, b));
+    }
+}
+
+static void sse2_sub(uint64_t* dst, const uint64_t* src) {
+    for (uint8_t i = 0; i < VECTOR_LANES; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i*)&dst[i]);
+        __m128i b = _mm_loadu_si128((const __m128i*)&src[i]);
+
+        _mm_storeu_si128((__m128i*)&dst[i], _mm_sub_epi64(a, b));
+    }
+}
+
+static void sse2_mul(uint64_t* dst, const uint64_t* src) {
+    for (uint8_t i = 0; i < VECTOR_LANES; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i*)&dst[i]);
+        __m128i b = _mm_loadu_si128((const __m128i*)&src[i]);
+
+        _mm_storeu_si128((__m128i*)&dst[i], sse2_mullo_epi64(a, b));
+    }
+}
+
+static uint64_t sse2_sum(const uint64_t* src) {
+    __m128i sum = _mm_add_epi64(_mm_loadu_si128((const __m128i*)&src[0]), _mm_loadu_si128((const __m128i*)&src[2]));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+
+    return (uint64_t)_mm_cvtsi128_si64(sum);
+}
+
+static const SimdOps g_sse2_ops = {
+    .name = "sse2",
+    .add = sse2_add,
+    .sub = sse2_sub,
+    .mul = sse2_mul,
+    .sum = sse2_sum,
+};
+
+__attribute__((target("avx2")))
+static void avx2_add(uint64_t* dst, const uint64_t* src) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)dst);
+    __m256i b = _mm256_loadu_si256((const __m256i*)src);
+
+    _mm256_storeu_si256((__m256i*)dst, _mm256_add_epi64(a, b));
+}
+
+__attribute__((target("avx2")))
+static void avx2_sub(uint64_t* dst, const uint64_t* src) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)dst);
+    __m256i b = _mm256_loadu_si256((const __m256i*)src);
+
+    _mm256_storeu_si256((__m256i*)dst, _mm256_sub_epi64(a, b));
+}
+
+__attribute__((target("avx2")))
+static void avx2_mul(uint64_t* dst, const uint64_t* src) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)dst);
+    __m256i b = _mm256_loadu_si256((const __m256i*)src);
+
+    __m256i lo = _mm256_mul_epu32(a, b);
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+
+    _mm256_storeu_si256((__m256i*)dst, _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32)));
+}
+
+__attribute__((target("avx2")))
+static uint64_t avx2_sum(const uint64_t* src) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)src);
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+
+    return (uint64_t)_mm_cvtsi128_si64(sum);
+}
+
+static const SimdOps g_avx2_ops = {
+    .name = "avx2",
+    .add = avx2_add,
+    .sub = avx2_sub,
+    .mul = avx2_mul,
+    .sum = avx2_sum,
+};
+
+#endif /* SIMD_X86 */
+
+static const SimdOps* g_ops = &g_scalar_ops;
+static pthread_once_t g_ops_once = PTHREAD_ONCE_INIT;
+
+static void pick_ops() {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        g_ops = &g_avx2_ops;
+    else if (__builtin_cpu_supports("sse2"))
+        g_ops = &g_sse2_ops;
+#endif
+}
+
+/* picks the widest implementation the cpu supports, checked through cpuid once. vms may
+ * be made on several threads at the same time. */
+const SimdOps* simd_ops() {
+    pthread_once(&g_ops_once, pick_ops);
+
+    return g_ops;
+}
+
+/* the implementation called name, NULL when there is none or the cpu cannot run it. */
+const SimdOps* simd_ops_named(const char* name) {
+    if (strcmp(name, g_scalar_ops.name) == 0)
+        return &g_scalar_ops;
+
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+
+    if (strcmp(name, g_sse2_ops.name) == 0 && __builtin_cpu_supports("sse2"))
+        return &g_sse2_ops;
+
+    if (strcmp(name, g_avx2_ops.name) == 0 && __builtin_cpu_supports("avx2"))
+        return &g_avx2_ops;
+#endif
+
+    return NULL;
+}
@@ -0,0 +1,19 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+
+#define VECTOR_LANES 4 /* 256 bits of 64 bit lanes */
+
+typedef struct SimdOps_t {
+    const char* name;
+    void (*add)(uint64_t* dst, const uint64_t* src);
+    void (*sub)(uint64_t* dst, const uint64_t* src);
+    void (*mul)(uint64_t* dst, const uint64_t* src);
+    uint64_t (*sum)(const uint64_t* src);
+} SimdOps;
+
+const SimdOps* simd_ops();
+const SimdOps* simd_ops_named(const char* name);
+
+#endif /* SIMD_H */
@@ -0,0 +1,152 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+static int write_all(int fd, const void* data, uint64_t len, uint64_t offset) {
+    const uint8_t* bytes = data;
+
+    while (len > 0) {
+        ssize_t written = pwrite(fd, bytes, len, offset);
+
+        if (written <= 0)
+            return 0;
+
+        bytes += written;
+        offset += written;
+        len -= written;
+    }
+
+    return 1;
+}
+
+static int read_all(int fd, void* data, uint64_t len, uint64_t offset) {
+    uint8_t* bytes = data;
+
+    while (len > 0) {
+        ssize_t got = pread(fd, bytes, len, offset);
+
+        if (got <= 0)
+            return 0;
+
+        bytes += got;
+        offset += got;
+        len -= got;
+    }
+
+    return 1;
+}
+
+static uint64_t page_align(uint64_t value) {
+    uint64_t page = sysconf(_SC_PAGESIZE);
+
+    return (value + page - 1) / page * page;
+}
+
+/* writes the state of vm to path, returns 0 on failure. a faulted vm cannot be saved. */
+int vm_snapshot(const VM* vm, const char* path) {
+    if (vm->fault != VM_FAULT_NONE)
+        return 0;
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.register_count = REGISTER_MAX;
+    header.vregister_count = VREGISTER_MAX;
+    header.stack_max = STACK_MAX;
+    memcpy(header.registers, vm->registers, sizeof(header.registers));
+    memcpy(header.vregisters, vm->vregisters, sizeof(header.vregisters));
+    memcpy(header.flags, vm->flags, sizeof(header.flags));
+    header.rip = vm->rip;
+    header.rsp = vm->rsp;
+    header.rcsp = vm->rcsp;
+    header.memory_size = vm->memory_size;
+
+    uint64_t offset = sizeof(header);
+    uint64_t call_stack_len = vm->rcsp * sizeof(uint64_t);
+
+    header.memory_offset = page_align(offset + vm->rsp + call_stack_len);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+        return 0;
+
+    int ok = write_all(fd, &header, sizeof(header), 0)
+            && write_all(fd, vm->stack, vm->rsp, offset)
+            && write_all(fd, vm->call_stack, call_stack_len, offset + vm->rsp)
+            && ftruncate(fd, header.memory_offset + header.memory_size) == 0
+            && write_all(fd, vm->memory, vm->memory_size, header.memory_offset);
+
+    return close(fd) == 0 && ok;
+}
+
+/* rebuilds a vm from a snapshot of a run of instructions. the memory is a private
+ * mapping of the file, pages are only read in and copied when the program touches
+ * them, so restoring is cheap and restoring the same file many times gives forks that
+ * share everything they have not written to. the restored vm starts unverified. */
+VM* vm_restore(const char* path, const uint8_t* instructions) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return NULL;
+
+    SnapshotHeader header;
+    struct stat st;
+
+    int ok = read_all(fd, &header, sizeof(header), 0)
+            && fstat(fd, &st) == 0
+            && memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0
+            && header.version == SNAPSHOT_VERSION
+            && header.register_count == REGISTER_MAX
+            && header.vregister_count == VREGISTER_MAX
+            && header.stack_max == STACK_MAX
+            && header.rsp <= STACK_MAX
+            && header.rcsp <= CALL_STACK_MAX
+            && header.memory_offset + header.memory_size <= (uint64_t)st.st_size;
+
+    VM* vm = ok ? vm_init(instructions, header.rip, 0) : NULL;
+
+    if (!vm) {
+        close(fd);
+        return NULL;
+    }
+
+    uint64_t offset = sizeof(header);
+
+    memcpy(vm->registers, header.registers, sizeof(header.registers));
+    memcpy(vm->vregisters, header.vregisters, sizeof(header.vregisters));
+    memcpy(vm->flags, header.flags, sizeof(header.flags));
+    vm->rsp = header.rsp;
+    vm->rcsp = header.rcsp;
+
+    ok = read_all(fd, vm->stack, header.rsp, offset)
+            && read_all(fd, vm->call_stack, header.rcsp * sizeof(uint64_t), offset + header.rsp);
+
+    if (ok && header.memory_size > 0) {
+        void* memory = mmap(NULL, header.memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, header.memory_offset);
+
+        if (memory == MAP_FAILED) {
+            ok = 0;
+        } else {
+            vm->memory = memory;
+            vm->memory_size = header.memory_size;
+            vm->memory_owner = VM_MEMORY_MAPPED;
+        }
+    }
+
+    close(fd);
+
+    if (!ok) {
+        vm_deinit(vm);
+        return NULL;
+    }
+
+    return vm;
+}
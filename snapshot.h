@@ -0,0 +1,33 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+#define SNAPSHOT_MAGIC "THKSNAP"
+#define SNAPSHOT_VERSION 2
+
+/* the file starts with this header, followed by the used part of the data stack and
+ * of the call stack. memory follows at memory_offset, which is page aligned so a
+ * restore can map it straight from the file. */
+typedef struct SnapshotHeader_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t register_count;
+    uint32_t vregister_count;
+    uint32_t stack_max;
+    uint64_t registers[REGISTER_MAX];
+    uint64_t vregisters[VREGISTER_MAX][VECTOR_LANES];
+    uint8_t flags[FLAGS_MAX];
+    uint64_t rip;
+    uint64_t rsp;
+    uint64_t rcsp;
+    uint64_t memory_size;
+    uint64_t memory_offset;
+} SnapshotHeader;
+
+int vm_snapshot(const VM* vm, const char* path);
+VM* vm_restore(const char* path, const uint8_t* instructions);
+
+#endif /* SNAPSHOT_H */
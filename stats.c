@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+struct StatsAggregate_t {
+    pthread_mutex_t lock;
+    StatsTotals totals;
+};
+
+StatsAggregate* stats_init() {
+    StatsAggregate* aggregate = calloc(1, sizeof(StatsAggregate));
+
+    if (!aggregate)
+        return NULL;
+
+    pthread_mutex_init(&aggregate->lock, NULL);
+
+    return aggregate;
+}
+
+void stats_deinit(StatsAggregate* aggregate) {
+    if (!aggregate)
+        return;
+
+    pthread_mutex_destroy(&aggregate->lock);
+    free(aggregate);
+}
+
+/* adds what vm counted so far, a vm recorded twice is counted twice. */
+void stats_record(StatsAggregate* aggregate, const VM* vm) {
+    pthread_mutex_lock(&aggregate->lock);
+
+    StatsTotals* totals = &aggregate->totals;
+
+    totals->vms += 1;
+
+    switch (vm_status(vm)) {
+    case VM_HALTED:
+        totals->halted += 1;
+        break;
+    case VM_FAULTED:
+        totals->faulted += 1;
+        totals->faults[vm->fault] += 1;
+        break;
+    case VM_RUNNING:
+        totals->running += 1;
+        break;
+    }
+
+    totals->sum.instructions += vm->stats.instructions;
+    totals->sum.jumps_taken += vm->stats.jumps_taken;
+    totals->sum.pushes += vm->stats.pushes;
+    totals->sum.pops += vm->stats.pops;
+    totals->sum.nanoseconds += vm->stats.nanoseconds;
+
+    if (vm->stats.max_rsp > totals->sum.max_rsp)
+        totals->sum.max_rsp = vm->stats.max_rsp;
+
+    pthread_mutex_unlock(&aggregate->lock);
+}
+
+StatsTotals stats_totals(StatsAggregate* aggregate) {
+    pthread_mutex_lock(&aggregate->lock);
+    StatsTotals totals = aggregate->totals;
+    pthread_mutex_unlock(&aggregate->lock);
+
+    return totals;
+}
+
+static const char* status_name(VMStatus status) {
+    switch (status) {
+    case VM_RUNNING: return "running";
+    case VM_HALTED:  return "halted";
+    case VM_FAULTED: return "faulted";
+    }
+
+    return "unknown";
+}
+
+/* the counters as the middle of a json object or as lines of text. */
+static void dump_counters(FILE* file, const VMStats* stats, StatsFormat format) {
+    if (format == STATS_JSON) {
+        fprintf(file, "\"instructions\": %lu, \"jumps_taken\": %lu, \"pushes\": %lu, \"pops\": %lu, \"max_rsp\": %lu, \"stack_max\": %d, \"nanoseconds\": %lu",
+                stats->instructions, stats->jumps_taken, stats->pushes, stats->pops, stats->max_rsp, STACK_MAX, stats->nanoseconds);
+        return;
+    }
+
+    fprintf(file, "instructions: %lu\n", stats->instructions);
+    fprintf(file, "jumps taken: %lu\n", stats->jumps_taken);
+    fprintf(file, "pushes: %lu\n", stats->pushes);
+    fprintf(file, "pops: %lu\n", stats->pops);
+    fprintf(file, "max rsp: %lu of %d\n", stats->max_rsp, STACK_MAX);
+    fprintf(file, "wall time: %lu ns\n", stats->nanoseconds);
+}
+
+void stats_dump_vm(FILE* file, const VM* vm, StatsFormat format) {
+    VMStatus status = vm_status(vm);
+
+    if (format == STATS_JSON) {
+        fprintf(file, "{\"status\": \"%s\", ", status_name(status));
+
+        if (status == VM_FAULTED)
+            fprintf(file, "\"fault\": \"%s\", \"fault_rip\": %lu, ", vm_fault_name(vm->fault), vm->fault_rip);
+
+        dump_counters(file, &vm->stats, format);
+        fprintf(file, "}\n");
+        return;
+    }
+
+    fprintf(file, "status: %s\n", status_name(status));
+
+    if (status == VM_FAULTED)
+        fprintf(file, "fault: %s at rip %lu\n", vm_fault_name(vm->fault), vm->fault_rip);
+
+    dump_counters(file, &vm->stats, format);
+}
+
+/* only the faults that happened are listed. */
+void stats_dump_totals(FILE* file, const StatsTotals* totals, StatsFormat format) {
+    if (format == STATS_JSON) {
+        fprintf(file, "{\"vms\": %lu, \"halted\": %lu, \"faulted\": %lu, \"running\": %lu, \"faults\": {", totals->vms, totals->halted, totals->faulted, totals->running);
+
+        const char* separator = "";
+
+        for (int fault = VM_FAULT_NONE + 1; fault < VM_FAULT_COUNT; fault++) {
+            if (totals->faults[fault] == 0)
+                continue;
+
+            fprintf(file, "%s\"%s\": %lu", separator, vm_fault_name(fault), totals->faults[fault]);
+            separator = ", ";
+        }
+
+        fprintf(file, "}, ");
+        dump_counters(file, &totals->sum, format);
+        fprintf(file, "}\n");
+        return;
+    }
+
+    fprintf(file, "vms: %lu\n", totals->vms);
+    fprintf(file, "halted: %lu\n", totals->halted);
+    fprintf(file, "faulted: %lu\n", totals->faulted);
+
+    for (int fault = VM_FAULT_NONE + 1; fault < VM_FAULT_COUNT; fault++) {
+        if (totals->faults[fault] != 0)
+            fprintf(file, "    %s: %lu\n", vm_fault_name(fault), totals->faults[fault]);
+    }
+
+    fprintf(file, "running: %lu\n", totals->running);
+    dump_counters(file, &totals->sum, format);
+}
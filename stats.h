@@ -0,0 +1,35 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+typedef enum StatsFormat_t {
+    STATS_TEXT,
+    STATS_JSON,
+} StatsFormat;
+
+/* the counters of every vm recorded, max_rsp is the highest any of them reached. */
+typedef struct StatsTotals_t {
+    uint64_t vms;
+    uint64_t halted;
+    uint64_t faulted;
+    uint64_t running; /* recorded before they were done */
+    uint64_t faults[VM_FAULT_COUNT];
+    VMStats sum;
+} StatsTotals;
+
+/* adds up the counters of many vms, one lock covers it so vms finishing on different
+ * threads can be recorded into the same one. keep one per program to find the hot ones. */
+typedef struct StatsAggregate_t StatsAggregate;
+
+StatsAggregate* stats_init();
+void stats_deinit(StatsAggregate* aggregate);
+void stats_record(StatsAggregate* aggregate, const VM* vm);
+StatsTotals stats_totals(StatsAggregate* aggregate);
+void stats_dump_vm(FILE* file, const VM* vm, StatsFormat format);
+void stats_dump_totals(FILE* file, const StatsTotals* totals, StatsFormat format);
+
+#endif /* STATS_H */
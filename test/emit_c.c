@@ -0,0 +1,73 @@
+#include <string.h>
+
+#include "thorkell.h"
+#include "test.h"
+
+/* runs the program on stdin through vm_execute and through prog_execute, the same
+ * program turned into C by thorkell --emit-c prog and linked in, then compares every
+ * part of the two vms a program can change. -O assembles it the way the emitted C was. */
+
+VM* prog_init(uint64_t memory_size);
+void prog_execute(VM* vm);
+
+static const char* difference(const VM* a, const VM* b) {
+    if (memcmp(a->registers, b->registers, sizeof(a->registers)))
+        return "registers";
+    if (memcmp(a->vregisters, b->vregisters, sizeof(a->vregisters)))
+        return "vregisters";
+    if (memcmp(a->flags, b->flags, sizeof(a->flags)))
+        return "flags";
+    if (a->rsp != b->rsp || memcmp(a->stack, b->stack, a->rsp))
+        return "stack";
+    if (a->rcsp != b->rcsp || memcmp(a->call_stack, b->call_stack, a->rcsp * sizeof(a->call_stack[0])))
+        return "call stack";
+    if (a->rip != b->rip)
+        return "rip";
+    if (a->fault != b->fault || a->fault_rip != b->fault_rip)
+        return "fault";
+    if (a->memory_size != b->memory_size || memcmp(a->memory, b->memory, a->memory_size))
+        return "memory";
+
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    int flags = argc > 1 && !strcmp(argv[1], "-O") ? THORKELL_OPTIMIZE : 0;
+    char* source = test_read_stdin();
+    ThorkellProgram program;
+    ThorkellError error;
+
+    test_register_natives();
+
+    if (thorkell_assemble(source, flags, &program, &error) != THORKELL_OK) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        return 1;
+    }
+
+    VM* interpreted = thorkell_load(&program, MEMORY_DEFAULT, &error);
+
+    if (!interpreted) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        return 1;
+    }
+
+    VM* compiled = prog_init(MEMORY_DEFAULT);
+
+    test_fill_memory(interpreted);
+    test_fill_memory(compiled);
+    vm_execute(interpreted);
+    prog_execute(compiled);
+
+    const char* different = difference(interpreted, compiled);
+
+    if (different)
+        fprintf(stderr, "DIFFERENT: %s, %s at rip %lu against %s at rip %lu\n", different,
+                vm_fault_name(interpreted->fault), interpreted->rip, vm_fault_name(compiled->fault), compiled->rip);
+
+    vm_deinit(interpreted);
+    vm_deinit(compiled);
+    thorkell_program_free(&program);
+    free(source);
+
+    return different != NULL;
+}
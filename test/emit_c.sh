@@ -0,0 +1,47 @@
+#!/bin/sh
+# checks thorkell --emit-c against the interpreter: the programs of test/corpus and a
+# random program from gen for every seed are emitted as C with and without -O,
+# compiled, linked into the emit_c host and run both ways. any failure or any
+# difference between the two runs fails the test.
+# usage: emit_c.sh build_dir [seeds], run by make test.
+
+BUILD=${1:-build}
+SEEDS=${2:-150}
+CC=${CC:-cc}
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+compared=0
+failed=0
+
+# check name program
+check() {
+    for optimize in "" -O; do
+        if ! "$BUILD/thorkell" $optimize --emit-c prog "$2" > "$WORK/prog.c" 2> "$WORK/error"; then
+            echo "$1 $optimize: --emit-c failed: $(cat "$WORK/error")"
+            failed=$((failed + 1))
+        elif ! $CC -O1 -w -I. -o "$WORK/host" "$BUILD/test/emit_c.o" "$WORK/prog.c" "$BUILD/libthorkell.a" -lpthread; then
+            echo "$1 $optimize: the emitted C does not compile"
+            failed=$((failed + 1))
+        elif ! "$WORK/host" $optimize < "$2"; then
+            echo "$1 $optimize: the runs differ"
+            failed=$((failed + 1))
+        else
+            compared=$((compared + 1))
+        fi
+    done
+}
+
+for program in test/corpus/*.tk; do
+    check "$program" "$program"
+done
+
+seed=1
+while [ "$seed" -le "$SEEDS" ]; do
+    "$BUILD/test/gen" "$seed" > "$WORK/prog.tk"
+    check "seed $seed" "$WORK/prog.tk"
+    seed=$((seed + 1))
+done
+
+echo "emit-c: $compared programs the same, $failed failed"
+[ "$failed" -eq 0 ]
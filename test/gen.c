@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/* prints a random program for the seed given, with straight line segments, counted
+ * loops, bounded jumps back, a helper called from them, natives, pushes, signed and
+ * checked arithmetic, vector ops, divisions and memory accesses that may fault. every
+ * jump back takes RD down by one from 40 and stops once it wraps, so each program ends.
+ * RD guards through cmp, through the borrow of subo against RK and through the
+ * overflow of subo against RH, INT64_MIN. the hosts register natives 0 and 1 from
+ * test.h, 2 is left unknown. */
+
+static uint64_t g_state;
+
+static uint64_t next() {
+    uint64_t z = (g_state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+
+    return z ^ (z >> 31);
+}
+
+static int below(int n) {
+    return (int)(next() % (uint64_t)n);
+}
+
+static const char* reg() {
+    static const char* registers[] = { "RA", "RB", "RC" };
+
+    return registers[below(3)];
+}
+
+static const char* vreg() {
+    static const char* registers[] = { "VA", "VB", "VC" };
+
+    return registers[below(3)];
+}
+
+static const char* arithmetic() {
+    static const char* names[] = { "add", "sub", "mul" };
+
+    return names[below(3)];
+}
+
+static const char* checked() {
+    static const char* names[] = { "addo", "subo", "mulo" };
+
+    return names[below(3)];
+}
+
+static const char* vector() {
+    static const char* names[] = { "vadd", "vsub", "vmul" };
+
+    return names[below(3)];
+}
+
+static void jump_back(const int* plain, int plain_count) {
+    char label = 'a' + plain[below(plain_count)];
+
+    switch (below(3)) {
+    case 0:
+        printf("sub RD, 1\ncmp RD, 1000\njl L%c\n", label);
+        break;
+    case 1:
+        printf("sub RD, 1\nmove RG, RD\nsubo RG, RK\njc L%c\n", label);
+        break;
+    default:
+        printf("sub RD, 1\nmove RG, RD\nsubo RG, RH\njo L%c\n", label);
+        break;
+    }
+}
+
+int main(int argc, char** argv) {
+    g_state = argc > 1 ? strtoull(argv[1], NULL, 10) : 0;
+
+    int plain[6];
+    int plain_count = 0;
+    int helper = below(3) == 0;
+    int segments = 1 + below(6);
+
+    if (helper)
+        printf("Lh: add RA, 1\nmul RB, 3\ncmp RA, RB\nret\n");
+
+    printf("start: move RD, 40\nmove RE, %d\nmove RH, 9223372036854775808\nmove RK, 1000\n", 8 * below(10));
+    printf("move RI, %d\nmove RJ, %d\n", 8 * below(40), below(64));
+
+    /* the optimizer drops code nothing reaches, the helper is called at least once. */
+    if (helper)
+        printf("call Lh\n");
+
+    for (int s = 0; s < segments; s++) {
+        if (below(10) < 4) {
+            const char* counter = below(2) ? "RB" : "RC";
+
+            printf("move %s, %d\nL%c:\n", counter, 1 + below(30), 'a' + s);
+
+            for (int i = below(4); i > 0; i--) {
+                const char* r = below(2) ? "RA" : (counter[1] == 'B' ? "RC" : "RB");
+
+                printf("%s %s, %d\n", below(2) ? "add" : "sub", r, below(10));
+            }
+
+            printf("sub %s, 1\ncmp %s, 0\n%s L%c\n", counter, counter, below(2) ? "jg" : "jne", 'a' + s);
+            continue;
+        }
+
+        printf("L%c:\n", 'a' + s);
+        plain[plain_count++] = s;
+
+        for (int i = 1 + below(10); i > 0; i--) {
+            int k = below(160);
+
+            if (k < 12)
+                printf("move %s, %d\n", reg(), below(21));
+            else if (k < 24)
+                printf("move %s, %s\n", reg(), reg());
+            else if (k < 36)
+                printf("%s %s, %d\n", arithmetic(), reg(), below(10));
+            else if (k < 44)
+                printf("div %s, %d\n", reg(), 1 + below(5));
+            else if (k < 47)
+                printf("div %s, RD\n", reg());
+            else if (k < 48)
+                printf("div %s, %s\n", reg(), reg());
+            else if (k < 58)
+                printf("%s %s, %s\n", arithmetic(), reg(), reg());
+            else if (k < 66)
+                printf("cmp %s, %d\n", reg(), below(21));
+            else if (k < 72)
+                printf("push %s\npop %s\n", reg(), reg());
+            else if (k < 76)
+                printf("storeq %s, RE\n", reg());
+            else if (k < 80)
+                printf("loadq %s, RE, %d\n", reg(), 8 * below(4));
+            else if (k < 84 && helper)
+                printf("call Lh\n");
+            else if (k < 92 && s > 0 && plain_count > 1)
+                jump_back(plain, plain_count - 1);
+            else if (k < 95)
+                printf("sdiv %s, %s\n", reg(), below(2) ? "18446744073709551615" : "3");
+            else if (k < 97)
+                printf("sdiv %s, %s\n", reg(), reg());
+            else if (k < 101)
+                printf("scmp %s, %s\n", reg(), reg());
+            else if (k < 104)
+                printf("scmp %s, %s\n", reg(), below(2) ? "18446744073709551611" : "7");
+            else if (k < 110)
+                printf("%s %s, %s\n", checked(), reg(), below(4) ? reg() : "RH");
+            else if (k < 113)
+                printf("wmul %s, %s, %s\n", reg(), reg(), reg());
+            else if (k < 117)
+                printf("vsplat %s, %s\n", vreg(), reg());
+            else if (k < 122)
+                printf("%s %s, %s\n", vector(), vreg(), vreg());
+            else if (k < 124)
+                printf("vsum %s, %s\n", reg(), vreg());
+            else if (k < 127)
+                printf("vload %s, RE, %d\n", vreg(), 8 * below(4));
+            else if (k < 130)
+                printf("vstore %s, RE, %d\n", vreg(), 8 * below(4));
+            else if (k < 133)
+                printf("memcpy RE, RI, RJ\n");
+            else if (k < 135)
+                printf("memset RI, %s, RJ\n", reg());
+            else if (k < 139)
+                printf("callnative %d\n", below(10) ? below(2) : 2);
+            else
+                printf("cmp %s, %s\n", reg(), reg());
+        }
+
+        if (below(5) == 0 && s > 0 && plain_count > 1)
+            jump_back(plain, plain_count - 1);
+    }
+
+    printf("halt\n");
+
+    return 0;
+}
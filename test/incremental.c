@@ -0,0 +1,167 @@
+#include <string.h>
+
+#include "incremental.h"
+#include "test.h"
+
+#define TEST_EDITS 300
+
+/* types the program on stdin into an incremental assembler and then makes random edits
+ * to it: digits changed, lines deleted and copied, and pieces of other lines pasted
+ * over the text. after every edit the assembler has to agree with thorkell_assemble on
+ * the edited source, the same code and start_rip or the same error. a rejected edit has
+ * to leave the program as it was and is not made to the source. */
+
+static uint64_t g_state;
+
+static uint64_t next() {
+    uint64_t z = (g_state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+
+    return z ^ (z >> 31);
+}
+
+static size_t below(size_t n) {
+    return n > 0 ? next() % n : 0;
+}
+
+/* the start of a random line of source, len for the end of it. */
+static size_t line_start(const char* source, size_t len) {
+    size_t at = below(len + 1);
+
+    while (at > 0 && at < len && source[at - 1] != '\n')
+        at -= 1;
+
+    return at;
+}
+
+static size_t line_len(const char* source, size_t len, size_t at) {
+    const char* end = memchr(&source[at], '\n', len - at);
+
+    return end ? (size_t)(end - &source[at]) + 1 : len - at;
+}
+
+static int same_program(const ThorkellProgram* a, const ThorkellProgram* b) {
+    if (cvector_size(a->code) != cvector_size(b->code) || a->start_rip != b->start_rip)
+        return 0;
+
+    return cvector_size(a->code) == 0 || !memcmp(a->code, b->code, cvector_size(a->code));
+}
+
+/* an edit of source as an offset, the bytes it removes and the text it puts there. */
+static void random_edit(const char* source, size_t len, const char* original, size_t* offset, size_t* removed, char* text) {
+    size_t original_len = strlen(original);
+    size_t from = line_start(original, original_len);
+    size_t copy = line_len(original, original_len, from);
+
+    *offset = line_start(source, len);
+    *removed = 0;
+    text[0] = 0;
+
+    switch (below(4)) {
+    case 0: /* a digit, which mostly keeps every size */
+        for (size_t i = 0; i < 64 && *offset < len; i++, (*offset)++) {
+            if (source[*offset] >= '0' && source[*offset] <= '9') {
+                *removed = 1;
+                text[0] = '0' + below(10);
+                text[1] = 0;
+                return;
+            }
+        }
+
+        *offset = len;
+        break;
+    case 1:
+        *removed = line_len(source, len, *offset);
+        break;
+    case 2:
+        memcpy(text, &original[from], copy);
+        text[copy] = 0;
+        break;
+    default: /* anywhere and mostly not a whole line */
+        *offset = below(len + 1);
+        *removed = below(len - *offset + 1) % 9;
+        copy = below(copy + 1) % 13;
+        memcpy(text, &original[from], copy);
+        text[copy] = 0;
+        break;
+    }
+}
+
+int main(int argc, char** argv) {
+    char* original = test_read_stdin();
+    size_t capacity = 2 * strlen(original) + 4096;
+    char* source = calloc(capacity, 1);
+    char* edited = calloc(capacity, 1);
+    char* text = malloc(strlen(original) + 1);
+    IncrementalAssembler* assembler = incremental_init();
+    ThorkellProgram expected = { 0 };
+    int failed = 0;
+
+    g_state = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+
+    if (!source || !edited || !text || !assembler) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+
+    for (int i = 0; i <= TEST_EDITS && !failed; i++) {
+        size_t len = strlen(source);
+        size_t offset = 0;
+        size_t removed = 0;
+
+        if (i == 0)
+            strcpy(text, original);
+        else
+            random_edit(source, len, original, &offset, &removed, text);
+
+        size_t inserted = strlen(text);
+
+        if (len - removed + inserted >= capacity)
+            continue;
+
+        memcpy(edited, source, offset);
+        memcpy(&edited[offset], text, inserted);
+        strcpy(&edited[offset + inserted], &source[offset + removed]);
+
+        ThorkellProgram program;
+        ThorkellError want;
+        ThorkellError got;
+        ThorkellStatus want_status = thorkell_assemble(edited, 0, &program, &want);
+        ThorkellStatus got_status = incremental_edit(assembler, offset, removed, text, &got);
+
+        if (want_status != got_status) {
+            fprintf(stderr, "DIFFERENT: edit %d is %s, not %s: %s\n", i, thorkell_status_name(got_status), thorkell_status_name(want_status),
+                    want_status != THORKELL_OK ? want.message : got.message);
+            failed = 1;
+        } else if (want_status != THORKELL_OK) {
+            if (want.line != got.line || want.col != got.col || strcmp(want.message, got.message)) {
+                fprintf(stderr, "DIFFERENT: edit %d fails at %zu:%zu, not %zu:%zu: %s\n", i, got.line, got.col, want.line, want.col, want.message);
+                failed = 1;
+            } else if (!same_program(incremental_program(assembler), &expected)) {
+                fprintf(stderr, "DIFFERENT: edit %d was rejected and changed the program\n", i);
+                failed = 1;
+            }
+        } else if (!same_program(incremental_program(assembler), &program)) {
+            fprintf(stderr, "DIFFERENT: edit %d assembled other code\n", i);
+            failed = 1;
+        } else {
+            thorkell_program_free(&expected);
+            expected = program;
+            strcpy(source, edited);
+            continue;
+        }
+
+        if (want_status == THORKELL_OK)
+            thorkell_program_free(&program);
+    }
+
+    thorkell_program_free(&expected);
+    incremental_deinit(assembler);
+    free(text);
+    free(edited);
+    free(source);
+    free(original);
+
+    return failed;
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+# checks the incremental assembler against thorkell_assemble: the programs of test/corpus
+# and a random program from gen for every seed are typed into the incremental host and
+# edited at random, see test/incremental.c.
+# usage: incremental.sh build_dir [seeds], run by make test.
+
+BUILD=${1:-build}
+SEEDS=${2:-300}
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+compared=0
+failed=0
+
+# check name program seed
+check() {
+    if "$BUILD/test/incremental" "$3" < "$2"; then
+        compared=$((compared + 1))
+    else
+        echo "$1: the incremental assembler differs"
+        failed=$((failed + 1))
+    fi
+}
+
+for program in test/corpus/*.tk; do
+    check "$program" "$program" 1
+done
+
+seed=1
+while [ "$seed" -le "$SEEDS" ]; do
+    "$BUILD/test/gen" "$seed" > "$WORK/prog.tk"
+    check "seed $seed" "$WORK/prog.tk" "$seed"
+    seed=$((seed + 1))
+done
+
+echo "incremental: $compared programs edited the same, $failed failed"
+[ "$failed" -eq 0 ]
@@ -0,0 +1,130 @@
+#include <string.h>
+
+#include "thorkell.h"
+#include "test.h"
+
+/* runs the program on stdin assembled as it is and with THORKELL_OPTIMIZE, then compares
+ * every part of the two vms a program can change. the optimizer drops and rewrites
+ * instructions, so code addresses are compared by where they are in the program. */
+
+/* where ip is, counted in the instructions the optimizer keeps as they are: the ones
+ * that can fault and halt, divisions aside, which constants may turn into immediate
+ * ones or drop. the instruction at ip is part of it with its immediate forms folded. */
+typedef struct Position_t {
+    uint64_t kept;
+    uint8_t instruction;
+} Position;
+
+static int kept(uint8_t instruction) {
+    switch (instruction) {
+    case INS_HALT:
+    case INS_IPUSH:
+    case INS_PUSH:
+    case INS_POP:
+    case INS_CALL:
+    case INS_RET:
+    case INS_LOADB:
+    case INS_LOADW:
+    case INS_LOADD:
+    case INS_LOADQ:
+    case INS_STOREB:
+    case INS_STOREW:
+    case INS_STORED:
+    case INS_STOREQ:
+    case INS_MEMCPY:
+    case INS_MEMSET:
+    case INS_VLOAD:
+    case INS_VSTORE:
+    case INS_CALLNATIVE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static Position position_of(const ThorkellProgram* program, uint64_t ip) {
+    Position position = { .kept = 0, .instruction = INS_COUNT };
+    uint64_t at = 0;
+
+    while (at < ip && at < cvector_size(program->code)) {
+        position.kept += kept(program->code[at + 1]);
+        at += program->code[at];
+    }
+
+    if (at == ip && at < cvector_size(program->code)) {
+        uint8_t instruction = program->code[at + 1];
+
+        position.instruction = instruction == INS_IDIV ? INS_DIV : instruction == INS_ISDIV ? INS_SDIV : instruction;
+    }
+
+    return position;
+}
+
+static int same_position(const ThorkellProgram* a, uint64_t a_ip, const ThorkellProgram* b, uint64_t b_ip) {
+    Position a_position = position_of(a, a_ip);
+    Position b_position = position_of(b, b_ip);
+
+    return a_position.kept == b_position.kept && a_position.instruction == b_position.instruction;
+}
+
+static const char* difference(const ThorkellProgram* a_program, const VM* a, const ThorkellProgram* b_program, const VM* b) {
+    if (memcmp(a->registers, b->registers, sizeof(a->registers)))
+        return "registers";
+    if (memcmp(a->vregisters, b->vregisters, sizeof(a->vregisters)))
+        return "vregisters";
+    if (memcmp(a->flags, b->flags, sizeof(a->flags)))
+        return "flags";
+    if (a->rsp != b->rsp || memcmp(a->stack, b->stack, a->rsp))
+        return "stack";
+    if (a->rcsp != b->rcsp)
+        return "call stack";
+
+    for (uint64_t i = 0; i < a->rcsp; i++) {
+        if (!same_position(a_program, a->call_stack[i], b_program, b->call_stack[i]))
+            return "call stack";
+    }
+
+    if (!same_position(a_program, a->rip, b_program, b->rip))
+        return "rip";
+    if (a->fault != b->fault || (a->fault != VM_FAULT_NONE && !same_position(a_program, a->fault_rip, b_program, b->fault_rip)))
+        return "fault";
+    if (a->memory_size != b->memory_size || memcmp(a->memory, b->memory, a->memory_size))
+        return "memory";
+
+    return NULL;
+}
+
+int main() {
+    char* source = test_read_stdin();
+    ThorkellProgram programs[2];
+    VM* vms[2];
+    ThorkellError error;
+
+    test_register_natives();
+
+    for (int i = 0; i < 2; i++) {
+        if (thorkell_assemble(source, i ? THORKELL_OPTIMIZE : 0, &programs[i], &error) != THORKELL_OK
+                || !(vms[i] = thorkell_load(&programs[i], MEMORY_DEFAULT, &error))) {
+            fprintf(stderr, "ERROR: %s\n", error.message);
+            return 1;
+        }
+
+        test_fill_memory(vms[i]);
+        vm_execute(vms[i]);
+    }
+
+    const char* different = difference(&programs[0], vms[0], &programs[1], vms[1]);
+
+    if (different)
+        fprintf(stderr, "DIFFERENT: %s, %s at rip %lu against %s at rip %lu once optimized\n", different,
+                vm_fault_name(vms[0]->fault), vms[0]->rip, vm_fault_name(vms[1]->fault), vms[1]->rip);
+
+    for (int i = 0; i < 2; i++) {
+        vm_deinit(vms[i]);
+        thorkell_program_free(&programs[i]);
+    }
+
+    free(source);
+
+    return different != NULL;
+}
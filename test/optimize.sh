@@ -0,0 +1,37 @@
+#!/bin/sh
+# checks THORKELL_OPTIMIZE against plain code: the programs of test/corpus and a random
+# program from gen for every seed are run by the optimize host assembled both ways and
+# compared.
+# usage: optimize.sh build_dir [seeds], run by make test.
+
+BUILD=${1:-build}
+SEEDS=${2:-1000}
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+compared=0
+failed=0
+
+# check name program
+check() {
+    if "$BUILD/test/optimize" < "$2"; then
+        compared=$((compared + 1))
+    else
+        echo "$1: the optimized run differs"
+        failed=$((failed + 1))
+    fi
+}
+
+for program in test/corpus/*.tk; do
+    check "$program" "$program"
+done
+
+seed=1
+while [ "$seed" -le "$SEEDS" ]; do
+    "$BUILD/test/gen" "$seed" > "$WORK/prog.tk"
+    check "seed $seed" "$WORK/prog.tk"
+    seed=$((seed + 1))
+done
+
+echo "optimize: $compared programs the same, $failed failed"
+[ "$failed" -eq 0 ]
@@ -0,0 +1,65 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "thorkell.h"
+
+/* shared by the test hosts, each reads the program it checks from stdin and runs it
+ * with the same natives registered. */
+
+/* mixes RB into RA, sets the equal flag from it and pushes it while there is room. */
+static inline void test_native_mix(VM* vm) {
+    REG(0) = REG(0) * 31 + REG(1);
+    FEQ = REG(0) & 1;
+
+    if (vm->rsp + sizeof(uint64_t) <= STACK_MAX) {
+        memcpy(&vm->stack[vm->rsp], &REG(0), sizeof(uint64_t));
+        vm->rsp += sizeof(uint64_t);
+    }
+}
+
+/* writes RC to memory at RI and faults on an RA that is a multiple of 5. */
+static inline void test_native_check(VM* vm) {
+    uint8_t* to = vm_native_memory(vm, REG(8), sizeof(uint64_t));
+
+    if (to)
+        memcpy(to, &REG(2), sizeof(uint64_t));
+
+    if (REG(0) % 5 == 0)
+        vm_fault(vm, VM_FAULT_NATIVE);
+}
+
+/* the same words in memory for every run, so loads see more than zeros. */
+static inline void test_fill_memory(VM* vm) {
+    for (uint64_t i = 0; i + sizeof(uint64_t) <= vm->memory_size; i += sizeof(uint64_t)) {
+        uint64_t word = i / sizeof(uint64_t) * 3 + 1;
+        memcpy(&vm->memory[i], &word, sizeof(word));
+    }
+}
+
+static inline void test_register_natives() {
+    vm_register_native(0, "mix", test_native_mix);
+    vm_register_native(1, "check", test_native_check);
+}
+
+static inline char* test_read_stdin() {
+    size_t len = 0;
+    size_t capacity = 4096;
+    char* source = malloc(capacity);
+
+    for (size_t n; (n = fread(source + len, 1, capacity - len - 1, stdin)) > 0;) {
+        len += n;
+
+        if (capacity - len == 1)
+            source = realloc(source, capacity *= 2);
+    }
+
+    source[len] = '\0';
+
+    return source;
+}
+
+#endif /* TEST_H */
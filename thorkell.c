@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "thorkell.h"
+#include "parser.h"
+#include "cfg.h"
+#include "opt.h"
+#include "verify.h"
+#include "aot.h"
+#include "embed.h"
+#include "layout.h"
+
+static ThorkellStatus set_error(ThorkellError* error, ThorkellStatus status, const char* message) {
+    if (!error)
+        return status;
+
+    memset(error, 0, sizeof(ThorkellError));
+    error->status = status;
+    snprintf(error->message, sizeof(error->message), "%s", message);
+
+    return status;
+}
+
+/* parses and optionally optimizes source, the symbols stay valid until parser_deinit.
+ * with symbol_entries the optimizer keeps every label a valid place to start at. */
+static ThorkellStatus parse(const char* source, int flags, int symbol_entries, cvector_vector_type(ParsedInstruction)* parsed_instructions, uint64_t* start_rip, ThorkellError* error) {
+    *parsed_instructions = NULL;
+    *start_rip = 0;
+
+    if (!parser_init(source))
+        return set_error(error, THORKELL_ERROR_SYNTAX, "no source");
+
+    *parsed_instructions = parser_start(start_rip);
+
+    const ParseError* parse_error = parser_error();
+
+    if (parse_error) {
+        set_error(error, THORKELL_ERROR_SYNTAX, parse_error->message);
+
+        if (error) {
+            error->line = parse_error->line;
+            error->col = parse_error->col;
+        }
+
+        return THORKELL_ERROR_SYNTAX;
+    }
+
+    /* the optimizer leaves programs it cannot analyse untouched, so its result is advisory. */
+    if (flags & THORKELL_OPTIMIZE)
+        optimize(parsed_instructions, start_rip, parser_symbols(), symbol_entries);
+
+    return set_error(error, THORKELL_OK, "");
+}
+
+ThorkellStatus thorkell_assemble(const char* source, int flags, ThorkellProgram* program, ThorkellError* error) {
+    cvector_vector_type(ParsedInstruction) parsed_instructions = NULL;
+
+    program->code = NULL;
+    program->start_rip = 0;
+
+    ThorkellStatus status = parse(source, flags, 0, &parsed_instructions, &program->start_rip, error);
+
+    if (status == THORKELL_OK)
+        program->code = parsed_instructions_codegen(parsed_instructions);
+
+    cvector_free(parsed_instructions);
+    parser_deinit();
+
+    return status;
+}
+
+/* assembles source with its blocks laid out for profile, which has to be from a run of
+ * what source assembles to with the same flags. a program the layout cannot analyse
+ * comes out in source order, like the optimizer leaves it. */
+ThorkellStatus thorkell_assemble_profiled(const char* source, int flags, const Profile* profile, ThorkellProgram* program, LayoutStats* stats, ThorkellError* error) {
+    cvector_vector_type(ParsedInstruction) parsed_instructions = NULL;
+
+    program->code = NULL;
+    program->start_rip = 0;
+
+    if (stats)
+        memset(stats, 0, sizeof(LayoutStats));
+
+    ThorkellStatus status = parse(source, flags, 0, &parsed_instructions, &program->start_rip, error);
+
+    if (status == THORKELL_OK) {
+        cvector_vector_type(uint8_t) code = parsed_instructions_codegen(parsed_instructions);
+
+        if (!profile_matches(profile, code, cvector_size(code))) {
+            status = set_error(error, THORKELL_ERROR_PROGRAM, "the profile was recorded on different code");
+        } else if (layout_blocks(&parsed_instructions, &program->start_rip, parser_symbols(), profile, stats) < 0) {
+            program->code = code;
+            code = NULL;
+        } else {
+            program->code = parsed_instructions_codegen(parsed_instructions);
+        }
+
+        cvector_free(code);
+    }
+
+    cvector_free(parsed_instructions);
+    parser_deinit();
+
+    return status;
+}
+
+void thorkell_program_free(ThorkellProgram* program) {
+    cvector_free(program->code);
+
+    program->code = NULL;
+    program->start_rip = 0;
+}
+
+/* verifies the bytecode before handing out a vm, programs that are proven stack safe
+ * run on the unchecked interpreter. */
+VM* thorkell_load(const ThorkellProgram* program, uint64_t memory_size, ThorkellError* error) {
+    Verification verification = verify_program(program->code, cvector_size(program->code), program->start_rip);
+
+    if (!verification.ok) {
+        set_error(error, THORKELL_ERROR_VERIFY, verification.message);
+
+        if (error)
+            error->rip = verification.rip;
+
+        return NULL;
+    }
+
+    VM* vm = vm_init(program->code, program->start_rip, memory_size);
+
+    if (!vm) {
+        set_error(error, THORKELL_ERROR_MEMORY, "cannot allocate the vm");
+        return NULL;
+    }
+
+    vm->verified = verification.stack_safe;
+    set_error(error, THORKELL_OK, "");
+
+    return vm;
+}
+
+/* runs vm until it halts or faults. */
+ThorkellStatus thorkell_execute(VM* vm, ThorkellError* error) {
+    if (!vm)
+        return set_error(error, THORKELL_ERROR_MEMORY, "no vm");
+
+    vm_execute(vm);
+
+    if (vm->fault == VM_FAULT_NONE)
+        return set_error(error, THORKELL_OK, "");
+
+    set_error(error, THORKELL_ERROR_FAULT, vm_fault_name(vm->fault));
+
+    if (error) {
+        error->fault = vm->fault;
+        error->rip = vm->fault_rip;
+    }
+
+    return THORKELL_ERROR_FAULT;
+}
+
+ThorkellStatus thorkell_dump_cfg(const char* source, int flags, FILE* file, ThorkellError* error) {
+    cvector_vector_type(ParsedInstruction) parsed_instructions = NULL;
+    uint64_t start_rip = 0;
+
+    ThorkellStatus status = parse(source, flags, 0, &parsed_instructions, &start_rip, error);
+
+    if (status == THORKELL_OK) {
+        CFG* cfg = cfg_init(parsed_instructions, start_rip, NULL);
+
+        if (cfg)
+            cfg_dump(file, cfg, parsed_instructions, parser_symbols());
+        else
+            status = set_error(error, THORKELL_ERROR_PROGRAM, "a jump or the start label points outside the program");
+
+        cfg_deinit(cfg);
+    }
+
+    cvector_free(parsed_instructions);
+    parser_deinit();
+
+    return status;
+}
+
+/* only verified programs are compiled, the generated code leaves out what the verifier proves. */
+ThorkellStatus thorkell_emit_c(const char* source, int flags, const char* name, FILE* file, ThorkellError* error) {
+    cvector_vector_type(ParsedInstruction) parsed_instructions = NULL;
+    uint64_t start_rip = 0;
+
+    ThorkellStatus status = parse(source, flags, 0, &parsed_instructions, &start_rip, error);
+
+    if (status == THORKELL_OK) {
+        cvector_vector_type(uint8_t) code = parsed_instructions_codegen(parsed_instructions);
+        Verification verification = verify_program(code, cvector_size(code), start_rip);
+        CFG* cfg = verification.ok ? cfg_init(parsed_instructions, start_rip, NULL) : NULL;
+
+        if (!verification.ok) {
+            status = set_error(error, THORKELL_ERROR_VERIFY, verification.message);
+
+            if (error)
+                error->rip = verification.rip;
+        } else if (!cfg) {
+            status = set_error(error, THORKELL_ERROR_PROGRAM, "a jump or the start label points outside the program");
+        } else {
+            aot_emit_c(file, name, parsed_instructions, cfg, parser_symbols(), code, cvector_size(code), start_rip);
+        }
+
+        cfg_deinit(cfg);
+        cvector_free(code);
+    }
+
+    cvector_free(parsed_instructions);
+    parser_deinit();
+
+    return status;
+}
+
+/* assembles and verifies at build time what embedded_load would otherwise redo at startup.
+ * every label is exported as an entry point, so each is optimized and verified as one. */
+ThorkellStatus thorkell_embed(const char* source, int flags, const char* name, FILE* file, ThorkellError* error) {
+    cvector_vector_type(ParsedInstruction) parsed_instructions = NULL;
+    uint64_t start_rip = 0;
+
+    ThorkellStatus status = parse(source, flags, 1, &parsed_instructions, &start_rip, error);
+
+    if (status == THORKELL_OK) {
+        cvector_vector_type(uint8_t) code = parsed_instructions_codegen(parsed_instructions);
+        cvector_vector_type(Symbol) symbols = parser_symbols();
+        cvector_vector_type(uint64_t) entries = NULL;
+
+        for (size_t i = 0; i < cvector_size(symbols); i++)
+            cvector_push_back(entries, symbols[i].ip);
+
+        Verification verification = verify_program_entries(code, cvector_size(code), start_rip, entries, cvector_size(entries));
+
+        cvector_free(entries);
+
+        if (verification.ok) {
+            embed_emit_c(file, name, code, cvector_size(code), start_rip, parser_symbols(), verification.stack_safe);
+        } else {
+            status = set_error(error, THORKELL_ERROR_VERIFY, verification.message);
+
+            if (error)
+                error->rip = verification.rip;
+        }
+
+        cvector_free(code);
+    }
+
+    cvector_free(parsed_instructions);
+    parser_deinit();
+
+    return status;
+}
+
+const char* thorkell_status_name(ThorkellStatus status) {
+    switch (status) {
+    case THORKELL_OK:            return "ok";
+    case THORKELL_ERROR_SYNTAX:  return "syntax error";
+    case THORKELL_ERROR_PROGRAM: return "invalid program";
+    case THORKELL_ERROR_VERIFY:  return "verification failed";
+    case THORKELL_ERROR_FAULT:   return "fault";
+    case THORKELL_ERROR_MEMORY:  return "out of memory";
+    }
+
+    return "unknown";
+}
@@ -0,0 +1,53 @@
+#ifndef THORKELL_H
+#define THORKELL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cvector.h"
+#include "vm.h"
+#include "profile.h"
+#include "layout.h"
+
+#define THORKELL_OPTIMIZE 0x1
+#define THORKELL_ERROR_MAX 256
+#define THORKELL_ASSEMBLER_VERSION 1 /* bump whenever the same source assembles to different bytes */
+
+typedef enum ThorkellStatus_t {
+    THORKELL_OK,
+    THORKELL_ERROR_SYNTAX,
+    THORKELL_ERROR_PROGRAM,
+    THORKELL_ERROR_VERIFY,
+    THORKELL_ERROR_FAULT,
+    THORKELL_ERROR_MEMORY,
+} ThorkellStatus;
+
+typedef struct ThorkellError_t {
+    ThorkellStatus status;
+    size_t line; /* where in the source, for syntax errors */
+    size_t col;
+    VMFault fault; /* what and where in the bytecode, for faults and verification */
+    uint64_t rip;
+    char message[THORKELL_ERROR_MAX];
+} ThorkellError;
+
+typedef struct ThorkellProgram_t {
+    cvector_vector_type(uint8_t) code;
+    uint64_t start_rip;
+} ThorkellProgram;
+
+/* none of these terminate the process, failures come back as a status with error filled in.
+ * error may be NULL when the caller only cares about the status. different sources may be
+ * assembled and different vms executed on different threads at the same time. */
+ThorkellStatus thorkell_assemble(const char* source, int flags, ThorkellProgram* program, ThorkellError* error);
+ThorkellStatus thorkell_assemble_profiled(const char* source, int flags, const Profile* profile, ThorkellProgram* program, LayoutStats* stats, ThorkellError* error);
+void thorkell_program_free(ThorkellProgram* program);
+VM* thorkell_load(const ThorkellProgram* program, uint64_t memory_size, ThorkellError* error);
+ThorkellStatus thorkell_execute(VM* vm, ThorkellError* error);
+ThorkellStatus thorkell_dump_cfg(const char* source, int flags, FILE* file, ThorkellError* error);
+ThorkellStatus thorkell_emit_c(const char* source, int flags, const char* name, FILE* file, ThorkellError* error);
+ThorkellStatus thorkell_embed(const char* source, int flags, const char* name, FILE* file, ThorkellError* error);
+
+const char* thorkell_status_name(ThorkellStatus status);
+
+#endif /* THORKELL_H */
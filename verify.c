@@ -0,0 +1,329 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cvector.h"
+#include "verify.h"
+#include "vm.h"
+
+#define DEPTH_UNSEEN  -1
+#define DEPTH_UNKNOWN -2
+
+/* operands, one character each: r register, v vector register, * every remaining
+ * byte is a register, i the remaining bytes are an immediate, t they are a jump target. */
+typedef struct Shape_t {
+    uint8_t min_len;
+    uint8_t max_len;
+    const char* operands;
+} Shape;
+
+static const Shape g_shapes[INS_COUNT] = {
+    [INS_HALT]       = { 2,  2,   "" },
+    [INS_IADD]       = { 3,  11,  "ri" },
+    [INS_ISUB]       = { 3,  11,  "ri" },
+    [INS_IMUL]       = { 3,  11,  "ri" },
+    [INS_IDIV]       = { 3,  11,  "ri" },
+    [INS_ADD]        = { 4,  255, "r*" },
+    [INS_SUB]        = { 4,  255, "r*" },
+    [INS_MUL]        = { 4,  255, "r*" },
+    [INS_DIV]        = { 4,  255, "r*" },
+    [INS_IPUSH]      = { 2,  10,  "i" },
+    [INS_PUSH]       = { 3,  255, "*" },
+    [INS_POP]        = { 3,  3,   "r" },
+    [INS_IMOVE]      = { 3,  11,  "ri" },
+    [INS_MOVE]       = { 4,  4,   "rr" },
+    [INS_ICMP]       = { 3,  11,  "ri" },
+    [INS_CMP]        = { 4,  4,   "rr" },
+    [INS_JMP]        = { 2,  10,  "t" },
+    [INS_JE]         = { 2,  10,  "t" },
+    [INS_JNE]        = { 2,  10,  "t" },
+    [INS_JG]         = { 2,  10,  "t" },
+    [INS_JL]         = { 2,  10,  "t" },
+    [INS_JGE]        = { 2,  10,  "t" },
+    [INS_JLE]        = { 2,  10,  "t" },
+    [INS_LOOP]       = { 11, 11,  "rt" },
+    [INS_CALL]       = { 2,  10,  "t" },
+    [INS_RET]        = { 2,  2,   "" },
+    [INS_LOADB]      = { 12, 12,  "rri" },
+    [INS_LOADW]      = { 12, 12,  "rri" },
+    [INS_LOADD]      = { 12, 12,  "rri" },
+    [INS_LOADQ]      = { 12, 12,  "rri" },
+    [INS_STOREB]     = { 12, 12,  "rri" },
+    [INS_STOREW]     = { 12, 12,  "rri" },
+    [INS_STORED]     = { 12, 12,  "rri" },
+    [INS_STOREQ]     = { 12, 12,  "rri" },
+    [INS_MEMCPY]     = { 5,  5,   "rrr" },
+    [INS_MEMSET]     = { 5,  5,   "rrr" },
+    [INS_VADD]       = { 4,  4,   "vv" },
+    [INS_VSUB]       = { 4,  4,   "vv" },
+    [INS_VMUL]       = { 4,  4,   "vv" },
+    [INS_VSUM]       = { 4,  4,   "rv" },
+    [INS_VSPLAT]     = { 4,  4,   "vr" },
+    [INS_VLOAD]      = { 12, 12,  "vri" },
+    [INS_VSTORE]     = { 12, 12,  "vri" },
+    [INS_CALLNATIVE] = { 3,  3,   "i" },
+    [INS_SDIV]       = { 4,  255, "r*" },
+    [INS_ISDIV]      = { 3,  11,  "ri" },
+    [INS_ADDO]       = { 4,  4,   "rr" },
+    [INS_SUBO]       = { 4,  4,   "rr" },
+    [INS_MULO]       = { 4,  4,   "rr" },
+    [INS_SCMP]       = { 4,  4,   "rr" },
+    [INS_ISCMP]      = { 3,  11,  "ri" },
+    [INS_WMUL]       = { 5,  5,   "rrr" },
+    [INS_JO]         = { 2,  10,  "t" },
+    [INS_JC]         = { 2,  10,  "t" },
+};
+
+static Verification verification_error(uint64_t rip, const char* message) {
+    return (Verification) {
+        .ok = 0,
+        .rip = rip,
+        .message = message,
+        .stack_safe = 0,
+        .max_stack = 0,
+    };
+}
+
+/* checks the operands of the instruction at ins against its shape, NULL when they fit. */
+static const char* check_operands(const uint8_t* ins, const Shape* shape, uint64_t* target, int* has_target) {
+    uint8_t len = ins[0];
+    uint8_t at = 2;
+
+    *has_target = 0;
+
+    for (const char* kind = shape->operands; *kind; kind++) {
+        switch (*kind) {
+        case 'r':
+            if (ins[at] >= REGISTER_MAX)
+                return "register out of range";
+
+            at += 1;
+            break;
+
+        case 'v':
+            if (ins[at] >= VREGISTER_MAX)
+                return "vector register out of range";
+
+            at += 1;
+            break;
+
+        case '*':
+            for (; at < len; at++) {
+                if (ins[at] >= REGISTER_MAX)
+                    return "register out of range";
+            }
+
+            break;
+
+        case 'i':
+            at = len;
+            break;
+
+        case 't':
+            *target = 0;
+            memcpy(target, &ins[at], len - at);
+            *has_target = 1;
+
+            at = len;
+            break;
+        }
+    }
+
+    return at == len ? NULL : "operands do not match the instruction length";
+}
+
+static int falls_through(Instruction instruction) {
+    return instruction != INS_HALT && instruction != INS_JMP && instruction != INS_RET;
+}
+
+static void merge_depth(int64_t* depth, cvector_vector_type(uint64_t)* worklist, uint64_t rip, int64_t incoming) {
+    if (depth[rip] == incoming || depth[rip] == DEPTH_UNKNOWN)
+        return;
+
+    depth[rip] = depth[rip] == DEPTH_UNSEEN ? incoming : DEPTH_UNKNOWN;
+    cvector_push_back(*worklist, rip);
+}
+
+/* tracks the data stack depth along every path from each of the roots, all entered with
+ * an empty stack. a program is stack safe when each reachable push and pop sees a single
+ * known depth that keeps it in bounds. calls and natives may move the stack arbitrarily,
+ * so the depth after them is unknown. */
+static int analyse_stack(const uint8_t* instructions, cvector_vector_type(uint64_t) roots, int64_t* depth, uint64_t* max_stack) {
+    cvector_vector_type(uint64_t) worklist = NULL;
+    int safe = 1;
+
+    *max_stack = 0;
+
+    for (size_t i = 0; i < cvector_size(roots); i++)
+        merge_depth(depth, &worklist, roots[i], 0);
+
+    while (!cvector_empty(worklist)) {
+        uint64_t rip = worklist[cvector_size(worklist) - 1];
+        cvector_pop_back(worklist);
+
+        const uint8_t* ins = &instructions[rip];
+        uint8_t len = ins[0];
+        Instruction instruction = ins[1];
+        int64_t in = depth[rip];
+        int64_t out = in;
+
+        switch (instruction) {
+        case INS_IPUSH:
+        case INS_PUSH: {
+            int64_t pushed = sizeof(uint64_t) * (instruction == INS_IPUSH ? 1 : len - 2);
+
+            if (in == DEPTH_UNKNOWN || in + pushed >= STACK_MAX) {
+                safe = 0;
+                out = DEPTH_UNKNOWN;
+            } else {
+                out = in + pushed;
+            }
+
+            break;
+        }
+
+        case INS_POP:
+            if (in == DEPTH_UNKNOWN || in < (int64_t)sizeof(uint64_t)) {
+                safe = 0;
+                out = DEPTH_UNKNOWN;
+            } else {
+                out = in - sizeof(uint64_t);
+            }
+
+            break;
+
+        case INS_CALLNATIVE:
+            out = DEPTH_UNKNOWN;
+            break;
+
+        default:
+            break;
+        }
+
+        if (out >= 0 && (uint64_t)out > *max_stack)
+            *max_stack = out;
+
+        uint64_t target = 0;
+        int has_target = 0;
+
+        check_operands(ins, &g_shapes[instruction], &target, &has_target);
+
+        if (has_target) {
+            merge_depth(depth, &worklist, target, out);
+
+            if (instruction == INS_CALL)
+                out = DEPTH_UNKNOWN;
+        }
+
+        if (falls_through(instruction))
+            merge_depth(depth, &worklist, rip + len, out);
+    }
+
+    cvector_free(worklist);
+
+    return safe;
+}
+
+Verification verify_program(const uint8_t* instructions, uint64_t size, uint64_t start_rip) {
+    return verify_program_entries(instructions, size, start_rip, NULL, 0);
+}
+
+/* one linear pass for instruction boundaries, opcodes and operands, then jump targets
+ * and the start have to land on instruction starts, then the stack depth analysis from
+ * the start and every entry, the other places a fresh vm may be started at. entries
+ * that are not instructions, like a label at the very end, are no place to start. */
+Verification verify_program_entries(const uint8_t* instructions, uint64_t size, uint64_t start_rip, const uint64_t* entries, size_t entry_count) {
+    if (!instructions || size == 0)
+        return verification_error(0, "empty program");
+
+    uint8_t* is_start = calloc(size, 1);
+    uint64_t last = 0;
+
+    for (uint64_t rip = 0; rip < size; rip += instructions[rip]) {
+        if (size - rip < 2) {
+            free(is_start);
+            return verification_error(rip, "truncated instruction");
+        }
+
+        uint8_t len = instructions[rip];
+        uint8_t op_code = instructions[rip + 1];
+
+        if (op_code >= INS_COUNT || g_shapes[op_code].min_len == 0) {
+            free(is_start);
+            return verification_error(rip, "unknown opcode");
+        }
+
+        const Shape* shape = &g_shapes[op_code];
+
+        if (len < shape->min_len || len > shape->max_len) {
+            free(is_start);
+            return verification_error(rip, "bad instruction length");
+        }
+
+        if (len > size - rip) {
+            free(is_start);
+            return verification_error(rip, "instruction runs past the end of the program");
+        }
+
+        uint64_t target = 0;
+        int has_target = 0;
+        const char* message = check_operands(&instructions[rip], shape, &target, &has_target);
+
+        if (message) {
+            free(is_start);
+            return verification_error(rip, message);
+        }
+
+        is_start[rip] = 1;
+        last = rip;
+    }
+
+    if (falls_through(instructions[last + 1])) {
+        free(is_start);
+        return verification_error(last, "execution can run off the end of the program");
+    }
+
+    if (start_rip >= size || !is_start[start_rip]) {
+        free(is_start);
+        return verification_error(start_rip, "start is not an instruction");
+    }
+
+    for (uint64_t rip = 0; rip < size; rip += instructions[rip]) {
+        uint64_t target = 0;
+        int has_target = 0;
+
+        check_operands(&instructions[rip], &g_shapes[instructions[rip + 1]], &target, &has_target);
+
+        if (has_target && (target >= size || !is_start[target])) {
+            free(is_start);
+            return verification_error(rip, "jump target is not an instruction");
+        }
+    }
+
+    cvector_vector_type(uint64_t) roots = NULL;
+    cvector_push_back(roots, start_rip);
+
+    for (size_t i = 0; i < entry_count; i++) {
+        if (entries[i] < size && is_start[entries[i]])
+            cvector_push_back(roots, entries[i]);
+    }
+
+    free(is_start);
+
+    int64_t* depth = malloc(size * sizeof(int64_t));
+
+    for (uint64_t rip = 0; rip < size; rip++)
+        depth[rip] = DEPTH_UNSEEN;
+
+    Verification verification = {
+        .ok = 1,
+        .rip = 0,
+        .message = NULL,
+    };
+
+    verification.stack_safe = analyse_stack(instructions, roots, depth, &verification.max_stack);
+
+    cvector_free(roots);
+    free(depth);
+
+    return verification;
+}
@@ -0,0 +1,18 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Verification_t {
+    int ok;
+    uint64_t rip; /* first offending instruction when not ok */
+    const char* message;
+    int stack_safe; /* every reachable push and pop provably stays inside the stack */
+    uint64_t max_stack; /* deepest the stack gets, only meaningful when stack_safe */
+} Verification;
+
+Verification verify_program(const uint8_t* instructions, uint64_t size, uint64_t start_rip);
+Verification verify_program_entries(const uint8_t* instructions, uint64_t size, uint64_t start_rip, const uint64_t* entries, size_t entry_count);
+
+#endif /* VERIFY_H */
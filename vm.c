@@ -1,41 +1,57 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/mman.h>
 
 #include "vm.h"
 
-static void push_stack_byte(VM* vm, uint8_t byte) {
-    if (vm->rsp >= STACK_MAX) {
-        fprintf(stderr, "ERROR: stackoverflow\n");
-        exit(-1);
+/* shared by every vm, filled in by the host before any of them run. */
+static NativeFunction g_natives[NATIVE_MAX];
+static const char* g_native_names[NATIVE_MAX];
+
+/* the stack helpers take checked as a constant, the unchecked interpreter only runs
+ * programs the verifier proved to stay inside the stack. */
+static void push_stack_byte(VM* vm, uint8_t byte, const int checked) {
+    if (checked && vm->rsp >= STACK_MAX) {
+        vm_fault(vm, VM_FAULT_STACK_OVERFLOW);
+        return;
     }
 
     STACK(0) = byte;
     vm->rsp += 1;
 }
 
-static void pop_stack_qword(VM* vm, uint8_t dst) {
-    uint8_t* bytes = (uint8_t*)&REG(dst);
-    uint8_t* stack_bytes = &STACK(-8);
+static void count_pushes(VM* vm, uint64_t values) {
+    vm->stats.pushes += values;
 
+    if (vm->rsp > vm->stats.max_rsp)
+        vm->stats.max_rsp = vm->rsp;
+}
+
+static void pop_stack_qword(VM* vm, uint8_t dst, const int checked) {
     uint64_t current_rsp = vm->rsp;
     uint64_t diff = current_rsp - sizeof(uint64_t);
 
-    if (vm->rsp == 0 || diff > current_rsp) {
-        fprintf(stderr, "ERROR: stackoverflow\n");
-        exit(-1);
+    if (checked && (vm->rsp == 0 || diff > current_rsp)) {
+        vm_fault(vm, VM_FAULT_STACK_UNDERFLOW);
+        return;
     }
 
+    uint8_t* bytes = (uint8_t*)&REG(dst);
+    uint8_t* stack_bytes = &STACK(-8);
+
     for (uint8_t i = 0; i < sizeof(uint64_t); i++)
         bytes[i] = stack_bytes[i];
 
     vm->rsp -= 8;
+    vm->stats.pops += 1;
 }
 
-static void push_stack_immediate(VM* vm, const uint8_t* operand, uint8_t len) {
-    if (vm->rsp + len >= STACK_MAX) {
-        fprintf(stderr, "ERROR: stackoverflow\n");
-        exit(-1);
+static void push_stack_immediate(VM* vm, const uint8_t* operand, uint8_t len, const int checked) {
+    if (checked && vm->rsp + (len > sizeof(uint64_t) ? len : sizeof(uint64_t)) >= STACK_MAX) {
+        vm_fault(vm, VM_FAULT_STACK_OVERFLOW);
+        return;
     }
 
     for (uint8_t i = 0; i < len; i++)
@@ -47,20 +63,27 @@ static void push_stack_immediate(VM* vm, const uint8_t* operand, uint8_t len) {
     }
 
     vm->rsp += len;
+    count_pushes(vm, 1);
 }
 
-static void push_stack_register(VM* vm, const uint8_t* registers, uint8_t len) {
-    if (vm->rsp + len >= STACK_MAX) {
-        fprintf(stderr, "ERROR: stackoverflow\n");
-        exit(-1);
+static void push_stack_register(VM* vm, const uint8_t* registers, uint8_t len, const int checked) {
+    if (checked && vm->rsp + len >= STACK_MAX) {
+        vm_fault(vm, VM_FAULT_STACK_OVERFLOW);
+        return;
     }
 
     for (uint8_t i = 0; i < len; i++) {
         uint8_t* bytes = (uint8_t*)&REG(registers[i]);
 
         for (uint8_t j = 0; j < sizeof(uint64_t); j++)
-            push_stack_byte(vm, bytes[j]);
+            push_stack_byte(vm, bytes[j], checked);
     }
+
+    /* the check above counts registers not bytes, the bytes can still run off the end. */
+    if (checked && vm->fault != VM_FAULT_NONE)
+        return;
+
+    count_pushes(vm, len);
 }
 
 static void move_immediate(VM* vm, uint8_t dst, const uint8_t* operand, uint8_t len) {
@@ -95,6 +118,24 @@ static void compare_register(VM* vm, uint8_t lhs, uint8_t rhs) {
     set_flags(vm, REG(lhs), REG(rhs));
 }
 
+/* scmp sets the same flags as cmp but orders the operands as two's complement, so the
+ * usual jg, jl, jge and jle become signed branches. */
+static void set_signed_flags(VM* vm, int64_t lhs, int64_t rhs) {
+    FEQ   = lhs == rhs;
+    FNEQ  = lhs != rhs;
+    FGT   = lhs >  rhs;
+    FLT   = lhs <  rhs;
+    FGTEQ = lhs >= rhs;
+    FLTEQ = lhs <= rhs;
+}
+
+static void signed_compare_immediate(VM* vm, uint8_t lhs, const uint8_t* operand, uint8_t len) {
+    uint64_t rhs = 0;
+
+    memcpy(&rhs, operand, len);
+    set_signed_flags(vm, (int64_t)REG(lhs), (int64_t)rhs);
+}
+
 static void arithmetic_op_immediate(VM* vm, uint8_t dst, const uint8_t* operand, uint8_t len, uint8_t op) {
     uint64_t rhs = 0;
     uint8_t* bytes = (uint8_t*)&rhs;
@@ -113,6 +154,11 @@ static void arithmetic_op_immediate(VM* vm, uint8_t dst, const uint8_t* operand,
         REG(dst) *= rhs;
         break;
     case '/':
+        if (rhs == 0) {
+            vm_fault(vm, VM_FAULT_DIVIDE_BY_ZERO);
+            return;
+        }
+
         REG(dst) /= rhs;
         break;
     default:
@@ -137,16 +183,100 @@ static void arithmetic_op_register(VM* vm, uint8_t dst, const uint8_t* registers
             REG(dst) *= REG(registers[i]);
 
         break;
-    case '/':
-        for (uint8_t i = 0; i < len; i++)
-            REG(dst) /= REG(registers[i]);
+    case '/': {
+        /* divides into a copy so a zero divisor faults with dst untouched. */
+        uint64_t quotient = REG(dst);
+
+        for (uint8_t i = 0; i < len; i++) {
+            if (REG(registers[i]) == 0) {
+                vm_fault(vm, VM_FAULT_DIVIDE_BY_ZERO);
+                return;
+            }
 
+            quotient /= REG(registers[i]);
+        }
+
+        REG(dst) = quotient;
         break;
+    }
     default:
         break;
     }
 }
 
+/* two's complement division, truncating toward zero like c does. */
+static int signed_divide(VM* vm, int64_t* quotient, int64_t divisor) {
+    if (divisor == 0) {
+        vm_fault(vm, VM_FAULT_DIVIDE_BY_ZERO);
+        return 0;
+    }
+
+    if (divisor == -1 && *quotient == INT64_MIN) {
+        vm_fault(vm, VM_FAULT_DIVIDE_OVERFLOW);
+        return 0;
+    }
+
+    *quotient /= divisor;
+    return 1;
+}
+
+static void signed_divide_immediate(VM* vm, uint8_t dst, const uint8_t* operand, uint8_t len) {
+    uint64_t rhs = 0;
+    int64_t quotient = (int64_t)REG(dst);
+
+    memcpy(&rhs, operand, len);
+
+    if (signed_divide(vm, &quotient, (int64_t)rhs))
+        REG(dst) = (uint64_t)quotient;
+}
+
+static void signed_divide_register(VM* vm, uint8_t dst, const uint8_t* registers, uint8_t len) {
+    int64_t quotient = (int64_t)REG(dst);
+
+    for (uint8_t i = 0; i < len; i++) {
+        if (!signed_divide(vm, &quotient, (int64_t)REG(registers[i])))
+            return;
+    }
+
+    REG(dst) = (uint64_t)quotient;
+}
+
+/* dst op= src, OF says whether the signed result wrapped and CF whether the unsigned one
+ * did, both straight from the compiler's overflow builtins. the other flags are left alone. */
+static void checked_arithmetic(VM* vm, uint8_t dst, uint8_t src, uint8_t op) {
+    uint64_t lhs = REG(dst);
+    uint64_t rhs = REG(src);
+    uint64_t result = 0;
+    int64_t signed_result = 0;
+
+    switch (op) {
+    case '+':
+        FCF = __builtin_add_overflow(lhs, rhs, &result);
+        FOF = __builtin_add_overflow((int64_t)lhs, (int64_t)rhs, &signed_result);
+        break;
+    case '-':
+        FCF = __builtin_sub_overflow(lhs, rhs, &result);
+        FOF = __builtin_sub_overflow((int64_t)lhs, (int64_t)rhs, &signed_result);
+        break;
+    case '*':
+        FCF = __builtin_mul_overflow(lhs, rhs, &result);
+        FOF = __builtin_mul_overflow((int64_t)lhs, (int64_t)rhs, &signed_result);
+        break;
+    default:
+        return;
+    }
+
+    REG(dst) = result;
+}
+
+/* hi:lo = lo * src, the full 128 bit unsigned product. */
+static void widening_multiply(VM* vm, uint8_t hi, uint8_t lo, uint8_t src) {
+    unsigned __int128 product = (unsigned __int128)REG(lo) * REG(src);
+
+    REG(lo) = (uint64_t)product;
+    REG(hi) = (uint64_t)(product >> 64);
+}
+
 static void load_rip_immediate(VM* vm, const uint8_t* operand, uint8_t len) {
     uint64_t new_rip = 0;
     uint8_t* bytes = (uint8_t*)&new_rip;
@@ -155,9 +285,134 @@ static void load_rip_immediate(VM* vm, const uint8_t* operand, uint8_t len) {
         bytes[i] = operand[i];
 
     vm->rip = new_rip;
+    vm->stats.jumps_taken += 1;
+}
+
+static void call_immediate(VM* vm, const uint8_t* operand, uint8_t len, uint64_t return_rip) {
+    if (vm->rcsp >= CALL_STACK_MAX) {
+        vm_fault(vm, VM_FAULT_CALL_STACK_OVERFLOW);
+        return;
+    }
+
+    vm->call_stack[vm->rcsp] = return_rip;
+    vm->rcsp += 1;
+
+    load_rip_immediate(vm, operand, len);
+}
+
+static void return_from_call(VM* vm) {
+    if (vm->rcsp == 0) {
+        vm_fault(vm, VM_FAULT_CALL_STACK_UNDERFLOW);
+        return;
+    }
+
+    vm->rcsp -= 1;
+    vm->rip = vm->call_stack[vm->rcsp];
+    vm->stats.jumps_taken += 1;
+}
+
+/* bounds checked pointer into the linear memory, NULL after faulting the vm. */
+static uint8_t* memory_at(VM* vm, uint64_t address, uint64_t len) {
+    if (address > vm->memory_size || len > vm->memory_size - address) {
+        vm_fault(vm, VM_FAULT_MEMORY_BOUNDS);
+        return NULL;
+    }
+
+    return &vm->memory[address];
+}
+
+static uint64_t effective_address(VM* vm, uint8_t base, const uint8_t* operand) {
+    uint64_t offset = 0;
+    memcpy(&offset, operand, sizeof(uint64_t));
+
+    return REG(base) + offset;
+}
+
+static void load_memory(VM* vm, uint8_t dst, uint8_t base, const uint8_t* operand, uint8_t width) {
+    const uint8_t* from = memory_at(vm, effective_address(vm, base, operand), width);
+    uint64_t value = 0;
+
+    if (!from)
+        return;
+
+    memcpy(&value, from, width);
+    REG(dst) = value;
+}
+
+static void store_memory(VM* vm, uint8_t src, uint8_t base, const uint8_t* operand, uint8_t width) {
+    uint8_t* to = memory_at(vm, effective_address(vm, base, operand), width);
+
+    if (to)
+        memcpy(to, &REG(src), width);
 }
 
-static void evaluate(VM* vm) {
+/* memcpy dst, src, len with memmove semantics so overlapping ranges behave. */
+static void copy_memory(VM* vm, uint8_t dst, uint8_t src, uint8_t len) {
+    uint8_t* to = memory_at(vm, REG(dst), REG(len));
+    uint8_t* from = memory_at(vm, REG(src), REG(len));
+
+    if (to && from)
+        memmove(to, from, REG(len));
+}
+
+static void fill_memory(VM* vm, uint8_t dst, uint8_t value, uint8_t len) {
+    uint8_t* to = memory_at(vm, REG(dst), REG(len));
+
+    if (to)
+        memset(to, (uint8_t)REG(value), REG(len));
+}
+
+/* runs the native registered under id, faulting the vm when there is none, or hands
+ * both to the native hook when the vm has one. */
+void vm_call_native(VM* vm, uint8_t id) {
+    NativeFunction function = g_natives[id];
+
+    if (vm->native_hook) {
+        vm->native_hook(vm, id, function, vm->native_hook_data);
+        return;
+    }
+
+    if (!function) {
+        vm_fault(vm, VM_FAULT_UNKNOWN_NATIVE);
+        return;
+    }
+
+    function(vm);
+}
+
+/* the len bytes at address a native is about to write, NULL after faulting the vm
+ * like a store out of bounds would. */
+uint8_t* vm_native_memory(VM* vm, uint64_t address, uint64_t len) {
+    uint8_t* to = memory_at(vm, address, len);
+
+    if (to && vm->native_write_hook)
+        vm->native_write_hook(vm, address, len, vm->native_hook_data);
+
+    return to;
+}
+
+static void vector_load(VM* vm, uint8_t dst, uint8_t base, const uint8_t* operand) {
+    const uint8_t* from = memory_at(vm, effective_address(vm, base, operand), sizeof(VREG(dst)));
+
+    if (from)
+        memcpy(VREG(dst), from, sizeof(VREG(dst)));
+}
+
+static void vector_store(VM* vm, uint8_t src, uint8_t base, const uint8_t* operand) {
+    uint8_t* to = memory_at(vm, effective_address(vm, base, operand), sizeof(VREG(src)));
+
+    if (to)
+        memcpy(to, VREG(src), sizeof(VREG(src)));
+}
+
+static void vector_splat(VM* vm, uint8_t dst, uint8_t src) {
+    for (uint8_t i = 0; i < VECTOR_LANES; i++)
+        VREG(dst)[i] = REG(src);
+}
+
+/* instantiated twice below, checked is a constant so each copy keeps only its own checks. */
+__attribute__((always_inline))
+static inline void evaluate(VM* vm, const int checked) {
     const uint8_t ins_len = FETCH(0);
     const uint8_t op_code = FETCH(1);
 
@@ -199,15 +454,15 @@ static void evaluate(VM* vm) {
         break;
 
     case INS_IPUSH:
-        push_stack_immediate(vm, &FETCH(2), ins_len - 2);
+        push_stack_immediate(vm, &FETCH(2), ins_len - 2, checked);
         break;
 
     case INS_PUSH:
-        push_stack_register(vm, &FETCH(2), ins_len - 2);
+        push_stack_register(vm, &FETCH(2), ins_len - 2, checked);
         break;
 
     case INS_POP:
-        pop_stack_qword(vm, FETCH(2));
+        pop_stack_qword(vm, FETCH(2), checked);
         break;
 
     case INS_IMOVE:
@@ -277,42 +532,404 @@ static void evaluate(VM* vm) {
         }
 
         break;
+
+    /* fused sub reg, 1 / cmp reg, 0 / jg target, emitted by the optimizer. */
+    case INS_LOOP:
+        REG(FETCH(2)) -= 1;
+        set_flags(vm, REG(FETCH(2)), 0);
+
+        if (FGT) {
+            load_rip_immediate(vm, &FETCH(3), ins_len - 3);
+            return;
+        }
+
+        break;
+
+    case INS_CALL:
+        call_immediate(vm, &FETCH(2), ins_len - 2, vm->rip + ins_len);
+        return;
+
+    case INS_RET:
+        return_from_call(vm);
+        return;
+
+    case INS_LOADB:
+        load_memory(vm, FETCH(2), FETCH(3), &FETCH(4), 1);
+        break;
+
+    case INS_LOADW:
+        load_memory(vm, FETCH(2), FETCH(3), &FETCH(4), 2);
+        break;
+
+    case INS_LOADD:
+        load_memory(vm, FETCH(2), FETCH(3), &FETCH(4), 4);
+        break;
+
+    case INS_LOADQ:
+        load_memory(vm, FETCH(2), FETCH(3), &FETCH(4), 8);
+        break;
+
+    case INS_STOREB:
+        store_memory(vm, FETCH(2), FETCH(3), &FETCH(4), 1);
+        break;
+
+    case INS_STOREW:
+        store_memory(vm, FETCH(2), FETCH(3), &FETCH(4), 2);
+        break;
+
+    case INS_STORED:
+        store_memory(vm, FETCH(2), FETCH(3), &FETCH(4), 4);
+        break;
+
+    case INS_STOREQ:
+        store_memory(vm, FETCH(2), FETCH(3), &FETCH(4), 8);
+        break;
+
+    case INS_MEMCPY:
+        copy_memory(vm, FETCH(2), FETCH(3), FETCH(4));
+        break;
+
+    case INS_MEMSET:
+        fill_memory(vm, FETCH(2), FETCH(3), FETCH(4));
+        break;
+
+    case INS_VADD:
+        vm->simd->add(VREG(FETCH(2)), VREG(FETCH(3)));
+        break;
+
+    case INS_VSUB:
+        vm->simd->sub(VREG(FETCH(2)), VREG(FETCH(3)));
+        break;
+
+    case INS_VMUL:
+        vm->simd->mul(VREG(FETCH(2)), VREG(FETCH(3)));
+        break;
+
+    case INS_VSUM:
+        REG(FETCH(2)) = vm->simd->sum(VREG(FETCH(3)));
+        break;
+
+    case INS_VSPLAT:
+        vector_splat(vm, FETCH(2), FETCH(3));
+        break;
+
+    case INS_VLOAD:
+        vector_load(vm, FETCH(2), FETCH(3), &FETCH(4));
+        break;
+
+    case INS_VSTORE:
+        vector_store(vm, FETCH(2), FETCH(3), &FETCH(4));
+        break;
+
+    case INS_CALLNATIVE:
+        vm_call_native(vm, FETCH(2));
+        break;
+
+    case INS_SDIV:
+        signed_divide_register(vm, FETCH(2), &FETCH(3), ins_len - 3);
+        break;
+
+    case INS_ISDIV:
+        signed_divide_immediate(vm, FETCH(2), &FETCH(3), ins_len - 3);
+        break;
+
+    case INS_ADDO:
+        checked_arithmetic(vm, FETCH(2), FETCH(3), '+');
+        break;
+
+    case INS_SUBO:
+        checked_arithmetic(vm, FETCH(2), FETCH(3), '-');
+        break;
+
+    case INS_MULO:
+        checked_arithmetic(vm, FETCH(2), FETCH(3), '*');
+        break;
+
+    case INS_SCMP:
+        set_signed_flags(vm, (int64_t)REG(FETCH(2)), (int64_t)REG(FETCH(3)));
+        break;
+
+    case INS_ISCMP:
+        signed_compare_immediate(vm, FETCH(2), &FETCH(3), ins_len - 3);
+        break;
+
+    case INS_WMUL:
+        widening_multiply(vm, FETCH(2), FETCH(3), FETCH(4));
+        break;
+
+    case INS_JO:
+        if (FOF) {
+            load_rip_immediate(vm, &FETCH(2), ins_len - 2);
+            return;
+        }
+
+        break;
+
+    case INS_JC:
+        if (FCF) {
+            load_rip_immediate(vm, &FETCH(2), ins_len - 2);
+            return;
+        }
+
+        break;
     
     default:
-        fprintf(stderr, "ERROR: unknown opcode: '%2x'\n", op_code);
-        exit(-1);
+        if (!checked)
+            __builtin_unreachable();
+
+        vm_fault(vm, VM_FAULT_UNKNOWN_OPCODE);
+        return;
     }
 
     vm->rip += ins_len;
 }
 
+static void evaluate_checked(VM* vm) {
+    evaluate(vm, 1);
+}
+
+static void evaluate_unchecked(VM* vm) {
+    evaluate(vm, 0);
+}
+
+VMStatus vm_status(const VM* vm) {
+    if (vm->fault != VM_FAULT_NONE)
+        return VM_FAULTED;
+
+    return FETCH(0) == INS_HALT ? VM_HALTED : VM_RUNNING;
+}
+
+/* evaluate steps past a faulting instruction like any other, this puts rip back on it
+ * once the loop is done, so advancing rip needs no fault check in every instruction. */
+static void settle_fault(VM* vm) {
+    if (vm->fault != VM_FAULT_NONE)
+        vm->rip = vm->fault_rip;
+}
+
+static uint64_t now_nanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/* runs until halt or the first fault, vm->fault tells the two apart. */
 void vm_execute(VM* vm) {
-    while (FETCH(0) != INS_HALT)
-        evaluate(vm);
+    uint64_t started = now_nanoseconds();
+    uint64_t instructions = 0;
+
+    if (vm->verified) {
+        for (; vm->fault == VM_FAULT_NONE && FETCH(0) != INS_HALT; instructions++)
+            evaluate_unchecked(vm);
+    } else {
+        for (; vm->fault == VM_FAULT_NONE && FETCH(0) != INS_HALT; instructions++)
+            evaluate_checked(vm);
+    }
+
+    /* the instruction count is kept in a local and added in once per call, a faulting
+     * instruction counts as retired. */
+    settle_fault(vm);
+    vm->stats.instructions += instructions;
+    vm->stats.nanoseconds += now_nanoseconds() - started;
+}
+
+/* executes at most quantum instructions, calling it again resumes where it stopped.
+ * it is not timed, a single step would cost more in the clock than in the instruction,
+ * whoever runs slices long enough to be worth it times them. */
+VMStatus vm_run(VM* vm, uint64_t quantum) {
+    if (quantum == 0) {
+        settle_fault(vm);
+        return vm_status(vm);
+    }
+
+    uint64_t i = 0;
+
+    for (; i < quantum; i++) {
+        if (vm->fault != VM_FAULT_NONE || FETCH(0) == INS_HALT)
+            break;
+
+        if (vm->verified)
+            evaluate_unchecked(vm);
+        else
+            evaluate_checked(vm);
+    }
+
+    settle_fault(vm);
+    vm->stats.instructions += i;
+
+    return vm_status(vm);
 }
 
-VM* vm_init(const uint8_t* instructions, uint64_t start_rip) {
+VM* vm_init(const uint8_t* instructions, uint64_t start_rip, uint64_t memory_size) {
     if (!instructions)
         return NULL;
 
     VM* vm = malloc(sizeof(VM));
+
+    if (!vm)
+        return NULL;
+
     memset(vm->flags, 0, FLAGS_MAX);
     memset(vm->registers, 0, REGISTER_MAX * sizeof(uint64_t));
+    memset(vm->vregisters, 0, sizeof(vm->vregisters));
+    vm->simd = simd_ops();
+
+    vm->memory = memory_size ? calloc(memory_size, 1) : NULL;
+    vm->memory_size = memory_size;
+
+    if (memory_size && !vm->memory) {
+        free(vm);
+        return NULL;
+    }
+
+    vm->memory_owner = VM_MEMORY_HEAP;
 
     vm->instructions = instructions;
     vm->rip = start_rip;
     vm->rsp = 0;
+    vm->rcsp = 0;
+    vm->fault = VM_FAULT_NONE;
+    vm->fault_rip = 0;
+    vm->verified = 0;
+    memset(&vm->stats, 0, sizeof(VMStats));
+    vm->native_hook = NULL;
+    vm->native_write_hook = NULL;
+    vm->native_hook_data = NULL;
 
     return vm;
 }
 
+static void release_memory(VM* vm) {
+    switch (vm->memory_owner) {
+    case VM_MEMORY_HEAP:
+        free(vm->memory);
+        break;
+    case VM_MEMORY_MAPPED:
+        if (vm->memory)
+            munmap(vm->memory, vm->memory_size);
+
+        break;
+    case VM_MEMORY_HOST:
+        break;
+    }
+}
+
 void vm_deinit(VM* vm) {
     if (!vm)
         return;
 
+    release_memory(vm);
+
     vm->instructions = NULL;
+    vm->memory = NULL;
     vm->rip = 0;
     vm->rsp = 0;
 
     free(vm);
 }
+
+/* makes a host buffer the vm's memory without copying it, the host keeps ownership. */
+void vm_map_memory(VM* vm, uint8_t* buffer, uint64_t size) {
+    release_memory(vm);
+
+    vm->memory = buffer;
+    vm->memory_size = buffer ? size : 0;
+    vm->memory_owner = VM_MEMORY_HOST;
+}
+
+/* stops the vm, the first fault wins and keeps the rip of the instruction that raised it. */
+void vm_fault(VM* vm, VMFault fault) {
+    if (vm->fault != VM_FAULT_NONE)
+        return;
+
+    vm->fault = fault;
+    vm->fault_rip = vm->rip;
+}
+
+const char* vm_fault_name(VMFault fault) {
+    switch (fault) {
+    case VM_FAULT_NONE:                 return "none";
+    case VM_FAULT_STACK_OVERFLOW:       return "stack overflow";
+    case VM_FAULT_STACK_UNDERFLOW:      return "stack underflow";
+    case VM_FAULT_CALL_STACK_OVERFLOW:  return "call stack overflow";
+    case VM_FAULT_CALL_STACK_UNDERFLOW: return "return with an empty call stack";
+    case VM_FAULT_MEMORY_BOUNDS:        return "memory access out of bounds";
+    case VM_FAULT_UNKNOWN_OPCODE:       return "unknown opcode";
+    case VM_FAULT_UNKNOWN_NATIVE:       return "no native function registered";
+    case VM_FAULT_NATIVE:               return "native function failed";
+    case VM_FAULT_DIVIDE_BY_ZERO:       return "division by zero";
+    case VM_FAULT_DIVIDE_OVERFLOW:      return "signed division overflow";
+    case VM_FAULT_COUNT:                break;
+    }
+
+    return "unknown";
+}
+
+void vm_register_native(uint8_t id, const char* name, NativeFunction function) {
+    g_natives[id] = function;
+    g_native_names[id] = name;
+}
+
+const char* vm_native_name(uint8_t id) {
+    return g_native_names[id];
+}
+
+const char* vm_instruction_name(Instruction instruction) {
+    switch (instruction) {
+    case INS_HALT:    return "halt";
+    case INS_IADD:    return "iadd";
+    case INS_ISUB:    return "isub";
+    case INS_IMUL:    return "imul";
+    case INS_IDIV:    return "idiv";
+    case INS_ADD:     return "add";
+    case INS_SUB:     return "sub";
+    case INS_MUL:     return "mul";
+    case INS_DIV:     return "div";
+    case INS_IPUSH:   return "ipush";
+    case INS_PUSH:    return "push";
+    case INS_POP:     return "pop";
+    case INS_IMOVE:   return "imove";
+    case INS_MOVE:    return "move";
+    case INS_ICMP:    return "icmp";
+    case INS_CMP:     return "cmp";
+    case INS_JMP:     return "jmp";
+    case INS_JE:      return "je";
+    case INS_JNE:     return "jne";
+    case INS_JG:      return "jg";
+    case INS_JL:      return "jl";
+    case INS_JGE:     return "jge";
+    case INS_JLE:     return "jle";
+    case INS_LOOP:    return "loop";
+    case INS_CALL:    return "call";
+    case INS_RET:     return "ret";
+    case INS_LOADB:   return "loadb";
+    case INS_LOADW:   return "loadw";
+    case INS_LOADD:   return "loadd";
+    case INS_LOADQ:   return "loadq";
+    case INS_STOREB:  return "storeb";
+    case INS_STOREW:  return "storew";
+    case INS_STORED:  return "stored";
+    case INS_STOREQ:  return "storeq";
+    case INS_MEMCPY:  return "memcpy";
+    case INS_MEMSET:  return "memset";
+    case INS_VADD:    return "vadd";
+    case INS_VSUB:    return "vsub";
+    case INS_VMUL:    return "vmul";
+    case INS_VSUM:    return "vsum";
+    case INS_VSPLAT:  return "vsplat";
+    case INS_VLOAD:   return "vload";
+    case INS_VSTORE:  return "vstore";
+    case INS_CALLNATIVE: return "callnative";
+    case INS_SDIV:    return "sdiv";
+    case INS_ISDIV:   return "isdiv";
+    case INS_ADDO:    return "addo";
+    case INS_SUBO:    return "subo";
+    case INS_MULO:    return "mulo";
+    case INS_SCMP:    return "scmp";
+    case INS_ISCMP:   return "iscmp";
+    case INS_WMUL:    return "wmul";
+    case INS_JO:      return "jo";
+    case INS_JC:      return "jc";
+    default:           return "unknown";
+    }
+}
@@ -3,11 +3,18 @@
 
 #include <stdint.h>
 
+#include "simd.h"
+
 #define STACK_MAX 2086
-#define FLAGS_MAX 6
-#define REGISTER_MAX 4
+#define CALL_STACK_MAX 1024
+#define MEMORY_DEFAULT (64 * 1024)
+#define FLAGS_MAX 8
+#define REGISTER_MAX 16
+#define VREGISTER_MAX 4
+#define NATIVE_MAX 256
 
 #define REG(x)   vm->registers[x]
+#define VREG(x)  vm->vregisters[x]
 #define STACK(x) vm->stack[vm->rsp + x]
 #define FETCH(x) vm->instructions[vm->rip + x]
 
@@ -17,6 +24,8 @@
 #define FLT   vm->flags[3]
 #define FGTEQ vm->flags[4]
 #define FLTEQ vm->flags[5]
+#define FOF   vm->flags[6] /* signed overflow of the last addo, subo or mulo */
+#define FCF   vm->flags[7] /* unsigned carry or borrow of the same */
 
 typedef enum Instruction_t {
     INS_HALT,
@@ -42,19 +51,134 @@ typedef enum Instruction_t {
     INS_JL,
     INS_JGE,
     INS_JLE,
+    INS_LOOP,
+    INS_CALL,
+    INS_RET,
+    INS_LOADB,
+    INS_LOADW,
+    INS_LOADD,
+    INS_LOADQ,
+    INS_STOREB,
+    INS_STOREW,
+    INS_STORED,
+    INS_STOREQ,
+    INS_MEMCPY,
+    INS_MEMSET,
+    INS_VADD,
+    INS_VSUB,
+    INS_VMUL,
+    INS_VSUM,
+    INS_VSPLAT,
+    INS_VLOAD,
+    INS_VSTORE,
+    INS_CALLNATIVE,
+    INS_SDIV,
+    INS_ISDIV,
+    INS_ADDO,
+    INS_SUBO,
+    INS_MULO,
+    INS_SCMP,
+    INS_ISCMP,
+    INS_WMUL,
+    INS_JO,
+    INS_JC,
+    INS_COUNT,
 } Instruction;
 
+typedef enum VMStatus_t {
+    VM_RUNNING,
+    VM_HALTED,
+    VM_FAULTED,
+} VMStatus;
+
+typedef enum VMFault_t {
+    VM_FAULT_NONE,
+    VM_FAULT_STACK_OVERFLOW,
+    VM_FAULT_STACK_UNDERFLOW,
+    VM_FAULT_CALL_STACK_OVERFLOW,
+    VM_FAULT_CALL_STACK_UNDERFLOW,
+    VM_FAULT_MEMORY_BOUNDS,
+    VM_FAULT_UNKNOWN_OPCODE,
+    VM_FAULT_UNKNOWN_NATIVE,
+    VM_FAULT_NATIVE,
+    VM_FAULT_DIVIDE_BY_ZERO,
+    VM_FAULT_DIVIDE_OVERFLOW,
+    VM_FAULT_COUNT,
+} VMFault;
+
+typedef enum VMMemoryOwner_t {
+    VM_MEMORY_HOST,   /* mapped in by the host through vm_map_memory */
+    VM_MEMORY_HEAP,   /* allocated by vm_init */
+    VM_MEMORY_MAPPED, /* a private mapping of a snapshot, unmapped on deinit */
+} VMMemoryOwner;
+
+/* host functions called through callnative <id>. the calling convention:
+ *  - arguments are read straight out of vm->registers, RA first, and any extra
+ *    arguments are popped off vm->stack by the callee.
+ *  - results are written back into RA (and RB for a second word), or pushed.
+ *  - every other register, the flags and vm->memory belong to the callee as well,
+ *    nothing is copied in or out, so a native sees exactly the state the bytecode left.
+ *  - memory a native writes it takes from vm_native_memory, which is all that record
+ *    and replay see of the write. reading vm->memory directly is fine.
+ *  - a native must not touch rip or the call stack, it reports errors through vm_fault. */
+struct VM_t;
+
+/* kept by the interpreter as it goes, the straight line path only pays for counting
+ * instructions in a register. */
+typedef struct VMStats_t {
+    uint64_t instructions; /* retired, halt included */
+    uint64_t jumps_taken; /* jumps, branches and loops that went to their target, calls and returns */
+    uint64_t pushes; /* values, a push of three registers is three */
+    uint64_t pops;
+    uint64_t max_rsp; /* the stack high water mark in bytes, out of STACK_MAX */
+    uint64_t nanoseconds; /* wall time spent in vm_execute and in scheduler slices, vm_run alone is not timed */
+} VMStats;
+
+typedef void (*NativeFunction)(struct VM_t* vm);
+
+/* called in place of every native the vm calls, with the one registered under id or
+ * NULL. record and replay use it to log what natives did and to play that back. */
+typedef void (*NativeHook)(struct VM_t* vm, uint8_t id, NativeFunction function, void* data);
+
+/* called with every range of memory a native takes from vm_native_memory to write. */
+typedef void (*NativeWriteHook)(struct VM_t* vm, uint64_t address, uint64_t len, void* data);
+
 typedef struct VM_t {
-    uint64_t registers[REGISTER_MAX]; /* A, B, C, D */
+    uint64_t registers[REGISTER_MAX]; /* A through P */
+    uint64_t vregisters[VREGISTER_MAX][VECTOR_LANES]; /* VA, VB, VC, VD */
     uint8_t flags[FLAGS_MAX];
     uint8_t stack[STACK_MAX];
+    uint64_t call_stack[CALL_STACK_MAX]; /* return addresses, kept apart from the data stack */
     const uint8_t* instructions;
+    uint8_t* memory; /* linear data memory, see memory_owner for who frees it */
+    uint64_t memory_size;
+    VMMemoryOwner memory_owner;
+    const SimdOps* simd;
     uint64_t rsp;
     uint64_t rip;
+    uint64_t rcsp;
+    VMFault fault; /* set once, the vm stops at the faulting instruction */
+    uint64_t fault_rip;
+    int verified; /* set by the host once verify_program proved the program stack safe */
+    VMStats stats;
+    NativeHook native_hook;
+    NativeWriteHook native_write_hook; /* given native_hook_data as well */
+    void* native_hook_data;
 } VM;
 
 void vm_execute(VM* vm);
-VM* vm_init(const uint8_t* instructions, uint64_t start_rip);
+VMStatus vm_run(VM* vm, uint64_t quantum);
+VMStatus vm_status(const VM* vm);
+VM* vm_init(const uint8_t* instructions, uint64_t start_rip, uint64_t memory_size);
 void vm_deinit(VM* vm);
+void vm_map_memory(VM* vm, uint8_t* buffer, uint64_t size);
+void vm_fault(VM* vm, VMFault fault);
+const char* vm_fault_name(VMFault fault);
+void vm_register_native(uint8_t id, const char* name, NativeFunction function);
+const char* vm_native_name(uint8_t id);
+void vm_call_native(VM* vm, uint8_t id);
+uint8_t* vm_native_memory(VM* vm, uint64_t address, uint64_t len);
+
+const char* vm_instruction_name(Instruction instruction);
 
 #endif /* VM_H */